@@ -0,0 +1,101 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <Arduino.h>
+#include <new>
+#include <utility>
+
+/*
+ * Fixed-block allocator for N objects of type T. Like the queues it keeps its storage inline (a global or static pool
+ * is a plain array in .bss), and the free blocks are a stack of indices, so alloc and free are O(1) and it never
+ * fragments the heap.
+ *
+ * alloc/free hand out raw blocks, create/destroy also construct and destruct the object in them.
+ * It's not thread safe, a pool belongs to one core.
+ */
+template <typename T, size_t N>
+class Pool
+{
+private:
+    alignas(T) uint8_t _storage[N][sizeof(T)];
+    uint16_t _free[N]; // stack of unused block indices
+    uint8_t _used[(N + 7) / 8] = {0}; // a bit per block, to catch double frees
+    size_t _n_free = N;
+    size_t _high_water = 0;
+
+    inline T *_block(size_t idx) { return reinterpret_cast<T *>(_storage[idx]); }
+    inline size_t _index(const T *ptr) const
+    {
+        return (reinterpret_cast<const uint8_t *>(ptr) - _storage[0]) / sizeof(T);
+    }
+    inline bool _is_used(size_t idx) const { return _used[idx / 8] & (1 << (idx % 8)); }
+    inline void _set_used(size_t idx, bool used)
+    {
+        if (used) _used[idx / 8] |= (1 << (idx % 8));
+        else _used[idx / 8] &= ~(1 << (idx % 8));
+    }
+
+public:
+    Pool()
+    {
+        static_assert(N > 0, "Can't have an empty pool");
+        static_assert(N < 0xFFFF, "Pool indices are 16 bits");
+        // the lowest blocks are handed out first
+        for (size_t i = 0; i < N; i++)
+            _free[i] = N - 1 - i;
+    }
+
+    // returns NULL if every block is in use. the block is uninitialized
+    T *alloc()
+    {
+        if (_n_free == 0) return NULL;
+        const uint16_t idx = _free[--_n_free];
+        _set_used(idx, true);
+        if (in_use() > _high_water) _high_water = in_use();
+        return _block(idx);
+    }
+
+    // false if ptr doesn't belong to this pool (NULL included) or its block was already free
+    bool free(T *ptr)
+    {
+        if (!owns(ptr)) return false;
+        const size_t idx = _index(ptr);
+        if (!_is_used(idx) || _n_free >= N) return false;
+        _set_used(idx, false);
+        _free[_n_free++] = idx;
+        return true;
+    }
+
+    template <typename... Args>
+    T *create(Args&&... args)
+    {
+        T *block = alloc();
+        if (!block) return NULL;
+        return new (block) T(std::forward<Args>(args)...);
+    }
+
+    bool destroy(T *ptr)
+    {
+        // a second destroy mustn't run the destructor again
+        if (!owns(ptr) || !_is_used(_index(ptr))) return false;
+        ptr->~T();
+        return free(ptr);
+    }
+
+    // true if ptr is the start of one of the blocks of this pool
+    bool owns(const void *ptr) const
+    {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(ptr);
+        if (p < _storage[0] || p >= _storage[0] + sizeof(_storage)) return false;
+        return (p - _storage[0]) % sizeof(T) == 0;
+    }
+
+    inline size_t buffer_size() const { return N; }
+    inline size_t in_use() const { return N - _n_free; }
+    inline size_t available() const { return _n_free; }
+    inline bool full() const { return _n_free == 0; }
+    // most blocks that were ever in use at the same time, to size N from a long run
+    inline size_t high_water() const { return _high_water; }
+};
+
+#endif /* _POOL_H_ */
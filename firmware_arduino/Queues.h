@@ -2,6 +2,17 @@
 #define _QUEUES_H_
 
 #include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+
+// contiguous run of entries inside a ring. a ring hands out at most two of them, the second one starts at the
+// beginning of the buffer after the first one reached its end
+template <typename T>
+struct QueueSpan
+{
+    T *data;
+    size_t n;
+};
 
 template <typename T, size_t N>
 class DequeBase
@@ -14,6 +25,31 @@ private:
 
     const bool _overwrite;
 
+    // index arithmetic. a power of two length wraps with a mask instead of a compare and branch
+    static constexpr bool _pow2 = (N & (N - 1)) == 0;
+    static inline size_t _next(size_t i)
+    {
+        if constexpr (_pow2) return (i + 1) & (N - 1);
+        else return i < N - 1 ? i + 1 : 0;
+    }
+    static inline size_t _prev(size_t i)
+    {
+        if constexpr (_pow2) return (i - 1) & (N - 1);
+        else return i > 0 ? i - 1 : N - 1;
+    }
+    static inline size_t _wrap(size_t i)
+    {
+        if constexpr (_pow2) return i & (N - 1);
+        else return i >= N ? i - N : i;
+    }
+
+    // trivially copyable entries are assigned, which lets the compiler copy whole words inline
+    static inline void _copy(T *dst, const T *src)
+    {
+        if constexpr (std::is_trivially_copyable<T>::value) *dst = *src;
+        else memcpy(dst, src, sizeof(T));
+    }
+
 protected:
     DequeBase(bool overwrite)
     : _overwrite(overwrite)
@@ -25,19 +61,21 @@ protected:
     {
         if (empty())
         {
-            // because N > 0
-            memcpy(_data + _front, entry, sizeof(T));
+            // because N > 0. pops can leave _front and _back apart, the only entry is both
+            _back = _front;
+            _copy(_data + _front, entry);
             ++_size;
             return true;
         }
 
-        size_t temp = _back < N - 1 ? _back + 1 : 0;
+        size_t temp = _next(_back);
 
         if (full())
         {
             if (_overwrite)
             {
-                _front = temp;
+                // when full temp is _front, drop the oldest entry by moving _front past it
+                _front = _next(_front);
             }
             else
                 return false;
@@ -45,7 +83,7 @@ protected:
 
         // populate
         _back = temp;
-        memcpy(_data + _back, entry, sizeof(T));
+        _copy(_data + _back, entry);
         if (_size < N) ++_size;
         return true;
     }
@@ -54,19 +92,20 @@ protected:
     {
         if (empty())
         {
-            // because N > 0
-            memcpy(_data + _front, entry, sizeof(T));
+            // because N > 0. pops can leave _front and _back apart, the only entry is both
+            _back = _front;
+            _copy(_data + _front, entry);
             ++_size;
             return true;
         }
 
-        size_t temp = _front > 0 ? _front-1 : N-1;
+        size_t temp = _prev(_front);
 
         if (full())
         {
             if (_overwrite)
             {
-                _back = temp;
+                _back = _prev(_back);
             }
             else
                 return false;
@@ -74,7 +113,7 @@ protected:
 
         // populate
         _front = temp;
-        memcpy(_data + _front, entry, sizeof(T));
+        _copy(_data + _front, entry);
         if (_size < N) ++_size;
         return true;
     }
@@ -83,8 +122,8 @@ protected:
     {
         if (empty()) return false;
 
-        memcpy(entry, _data + _back, sizeof(T));
-        _back = _back > 0 ? _back - 1 : N-1;
+        _copy(entry, _data + _back);
+        _back = _prev(_back);
         --_size;
         return true;
     }
@@ -93,8 +132,8 @@ protected:
     {
         if (empty()) return false;
 
-        memcpy(entry, _data + _front, sizeof(T));
-        _front = _front < N - 1 ? _front + 1 : 0;
+        _copy(entry, _data + _front);
+        _front = _next(_front);
         --_size;
         return true;
     }
@@ -112,12 +151,72 @@ protected:
     const T *peek(size_t i) const
     {
         if (i >= size()) return NULL;
-        size_t temp = _front + i;
-        if (temp >= N)
-        {
-            temp -= N;
-        }
-        return _data + temp;
+        return _data + _wrap(_front + i);
+    }
+
+    // zero copy access. push_back_n hands out up to n free slots after _back, which are only added to the deque by
+    // commit_back. pop_front_n hands out up to n entries from _front, which are only removed by release_front. both
+    // return the number of entries in the spans. entries stay where they are until the matching commit or release
+    size_t push_back_n(size_t n, QueueSpan<T> spans[2])
+    {
+        const size_t free = N - _size;
+        if (n > free) n = free;
+        const size_t start = _wrap(_front + _size);
+        const size_t n_first = n < N - start ? n : N - start;
+        spans[0] = {.data = _data + start, .n = n_first};
+        spans[1] = {.data = _data, .n = n - n_first};
+        return n;
+    }
+
+    T *reserve_back()
+    {
+        if (full()) return NULL;
+        return _data + _wrap(_front + _size);
+    }
+
+    void commit_back(size_t n)
+    {
+        if (n > N - _size) n = N - _size;
+        if (n == 0) return;
+        _size += n;
+        _back = _wrap(_front + _size - 1);
+    }
+
+    size_t pop_front_n(size_t n, QueueSpan<const T> spans[2]) const
+    {
+        if (n > _size) n = _size;
+        const size_t n_first = n < N - _front ? n : N - _front;
+        spans[0] = {.data = _data + _front, .n = n_first};
+        spans[1] = {.data = _data, .n = n - n_first};
+        return n;
+    }
+
+    void release_front(size_t n)
+    {
+        if (n > _size) n = _size;
+        _front = _wrap(_front + n);
+        _size -= n;
+    }
+
+    // copying versions, at most two copies per call
+    size_t push_back_n(const T *entries, size_t n)
+    {
+        QueueSpan<T> spans[2];
+        n = push_back_n(n, spans);
+        memcpy(spans[0].data, entries, spans[0].n * sizeof(T));
+        memcpy(spans[1].data, entries + spans[0].n, spans[1].n * sizeof(T));
+        commit_back(n);
+        return n;
+    }
+
+    size_t pop_front_n(T *entries, size_t n)
+    {
+        QueueSpan<const T> spans[2];
+        n = pop_front_n(n, spans);
+        memcpy(entries, spans[0].data, spans[0].n * sizeof(T));
+        memcpy(entries + spans[0].n, spans[1].data, spans[1].n * sizeof(T));
+        release_front(n);
+        return n;
     }
 
 public:
@@ -126,7 +225,7 @@ public:
     inline bool empty() const { return size() == 0; }
     inline bool available() const { return size() > 0; }
     inline bool full() const { return size() == N; }
-    inline void clean() { _back = _front; }
+    inline void clean() { _front = 0; _back = 0; _size = 0; }
 };
 
 template <typename T, size_t N>
@@ -144,6 +243,14 @@ public:
     inline const T *peek_back() const { return DequeBase<T, N>::peek_back(); }
     inline const T *peek_front() const { return DequeBase<T, N>::peek_front(); }
     inline const T *peek(size_t i) const { return DequeBase<T, N>::peek(i); }
+
+    inline size_t push_back_n(size_t n, QueueSpan<T> spans[2]) { return DequeBase<T, N>::push_back_n(n, spans); }
+    inline size_t push_back_n(const T *entries, size_t n) { return DequeBase<T, N>::push_back_n(entries, n); }
+    inline T *reserve_back() { return DequeBase<T, N>::reserve_back(); }
+    inline void commit_back(size_t n=1) { DequeBase<T, N>::commit_back(n); }
+    inline size_t pop_front_n(size_t n, QueueSpan<const T> spans[2]) const { return DequeBase<T, N>::pop_front_n(n, spans); }
+    inline size_t pop_front_n(T *entries, size_t n) { return DequeBase<T, N>::pop_front_n(entries, n); }
+    inline void release_front(size_t n) { DequeBase<T, N>::release_front(n); }
 };
 
 template <typename T, size_t N>
@@ -152,9 +259,20 @@ class QueueFIFO : public DequeBase<T, N>
 public:
     QueueFIFO(bool overwrite): DequeBase<T, N>(overwrite) {}
 
-    inline bool push(const T *const entry) { return DequeBase<T, N>::push_front(entry); }
-    inline bool pop(T *entry) { return DequeBase<T, N>::pop_back(entry); }
-    inline const T *peek() const { return DequeBase<T, N>::peek_back(); }
+    // entries go in at the back and come out at the front, so they lie in the buffer oldest first
+    inline bool push(const T *const entry) { return DequeBase<T, N>::push_back(entry); }
+    inline bool pop(T *entry) { return DequeBase<T, N>::pop_front(entry); }
+    inline const T *peek() const { return DequeBase<T, N>::peek_front(); }
+
+    // push_n hands out free slots to be filled in place and published with commit (reserve/commit for one entry).
+    // pop_n hands out the oldest entries, oldest first, to be read in place and dropped with release
+    inline size_t push_n(size_t n, QueueSpan<T> spans[2]) { return DequeBase<T, N>::push_back_n(n, spans); }
+    inline size_t push_n(const T *entries, size_t n) { return DequeBase<T, N>::push_back_n(entries, n); }
+    inline T *reserve() { return DequeBase<T, N>::reserve_back(); }
+    inline void commit(size_t n=1) { DequeBase<T, N>::commit_back(n); }
+    inline size_t pop_n(size_t n, QueueSpan<const T> spans[2]) const { return DequeBase<T, N>::pop_front_n(n, spans); }
+    inline size_t pop_n(T *entries, size_t n) { return DequeBase<T, N>::pop_front_n(entries, n); }
+    inline void release(size_t n) { DequeBase<T, N>::release_front(n); }
 };
 
 template <typename T, size_t N>
@@ -171,16 +289,68 @@ public:
 template <typename T, size_t N>
 class DequeBaseThreadSafe : protected DequeBase<T, N>
 {
+private:
+    // retries op under the mutex until it succeeds, sleeping in between. timeout_us = 0 waits forever
+    template <typename F>
+    bool _wait_for(F op, bool for_space, uint32_t timeout_us)
+    {
+        const uint32_t start = micros();
+        for (;;)
+        {
+            get_mutex_blocking();
+            bool res = op();
+            release_mutex();
+            if (res)
+            {
+                notify();
+                return true;
+            }
+            const uint32_t elapsed = micros() - start;
+            if (timeout_us > 0 && elapsed >= timeout_us) return false;
+            const uint32_t left = timeout_us > 0 ? timeout_us - elapsed : 0;
+            if (for_space) wait_space(left);
+            else wait_data(left);
+        }
+    }
+
 protected:
+    DequeBaseThreadSafe(bool overwrite) : DequeBase<T, N>(overwrite)
+    {}
+
     virtual inline void get_mutex_blocking() = 0;
     virtual inline void release_mutex() = 0;
     virtual inline bool get_mutex_timeout(uint32_t timeout_us) = 0;
+    // wake up anyone in wait_data() or wait_space(). called after every change to the queue
+    virtual inline void notify() = 0;
+    // sleep until notify() is called (from any core or an ISR) or timeout_us passes. may return early, 0 is no timeout.
+    // consumers and producers wait apart, so a wake up meant for one side can't be taken by the other
+    virtual inline void wait_data(uint32_t timeout_us) = 0;
+    virtual inline void wait_space(uint32_t timeout_us) = 0;
+
+    // wait until there's data or space instead of failing right away. false only if timeout_us passed
+    bool push_back_wait(const T *const entry, uint32_t timeout_us)
+    {
+        return _wait_for([&]() { return DequeBase<T, N>::push_back(entry); }, true, timeout_us);
+    }
+    bool push_front_wait(const T *const entry, uint32_t timeout_us)
+    {
+        return _wait_for([&]() { return DequeBase<T, N>::push_front(entry); }, true, timeout_us);
+    }
+    bool pop_back_wait(T *entry, uint32_t timeout_us)
+    {
+        return _wait_for([&]() { return DequeBase<T, N>::pop_back(entry); }, false, timeout_us);
+    }
+    bool pop_front_wait(T *entry, uint32_t timeout_us)
+    {
+        return _wait_for([&]() { return DequeBase<T, N>::pop_front(entry); }, false, timeout_us);
+    }
 
     bool push_back_blocking(const T *const entry)
     {
         get_mutex_blocking();
         bool res = DequeBase<T, N>::push_back(entry);
         release_mutex();
+        if (res) notify();
         return res;
     }
     bool push_back_timeout(const T *const entry, uint32_t timeout_us)
@@ -188,6 +358,7 @@ protected:
         if (!get_mutex_timeout(timeout_us)) return false;
         bool res = DequeBase<T, N>::push_back(entry);
         release_mutex();
+        if (res) notify();
         return res;
     }
     bool push_front_blocking(const T *const entry)
@@ -195,6 +366,7 @@ protected:
         get_mutex_blocking();
         bool res = DequeBase<T, N>::push_front(entry);
         release_mutex();
+        if (res) notify();
         return res;
     }
     bool push_front_timeout(const T *const entry, uint32_t timeout_us)
@@ -202,6 +374,7 @@ protected:
         if (!get_mutex_timeout(timeout_us)) return false;
         bool res = DequeBase<T, N>::push_front(entry);
         release_mutex();
+        if (res) notify();
         return res;
     }
 
@@ -210,6 +383,7 @@ protected:
         get_mutex_blocking();
         bool res = DequeBase<T, N>::pop_back(entry);
         release_mutex();
+        if (res) notify();
         return res;
     }
     bool pop_back_timeout(T *entry, uint32_t timeout_us)
@@ -217,6 +391,7 @@ protected:
         if (!get_mutex_timeout(timeout_us)) return false;
         bool res = DequeBase<T, N>::pop_back(entry);
         release_mutex();
+        if (res) notify();
         return res;
     }
     bool pop_front_blocking(T *entry)
@@ -224,6 +399,7 @@ protected:
         get_mutex_blocking();
         bool res = DequeBase<T, N>::pop_front(entry);
         release_mutex();
+        if (res) notify();
         return res;
     }
     bool pop_front_timeout(T *entry, uint32_t timeout_us)
@@ -231,8 +407,42 @@ protected:
         if (!get_mutex_timeout(timeout_us)) return false;
         bool res = DequeBase<T, N>::pop_front(entry);
         release_mutex();
+        if (res) notify();
+        return res;
+    }
+
+    size_t push_back_n_blocking(const T *entries, size_t n)
+    {
+        get_mutex_blocking();
+        size_t res = DequeBase<T, N>::push_back_n(entries, n);
+        release_mutex();
+        if (res) notify();
+        return res;
+    }
+    bool push_back_n_timeout(const T *entries, size_t n, size_t *pushed, uint32_t timeout_us)
+    {
+        if (!get_mutex_timeout(timeout_us)) return false;
+        *pushed = DequeBase<T, N>::push_back_n(entries, n);
+        release_mutex();
+        if (*pushed) notify();
+        return true;
+    }
+    size_t pop_front_n_blocking(T *entries, size_t n)
+    {
+        get_mutex_blocking();
+        size_t res = DequeBase<T, N>::pop_front_n(entries, n);
+        release_mutex();
+        if (res) notify();
         return res;
     }
+    bool pop_front_n_timeout(T *entries, size_t n, size_t *popped, uint32_t timeout_us)
+    {
+        if (!get_mutex_timeout(timeout_us)) return false;
+        *popped = DequeBase<T, N>::pop_front_n(entries, n);
+        release_mutex();
+        if (*popped) notify();
+        return true;
+    }
 
     const T *peek_back_blocking()
     {
@@ -341,6 +551,10 @@ public:
     bool peek_back_timeout(const T *entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::peek_back_timeout(entry, timeout_us); }
     const T *peek_front_blocking() { return DequeBaseThreadSafe<T, N>::peek_front_blocking(); }
     bool peek_front_timeout(const T *entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::peek_front_timeout(entry, timeout_us); }
+    bool push_back_wait(const T *const entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::push_back_wait(entry, timeout_us); }
+    bool push_front_wait(const T *const entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::push_front_wait(entry, timeout_us); }
+    bool pop_back_wait(T *entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::pop_back_wait(entry, timeout_us); }
+    bool pop_front_wait(T *entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::pop_front_wait(entry, timeout_us); }
 };
 
 template <typename T, size_t N>
@@ -350,12 +564,22 @@ public:
     QueueFIFOThreadSafe(bool overwrite) : DequeBaseThreadSafe<T, N>(overwrite)
     {}
 
-    bool push_blocking(const T *const entry) { return DequeBaseThreadSafe<T, N>::push_front_blocking(entry); }
-    bool push_timeout(const T *const entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::push_front_timeout(entry, timeout_us); }
-    bool pop_blocking(T *entry) { return DequeBaseThreadSafe<T, N>::pop_back_blocking(entry); }
-    bool pop_timeout(T *entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::pop_back_timeout(entry, timeout_us); }
-    const T *peek_blocking() { return DequeBaseThreadSafe<T, N>::peek_back_blocking(); }
-    bool peek_timeout(const T *entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::peek_back_timeout(entry, timeout_us); }
+    bool push_blocking(const T *const entry) { return DequeBaseThreadSafe<T, N>::push_back_blocking(entry); }
+    bool push_timeout(const T *const entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::push_back_timeout(entry, timeout_us); }
+    bool pop_blocking(T *entry) { return DequeBaseThreadSafe<T, N>::pop_front_blocking(entry); }
+    bool pop_timeout(T *entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::pop_front_timeout(entry, timeout_us); }
+    const T *peek_blocking() { return DequeBaseThreadSafe<T, N>::peek_front_blocking(); }
+    bool peek_timeout(const T *entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::peek_front_timeout(entry, timeout_us); }
+
+    // a whole batch under a single lock
+    size_t push_n_blocking(const T *entries, size_t n) { return DequeBaseThreadSafe<T, N>::push_back_n_blocking(entries, n); }
+    bool push_n_timeout(const T *entries, size_t n, size_t *pushed, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::push_back_n_timeout(entries, n, pushed, timeout_us); }
+    size_t pop_n_blocking(T *entries, size_t n) { return DequeBaseThreadSafe<T, N>::pop_front_n_blocking(entries, n); }
+    bool pop_n_timeout(T *entries, size_t n, size_t *popped, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::pop_front_n_timeout(entries, n, popped, timeout_us); }
+
+    // sleep until there's space (push) or data (pop). timeout_us = 0 waits forever
+    bool push_wait(const T *const entry, uint32_t timeout_us=0) { return DequeBaseThreadSafe<T, N>::push_back_wait(entry, timeout_us); }
+    bool pop_wait(T *entry, uint32_t timeout_us=0) { return DequeBaseThreadSafe<T, N>::pop_front_wait(entry, timeout_us); }
 };
 
 template <typename T, size_t N>
@@ -371,6 +595,64 @@ public:
     bool pop_timeout(T *entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::pop_back_timeout(entry, timeout_us); }
     const T *peek_blocking() { return DequeBaseThreadSafe<T, N>::peek_back_blocking(); }
     bool peek_timeout(const T *entry, uint32_t timeout_us) { return DequeBaseThreadSafe<T, N>::peek_back_timeout(entry, timeout_us); }
+    bool push_wait(const T *const entry, uint32_t timeout_us=0) { return DequeBaseThreadSafe<T, N>::push_front_wait(entry, timeout_us); }
+    bool pop_wait(T *entry, uint32_t timeout_us=0) { return DequeBaseThreadSafe<T, N>::pop_back_wait(entry, timeout_us); }
+};
+
+// Lock free single producer single consumer ring. Only the producer writes _head and only the consumer writes _tail, so
+// plain atomic loads and stores are enough (no read-modify-write, which the cortex-m0+ doesn't have). The release store
+// of an index publishes the slot it covers, the acquire load on the other side makes it visible.
+// Works between the two cores and between an ISR and thread context. push must always be called from the same side,
+// and pop/peek from the other one.
+template <typename T, size_t N>
+class QueueSPSC
+{
+private:
+    T _data[N];
+    // free running counters, the index into _data is counter % N. size is head - tail, even across the wrap
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+
+public:
+    QueueSPSC()
+    {
+        static_assert(N > 0, "Can't have an empty buffer");
+        static_assert((N & (N - 1)) == 0, "QueueSPSC length should be a power of two so the counters wrap cleanly");
+    }
+
+    // producer side
+    bool push(const T *const entry)
+    {
+        const uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= N) return false;
+        memcpy(_data + (head % N), entry, sizeof(T));
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    bool pop(T *entry)
+    {
+        const uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail) return false;
+        memcpy(entry, _data + (tail % N), sizeof(T));
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    const T *peek() const
+    {
+        const uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail) return NULL;
+        return _data + (tail % N);
+    }
+
+    // either side. the value may be stale by the time it's used, but only in the safe direction for the caller's side
+    inline size_t buffer_size() const { return N; }
+    inline size_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+    inline bool empty() const { return size() == 0; }
+    inline bool available() const { return size() > 0; }
+    inline bool full() const { return size() >= N; }
 };
 
 // RP2040 mutexes
@@ -380,21 +662,39 @@ public:
 #include <pico/sync.h>
 #include "pico/mutex.h"
 
+// the waiters sleep on a semaphore and not in __wfe: mutex_exit does a __sev itself, which sets the event flag of the
+// waiting core too, so its next __wfe would return right away and every wait would spin
+static inline void _queue_sem_wait(semaphore_t *sem, uint32_t timeout_us)
+{
+    if (timeout_us == 0) sem_acquire_blocking(sem);
+    else sem_acquire_timeout_us(sem, timeout_us);
+}
+
 template <typename T, size_t N>
 class DequeThreadSafe_RP2040 : public DequeThreadSafe<T, N>
 {
 private:
     mutex_t _mutex;
+    semaphore_t _data_changed, _space_changed; // a permit each on every change
 
 protected:
     inline void get_mutex_blocking() { mutex_enter_blocking(&_mutex); }
     inline void release_mutex() { mutex_exit(&_mutex); }
     inline bool get_mutex_timeout(uint32_t timeout_us) { return mutex_enter_timeout_us(&_mutex, timeout_us); }
+    inline void notify()
+    {
+        sem_release(&_data_changed);
+        sem_release(&_space_changed);
+    }
+    inline void wait_data(uint32_t timeout_us) { _queue_sem_wait(&_data_changed, timeout_us); }
+    inline void wait_space(uint32_t timeout_us) { _queue_sem_wait(&_space_changed, timeout_us); }
 
 public:
     DequeThreadSafe_RP2040(bool overwrite) : DequeThreadSafe<T, N>(overwrite)
     {
         mutex_init(&_mutex);
+        sem_init(&_data_changed, 0, 1);
+        sem_init(&_space_changed, 0, 1);
     }
 };
 
@@ -403,16 +703,26 @@ class QueueFIFOThreadSafe_RP2040 : public QueueFIFOThreadSafe<T, N>
 {
 private:
     mutex_t _mutex;
+    semaphore_t _data_changed, _space_changed; // a permit each on every change
 
 protected:
     inline void get_mutex_blocking() { mutex_enter_blocking(&_mutex); }
     inline void release_mutex() { mutex_exit(&_mutex); }
     inline bool get_mutex_timeout(uint32_t timeout_us) { return mutex_enter_timeout_us(&_mutex, timeout_us); }
+    inline void notify()
+    {
+        sem_release(&_data_changed);
+        sem_release(&_space_changed);
+    }
+    inline void wait_data(uint32_t timeout_us) { _queue_sem_wait(&_data_changed, timeout_us); }
+    inline void wait_space(uint32_t timeout_us) { _queue_sem_wait(&_space_changed, timeout_us); }
 
 public:
     QueueFIFOThreadSafe_RP2040(bool overwrite) : QueueFIFOThreadSafe<T, N>(overwrite)
     {
         mutex_init(&_mutex);
+        sem_init(&_data_changed, 0, 1);
+        sem_init(&_space_changed, 0, 1);
     }
 };
 
@@ -421,16 +731,26 @@ class StackLIFOThreadSafe_RP2040 : public StackLIFOThreadSafe<T, N>
 {
 private:
     mutex_t _mutex;
+    semaphore_t _data_changed, _space_changed; // a permit each on every change
 
 protected:
     inline void get_mutex_blocking() { mutex_enter_blocking(&_mutex); }
     inline void release_mutex() { mutex_exit(&_mutex); }
     inline bool get_mutex_timeout(uint32_t timeout_us) { return mutex_enter_timeout_us(&_mutex, timeout_us); }
+    inline void notify()
+    {
+        sem_release(&_data_changed);
+        sem_release(&_space_changed);
+    }
+    inline void wait_data(uint32_t timeout_us) { _queue_sem_wait(&_data_changed, timeout_us); }
+    inline void wait_space(uint32_t timeout_us) { _queue_sem_wait(&_space_changed, timeout_us); }
 
 public:
     StackLIFOThreadSafe_RP2040(bool overwrite) : StackLIFOThreadSafe<T, N>(overwrite)
     {
         mutex_init(&_mutex);
+        sem_init(&_data_changed, 0, 1);
+        sem_init(&_space_changed, 0, 1);
     }
 };
 
@@ -449,6 +769,9 @@ protected:
     inline void get_mutex_blocking() { noInterrupts(); }
     inline void release_mutex() { interrupts(); }
     inline bool get_mutex_timeout(uint32_t timeout_us) { noInterrupts(); return true; }
+    inline void notify() {}
+    inline void wait_data(uint32_t timeout_us) { delayMicroseconds(timeout_us > 0 && timeout_us < 1000 ? timeout_us : 1000); }
+    inline void wait_space(uint32_t timeout_us) { wait_data(timeout_us); }
 
 public:
     DequeThreadSafe_RP2040(bool overwrite) : DequeThreadSafe<T, N>(overwrite)
@@ -467,6 +790,9 @@ protected:
     inline void get_mutex_blocking() { noInterrupts(); }
     inline void release_mutex() { interrupts(); }
     inline bool get_mutex_timeout(uint32_t timeout_us) { noInterrupts(); return true; }
+    inline void notify() {}
+    inline void wait_data(uint32_t timeout_us) { delayMicroseconds(timeout_us > 0 && timeout_us < 1000 ? timeout_us : 1000); }
+    inline void wait_space(uint32_t timeout_us) { wait_data(timeout_us); }
 
 public:
     QueueFIFOThreadSafe_RP2040(bool overwrite) : QueueFIFOThreadSafe<T, N>(overwrite)
@@ -485,6 +811,9 @@ protected:
     inline void get_mutex_blocking() { noInterrupts(); }
     inline void release_mutex() { interrupts(); }
     inline bool get_mutex_timeout(uint32_t timeout_us) { noInterrupts(); return true; }
+    inline void notify() {}
+    inline void wait_data(uint32_t timeout_us) { delayMicroseconds(timeout_us > 0 && timeout_us < 1000 ? timeout_us : 1000); }
+    inline void wait_space(uint32_t timeout_us) { wait_data(timeout_us); }
 
 public:
     StackLIFOThreadSafe_RP2040(bool overwrite) : StackLIFOThreadSafe<T, N>(overwrite)
@@ -11,11 +11,11 @@ const char *SmartCmdArguments::arg(_smart_comm_size_t n) const
     return _args[n];
 }
 template <>
-bool SmartCmdArguments::to<const char>(_smart_comm_size_t n, const char *str) const
+bool SmartCmdArguments::to<const char *>(_smart_comm_size_t n, const char **str) const
 {
     const char *temp = arg(n);
     if (temp == NULL) return false;
-    str = temp;
+    *str = temp;
     return true;
 }
 template <>
@@ -182,22 +182,28 @@ bool SmartCmdArguments::to<bool>(_smart_comm_size_t n, bool *t) const
 
 /// SmartCmds /////////////////////////////////////////////////////////////////////////////////
 
-SmartCmdBase::SmartCmdBase(const char *command, smartCmdCB_t callback): _cmd(command), _cb(callback) {}
-
-SmartCmd::SmartCmd(const char *command, smartCmdCB_t callback): SmartCmdBase(command, callback) {}
 bool SmartCmd::is_command(const char *str) const { return strcmp(str, _cmd) == 0; }
 void SmartCmd::callback(Stream *stream, const SmartCmdArguments *args) const { _cb(stream, args, _cmd); }
 
 #ifdef PROGMEM
-SmartCmdF::SmartCmdF(const PROGMEM char *command, smartCmdCB_t callback): SmartCmdBase(reinterpret_cast<PGM_P>(command), callback) {}
+static uint32_t __smartCmdHash_P(PGM_P str)
+{
+    uint32_t hash = __smartCmdHash("");
+    for (char c = pgm_read_byte(str); c; c = pgm_read_byte(++str))
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619UL;
+    return hash;
+}
+
+SmartCmdF::SmartCmdF(const PROGMEM char *command, smartCmdCB_t callback)
+: SmartCmdBase(reinterpret_cast<PGM_P>(command), callback, __smartCmdHash_P(reinterpret_cast<PGM_P>(command))) {}
 bool SmartCmdF::is_command(const char *str) const { return strcmp_P(str, _cmd) == 0; }
 void SmartCmdF::callback(Stream *stream, const SmartCmdArguments *args) const
 {
-    _smart_comm_size_t len = strlen_P((const char *)_cmd);
-    char *cmd = (char *)malloc(len);
-    strncpy_P(cmd, (const char *)_cmd, len);
+    // copied to the stack instead of the heap. a longer name gets truncated, it's only passed along for the replies
+    char cmd[SMART_CMD_MAX_LEN+1];
+    strncpy_P(cmd, (const char *)_cmd, SMART_CMD_MAX_LEN);
+    cmd[SMART_CMD_MAX_LEN] = '\0';
     _cb(stream, args, cmd);
-    free(cmd);
 }
 #endif
 
@@ -214,201 +220,372 @@ void __defaultCommandNotRecognizedCB(Stream *stream, const char *cmd)
     #endif
 }
 
+/// SmartPayloadStream ////////////////////////////////////////////////////////////////////////
 
+SmartPayloadStream::SmartPayloadStream(Stream *stream, size_t len, unsigned long timeout_ms)
+: _stream(stream), _remaining(len)
+{
+    setTimeout(timeout_ms);
+}
 
-/// SmartComm /////////////////////////////////////////////////////////////////////////////////////
+int SmartPayloadStream::available()
+{
+    if (_remaining == 0) return 0;
+    const int n = _stream->available();
+    return static_cast<size_t>(n) < _remaining ? n : _remaining;
+}
 
-static void __trimChar(char *&str, char c)
+int SmartPayloadStream::read()
 {
-    // it modifies str so that all chatacters c at the start and end of str are removed. if c is space
-    // and str is "     hello there  ", after the function, str will be "hello there"
-    // this modifies the original str. it returns a new pointer (inside the original str)
-    // the str argument should be passed as *&a if a is a (char *)
-    // https://stackoverflow.com/questions/122616/how-do-i-trim-leading-trailing-whitespace-in-a-standard-way
-    if (c == '\0' || str == NULL || *str == '\0') {
-        return; // Nothing to trim
-    }
+    if (_remaining == 0) return -1;
+    const int c = _stream->read();
+    if (c >= 0) --_remaining;
+    return c;
+}
+
+int SmartPayloadStream::peek()
+{
+    if (_remaining == 0) return -1;
+    return _stream->peek();
+}
 
-    // remove from front
-    while (*str == c)
-        ++str;
+bool SmartPayloadStream::skip()
+{
+    while (_remaining)
+        if (timedRead() < 0) return false;
+    return true;
+}
 
-    char *endp = str + strlen(str) - 1;
-    // if(endp <= str) return;
+/// Binary frames /////////////////////////////////////////////////////////////////////////////
 
-    // remove from back
-    // if (endp - str < 2) return;
-    while (*endp == c && endp > str)
-        --endp;
-    *(endp+1) = '\0';
+uint16_t __smartCrc16(const uint8_t *data, size_t len)
+{
+    // CRC-16/CCITT-FALSE, bitwise. frames are short, a table would cost 512 bytes
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= static_cast<uint16_t>(data[i]) << 8;
+        for (uint8_t b = 0; b < 8; b++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
 }
 
-static void __removeConsecutiveDuplicates(char *&str, char c)
+size_t __cobsDecode(uint8_t *buf, size_t len)
 {
-    // modifies str such that there are no multiple consecutive characters c. That means that if c
-    // is a space, and str is "  hi how     are  you  ", after running this function, str will be
-    // " hi how are you "
-    //
-    // the idea of the implementation is the following:
-    // we traverse the string. if we find c in position i, we start counting how many contiguous
-    // characters c are after index i. if its one, we continue incrementing i. if there are more,
-    // we count how many there are before the caracter is no longer c. then we move the whole str
-    // that's on the right side of i to overwrite the excess of c characters
-    if (c == '\0' || str == NULL || *str == '\0') {
-        return; // Nothing to remove
+    // every code byte is replaced by the zero it stands for, so the write position stays behind the read position
+    size_t r = 0, w = 0;
+    while (r < len)
+    {
+        const uint8_t code = buf[r++];
+        if (code == 0) return 0;
+        for (uint8_t k = 1; k < code; k++)
+        {
+            if (r >= len) return 0;
+            buf[w++] = buf[r++];
+        }
+        // a full block (0xFF) and the last block have no zero after them
+        if (code != 0xFF && r < len)
+            buf[w++] = 0;
     }
-    _smart_comm_size_t len = strlen(str);
-    if (len == 1) return;
-    else if (len == 2)
+    return w;
+}
+
+void __cobsWrite(Print *out, const uint8_t *buf, size_t len)
+{
+    size_t i = 0;
+    for (;;)
     {
-        if (*str == c && *(str+1) == c)
-            *(str+1) = '\0';
-        return;
+        size_t run = 0;
+        while (i + run < len && buf[i + run] != 0 && run < 254)
+            ++run;
+        out->write(static_cast<uint8_t>(run + 1));
+        out->write(buf + i, run);
+        i += run;
+        if (i >= len) break;
+        // a block ended by a zero skips it, a full block doesn't have one
+        if (run < 254) ++i;
     }
+    out->write(static_cast<uint8_t>(0));
+}
 
-    char *endp = str + len - 1;
+static uint64_t __msgpackBE(const uint8_t *p, uint8_t n)
+{
+    uint64_t v = 0;
+    for (uint8_t i = 0; i < n; i++)
+        v = (v << 8) | p[i];
+    return v;
+}
 
-    // remove front
-    while (*str == c && *(str+1) == c)
-        ++str;
-    // if (str >= endp-1) return;
+static bool __u64ToText(uint64_t v, bool negative, char *out, size_t out_len, size_t *written)
+{
+    // printf can't do 64 bit integers on every board
+    char digits[21];
+    uint8_t n = 0;
+    do
+    {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    if (n + negative + 1 > out_len) return false;
+    size_t w = 0;
+    if (negative) out[w++] = '-';
+    while (n) out[w++] = digits[--n];
+    out[w++] = '\0';
+    *written = w;
+    return true;
+}
+
+bool __msgpackToArguments(const uint8_t *data, size_t len, char *out, size_t out_len, char *args[MAX_ARGUMENTS], _smart_comm_size_t &nArgs)
+{
+    nArgs = 0;
+    // no body is no arguments
+    if (len == 0) return true;
 
-    // remove back
-    while (*endp == c && *(endp-1) == c && endp > str+1)
-        --endp;
-    if (endp <= str+1)
+    size_t r = 0, w = 0;
+    size_t count;
+    if ((data[0] & 0xF0) == 0x90)
     {
-        *(endp+1) = '\0';
-        return;
+        count = data[0] & 0x0F;
+        r = 1;
     }
+    else if (data[0] == 0xDC && len >= 3)
+    {
+        count = __msgpackBE(data + 1, 2);
+        r = 3;
+    }
+    else return false;
+    if (count > MAX_ARGUMENTS) return false;
 
-    // remove center
-    _smart_comm_size_t nConsec = 0;
-    for (char *p = str+1; p < endp; ++p)
+    for (size_t i = 0; i < count; i++)
     {
-        // count how many consecutives
-        if (*p == c)
+        if (r >= len) return false;
+        const uint8_t t = data[r++];
+        char *arg = out + w;
+        size_t written = 0;
+        // bytes that follow the type
+        uint8_t n = 0;
+        if (t <= 0x7F)
         {
-            while (*(p + nConsec + 1) == c)
-                ++nConsec;
+            if (!__u64ToText(t, false, arg, out_len - w, &written)) return false;
         }
-
-        // shift all chars to the left nConsec places
-        if (nConsec)
+        else if (t >= 0xE0)
+        {
+            if (!__u64ToText(0x100 - t, true, arg, out_len - w, &written)) return false;
+        }
+        else if (t == 0xC0 || t == 0xC2 || t == 0xC3)
+        {
+            const char *lit = t == 0xC0 ? "null" : (t == 0xC3 ? "true" : "false");
+            written = strlen(lit) + 1;
+            if (written > out_len - w) return false;
+            memcpy(arg, lit, written);
+        }
+        else if (t >= 0xCC && t <= 0xCF)
+        {
+            n = 1 << (t - 0xCC);
+            if (r + n > len) return false;
+            if (!__u64ToText(__msgpackBE(data + r, n), false, arg, out_len - w, &written)) return false;
+        }
+        else if (t >= 0xD0 && t <= 0xD3)
         {
-            memmove(p + 1, p + nConsec + 1, endp-p);
-            // memmove(str+i+1, str+i+1+nConsec, len-nConsec);
-            // update strlen(p) == len accordingly
-            endp -= nConsec;
-            nConsec = 0;
+            n = 1 << (t - 0xD0);
+            if (r + n > len) return false;
+            // sign extend from n bytes
+            const uint64_t raw = __msgpackBE(data + r, n);
+            const uint8_t shift = 64 - 8 * n;
+            const int64_t v = static_cast<int64_t>(raw << shift) >> shift;
+            const uint64_t mag = v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+            if (!__u64ToText(mag, v < 0, arg, out_len - w, &written)) return false;
         }
+        else if (t == 0xCA || t == 0xCB)
+        {
+            n = t == 0xCA ? 4 : 8;
+            if (r + n > len) return false;
+            const uint64_t raw = __msgpackBE(data + r, n);
+            double d;
+            if (n == 4)
+            {
+                const uint32_t raw32 = raw;
+                float f;
+                memcpy(&f, &raw32, sizeof(f));
+                d = f;
+            }
+            else
+                memcpy(&d, &raw, sizeof(d));
+            // the longest a double gets with dtostrf or %.9g, and its '\0'
+            if (out_len - w < 32) return false;
+            #if defined(ARDUINO_ARCH_AVR)
+            dtostrf(d, 1, 7, arg);
+            #else
+            snprintf(arg, 32, "%.9g", d);
+            #endif
+            written = strlen(arg) + 1;
+        }
+        else if ((t & 0xE0) == 0xA0 || t == 0xD9 || t == 0xDA)
+        {
+            size_t str_len;
+            if ((t & 0xE0) == 0xA0)
+                str_len = t & 0x1F;
+            else
+            {
+                const uint8_t l = t == 0xD9 ? 1 : 2;
+                if (r + l > len) return false;
+                str_len = __msgpackBE(data + r, l);
+                r += l;
+            }
+            n = 0;
+            if (r + str_len > len || str_len + 1 > out_len - w) return false;
+            memcpy(arg, data + r, str_len);
+            arg[str_len] = '\0';
+            r += str_len;
+            written = str_len + 1;
+        }
+        else return false;
+
+        r += n;
+        w += written;
+        args[nArgs++] = arg;
     }
-    *(endp+1) = '\0';
+    return r == len;
 }
 
-template <typename F>
-static void __removeUnwantedChars(char *&str, const F &isUnwanted)
+SmartFrameStream::SmartFrameStream(Stream *stream)
+: _stream(stream)
+{}
+
+void SmartFrameStream::begin(uint8_t id, uint8_t seq)
 {
-    if (str == NULL || *str == '\0') {
-        return; // Nothing to remove
-    }
+    _id = id;
+    _seq = seq;
+    _lineLen = 0;
+}
 
-    _smart_comm_size_t len = strlen(str);
-    if (len == 1)
+size_t SmartFrameStream::write(uint8_t c)
+{
+    if (c == '\r') return 1;
+    if (c == '\n')
     {
-        if (isUnwanted(*str))
-            *str = '\0';
-        return;
+        _sendLine();
+        return 1;
     }
+    if (_lineLen >= SMART_BIN_LINE_LEN)
+        _sendLine();
+    _line[_lineLen++] = c;
+    return 1;
+}
 
-    char *endp = str + len - 1;
+void SmartFrameStream::flush()
+{
+    _sendLine();
+    _stream->flush();
+}
 
-    // remove from front
-    while (isUnwanted(*str))
-        ++str;
+void SmartFrameStream::_sendLine()
+{
+    if (_lineLen == 0) return;
 
-    // remove from tail
-    while (isUnwanted(*endp) && endp > str)
-        --endp;
-    if (endp <= str)
-    {
-        *(endp+1) = '\0';
-        return;
-    }
+    _frame[0] = _id;
+    _frame[1] = _seq;
+    uint8_t *body = _frame + 2;
+    const size_t body_max = sizeof(_frame) - SMART_BIN_OVERHEAD;
 
-    // remove from center
-    _smart_comm_size_t nConsec = 0;
-    for (char *p = str+1; p < endp; ++p)
+    size_t body_len = _encoder ? _encoder(_line, _lineLen, body, body_max) : 0;
+    if (body_len == 0 || body_len > body_max)
     {
-        while (isUnwanted(*(p + nConsec)))
-            ++nConsec;
-
-        // shift all chars to the left nConsec places
-        if (nConsec)
+        // as a MessagePack str
+        const size_t n = _lineLen;
+        size_t header;
+        if (n < 32)
+        {
+            body[0] = 0xA0 | n;
+            header = 1;
+        }
+        else if (n < 256)
         {
-            memmove(p, p+nConsec, endp-p);
-            endp -= nConsec;
-            nConsec = 0;
+            body[0] = 0xD9;
+            body[1] = n;
+            header = 2;
         }
+        else
+        {
+            body[0] = 0xDA;
+            body[1] = n >> 8;
+            body[2] = n & 0xFF;
+            header = 3;
+        }
+        memcpy(body + header, _line, n);
+        body_len = header + n;
     }
-    *(endp+1) = '\0';
-}
 
-static bool __isCharUnwanted(char c, char endChar, char sepChar)
-{
-    return !(c == endChar || c == sepChar || (c > 32 && c < 127) || c == '\0');
+    const size_t len = 2 + body_len;
+    const uint16_t crc = __smartCrc16(_frame, len);
+    _frame[len] = crc & 0xFF;
+    _frame[len + 1] = crc >> 8;
+    __cobsWrite(_stream, _frame, len + 2);
+    _lineLen = 0;
 }
 
-bool __extractArguments(char *buffer, char endChar, char sepChar, char *&command, char *args[MAX_ARGUMENTS], _smart_comm_size_t &nArgs)
+void __defaultLineTooLongCB(Stream *stream, const char *cmd)
 {
-    // return true if arguments were found. populates nArgs and populates the args array of arguments.
-    // buffer cannot be used afterward because it is modified to store the arguments pointed to by args
-
-    // trim leading and trailing sepChars from _buffer
-    __trimChar(buffer, sepChar);
-
-    // remove duplicate sepChars
-    __removeConsecutiveDuplicates(buffer, sepChar);
+    #if defined(ARDUINO_ARCH_AVR)
+    stream->print(F("ERROR: Line too long for command '"));
+    stream->print(cmd);
+    stream->println(F("'"));
+    #else
+    stream->print("ERROR: Line too long for command '");
+    stream->print(cmd);
+    stream->println("'");
+    #endif
+}
 
-    // remove unwanted chars
-    __removeUnwantedChars(buffer, [endChar, sepChar](char c){ return __isCharUnwanted(c, endChar, sepChar); });
 
-    _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: After conditioning, the message is '");_SMART_COMM_DEBUG_PRINT(buffer);_SMART_COMM_DEBUG_PRINT_STATIC("'\n");
 
-    command = buffer;
+/// SmartComm /////////////////////////////////////////////////////////////////////////////////////
 
-    _smart_comm_size_t len = strlen(buffer);
+SmartTokenizer::SmartTokenizer(char *buffer, _smart_comm_size_t size, char endChar, char sepChar)
+: _buffer(buffer), _size(size), _endChar(endChar), _sepChar(sepChar)
+{}
 
-    if (*buffer == '\0' || len == 0)
+bool SmartTokenizer::finish()
+{
+    if (_state == _KEEP)
     {
-        _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: No message structure found\n");
-        return false;
+        _buffer[_pos] = '\0';
+        _state = _BETWEEN;
     }
+    return command != NULL;
+}
 
-    // find all arguments
-    char *sepPtr = buffer; // ptr of the last separation char found + 1
-    // char *args[MAX_ARGUMENTS] = {0}; // ptrs of all separation characters found
-    // _smart_comm_size_t nArgs = 0; // amount of arguments
+void SmartTokenizer::reset()
+{
+    // no need to clear the buffer, the next tokens are written over the old ones
+    _pos = 0;
+    _state = _BETWEEN;
+    _overflow = false;
+    command = NULL;
     nArgs = 0;
-    char *ptr;
-    for (;;)
+}
+
+bool __extractArguments(char *buffer, char endChar, char sepChar, char *&command, char *args[MAX_ARGUMENTS], _smart_comm_size_t &nArgs)
+{
+    // return true if arguments were found. populates nArgs and populates the args array of arguments.
+    // buffer cannot be used afterward because it is modified to store the arguments pointed to by args
+    //
+    // the tokenizer writes each char at most at the position it was read from, so it can split buffer in place
+    SmartTokenizer tokenizer(buffer, strlen(buffer), endChar, sepChar);
+    for (const char *src = buffer; *src != '\0'; ++src)
+        tokenizer.push(*src);
+
+    const bool found = tokenizer.finish();
+    command = found ? tokenizer.command : buffer;
+    nArgs = tokenizer.nArgs;
+    for (_smart_comm_size_t i = 0; i < nArgs; i++)
+        args[i] = tokenizer.args[i];
+
+    if (!found)
     {
-        ptr = strchr(sepPtr, sepChar); // this returns the pointer to the first ocurrence
-
-        if (ptr == NULL) break;
-
-        // later we split the buffer into several strings,
-        // each being an argument (the first is the command)
-        // to reuse the same char array, we can change the
-        // sep chars for '\0' and save pointers to the next char
-        *ptr = '\0';
-        
-        // -2 because we dont want sepIndex to point to the ending '\0'
-        if (ptr >= buffer+len-1) break;
-        sepPtr = ptr+1;
-        
-        if (nArgs >= MAX_ARGUMENTS) break;
-        args[nArgs++] = sepPtr;
+        _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: No message structure found\n");
+        return false;
     }
 
     #ifdef _SMART_COMM_DEBUG
@@ -36,6 +36,10 @@
     #endif
 #endif
 
+#ifndef SMART_CMD_MAX_LEN
+#define SMART_CMD_MAX_LEN 31 // longest command name a SmartCmdF passes to its callback
+#endif
+
 #if defined(ARDUINO_ARCH_AVR)
 #define _smart_comm_size_t uint8_t
 #else
@@ -79,9 +83,13 @@
  * 
  * This library was written with memory footprint in mind and tries to reuse all buffers in a way the least amount of memory is
  * used at the same time. Because of this it could handle long messages and many different commands simultaneously. It was also
- * designed to allocate no memory on the heap (except when using PROGMEM variables where copying the PROGMEM data too RAM is
- * non-avoidable). Because of this the setup of the commands and callbacks may be a bit more involve than you might expect.
- * However you'll see it's quite intuitive.
+ * designed to allocate no memory on the heap. Because of this the setup of the commands and callbacks may be a bit more involve
+ * than you might expect. However you'll see it's quite intuitive.
+ *
+ * Every command carries a hash of its name, computed at compile time when the command is created from a literal (as the
+ * macros below do). SmartComm puts the commands in an open addressing table by that hash when it's constructed, so finding
+ * the command of a message hashes the received word once and normally compares a single string, no matter how many
+ * commands there are.
  * 
  * You can use the helper macro SMART_CMD_CREATE to more easily create commands. The macro is used in the following way.
  * SMART_CMD_CREATE(className, command, callback);
@@ -92,7 +100,7 @@
  * is generated by using SMART_CMD_CREATE(className, "command", callback); when PROGMEM is available is the following:
  *
  * const PROGMEM char __className_pstr_cmd[] = "command";
- * SmartCmdF className(__className_pstr_cmd, callback);
+ * SmartCmdF className(__className_pstr_cmd, callback, __smartCmdHash("command"));
  * 
  * or, if no PROGMEM is available:
  *
@@ -153,11 +161,13 @@ struct SmartCmdArguments
 {
 private:
     const char *const *const _args;
-    const char *arg(_smart_comm_size_t n) const;
 
 public:
     const _smart_comm_size_t N = 0;
 
+    // NULL if there aren't n+1 arguments
+    const char *arg(_smart_comm_size_t n) const;
+
     SmartCmdArguments(_smart_comm_size_t n, const char *const args[MAX_ARGUMENTS]);
     // bool toInt(_smart_comm_size_t n, long *i);
     // bool toBool(_smart_comm_size_t n, bool *b);
@@ -166,20 +176,140 @@ public:
 };
 
 
+/// SmartPayloadStream ////////////////////////////////////////////////////////////////////////
+
+#ifndef SMART_PAYLOAD_TIMEOUT_MS
+#define SMART_PAYLOAD_TIMEOUT_MS 1000 // longest wait for the next byte of a payload
+#endif
+
+/*
+ * The next len bytes of a stream, as a stream of their own. A command that announces a payload (e.g. "rundata payload 812"
+ * followed by the 812 bytes) can hand it to a parser like deserializeJson directly from inside its callback, without
+ * the payload going through the line buffer, and without the length limit of a line. When the callback returns SmartComm
+ * is back to reading lines, so the callback must consume the whole payload, skip() drops whatever the parser left.
+ * Writes go to the original stream.
+ */
+class SmartPayloadStream : public Stream
+{
+private:
+    Stream *const _stream;
+    size_t _remaining;
+
+public:
+    SmartPayloadStream(Stream *stream, size_t len, unsigned long timeout_ms=SMART_PAYLOAD_TIMEOUT_MS);
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override { return _stream->write(c); }
+    void flush() override { _stream->flush(); }
+
+    // reads and drops the rest of the payload. false if it timed out before the end
+    bool skip();
+    inline size_t remaining() const { return _remaining; }
+};
+
+/// Binary frames /////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Besides lines of text, SmartComm can exchange binary frames once the program switches it with setBinary(true) (usually
+ * from a command, so the host negotiates it). Every frame is COBS encoded and ended by 0x00, so a lost byte only costs
+ * the frame it was in. Decoded, a frame is
+ *     [id][seq][body...][crc16 lo][crc16 hi]
+ * with the CRC-16/CCITT-FALSE of everything before it.
+ *
+ * In a request id is the index of the command in the commands array, and the body is a MessagePack array of scalars
+ * (nil, bool, int, float, str) with its arguments. They are turned into the same text arguments a line would give, so
+ * the commands work the same in both modes. seq is chosen by the host and echoed back.
+ * Every line a command writes is sent back as a frame with the id and seq of its request, and a MessagePack body. The
+ * encoder set with setBinaryEncoder converts the line (e.g. json to MessagePack), or if there's none or it fails, the
+ * line is sent as a MessagePack str.
+ * A frame with id SMART_BIN_ID_TEXT goes back to text mode. Frames with a bad CRC are dropped.
+ */
+
+#ifndef SMART_BIN_LINE_LEN
+// longest reply line, longer ones are split into several frames
+#if defined(ARDUINO_ARCH_AVR)
+#define SMART_BIN_LINE_LEN 64
+#else
+#define SMART_BIN_LINE_LEN 512
+#endif
+#endif
+#define SMART_BIN_ID_TEXT   0xFF // request: back to text mode
+#define SMART_BIN_ID_ERROR  0xFE // reply to a frame that couldn't be dispatched
+#define SMART_BIN_OVERHEAD  4    // id, seq and crc
+
+// returns the number of bytes written to out, 0 if the line can't be encoded
+typedef size_t (*smartBinEncoderCB_t)(const char *line, size_t len, uint8_t *out, size_t out_len);
+
+uint16_t __smartCrc16(const uint8_t *data, size_t len);
+// in place, the decoded frame is never longer. returns its length, or 0 if it's malformed
+size_t __cobsDecode(uint8_t *buf, size_t len);
+// writes buf COBS encoded, followed by the 0x00 delimiter
+void __cobsWrite(Print *out, const uint8_t *buf, size_t len);
+// turns a MessagePack array of scalars into text arguments, stored back to back in out
+bool __msgpackToArguments(const uint8_t *data, size_t len, char *out, size_t out_len, char *args[MAX_ARGUMENTS], _smart_comm_size_t &nArgs);
+
+// the stream commands write to in binary mode. it collects each line and sends it as a reply frame. reads go to the
+// original stream
+class SmartFrameStream : public Stream
+{
+private:
+    Stream *const _stream;
+    smartBinEncoderCB_t _encoder = NULL;
+    uint8_t _id = 0, _seq = 0;
+    char _line[SMART_BIN_LINE_LEN];
+    size_t _lineLen = 0;
+    // a whole line fits as a str (3 bytes of header at most)
+    uint8_t _frame[SMART_BIN_OVERHEAD + 3 + SMART_BIN_LINE_LEN];
+
+    void _sendLine();
+
+public:
+    SmartFrameStream(Stream *stream);
+    inline void setEncoder(smartBinEncoderCB_t encoder) { _encoder = encoder; }
+    // the id and seq of the replies that follow
+    void begin(uint8_t id, uint8_t seq);
+    inline uint8_t id() const { return _id; }
+    inline uint8_t seq() const { return _seq; }
+
+    int available() override { return _stream->available(); }
+    int read() override { return _stream->read(); }
+    int peek() override { return _stream->peek(); }
+    size_t write(uint8_t c) override;
+    // also sends the line written so far, if it didn't end with a newline
+    void flush() override;
+};
+
 /// SmartCmds /////////////////////////////////////////////////////////////////////////////////
 
+// FNV-1a of a command name. a constant expression for the names of the commands, and a plain loop for the received
+// tokens, that can be as long as a line
+constexpr uint32_t __smartCmdHash(const char *str, uint32_t hash = 2166136261UL)
+{
+    for (; *str; str++)
+        hash = (hash ^ static_cast<uint8_t>(*str)) * 16777619UL;
+    return hash;
+}
+
 typedef void (*smartCmdCB_t)(Stream*, const SmartCmdArguments*, const char*);
 typedef void (*serialDefaultCmdCB_t)(Stream*, const char*);
 
 void __defaultCommandNotRecognizedCB(Stream *stream, const char *cmd);
+void __defaultLineTooLongCB(Stream *stream, const char *cmd);
 
 class SmartCmdBase
 {
 protected:
     const char *_cmd;
     smartCmdCB_t _cb;
+    uint32_t _hash;
 public:
-    SmartCmdBase(const char *command, smartCmdCB_t callback);
+    constexpr SmartCmdBase(const char *command, smartCmdCB_t callback, uint32_t hash)
+    : _cmd(command), _cb(callback), _hash(hash) {}
+    inline uint32_t hash() const { return _hash; }
+    // in flash for a SmartCmdF
+    inline const char *command() const { return _cmd; }
     virtual bool is_command(const char *str) const = 0;
     virtual void callback(Stream *stream, const SmartCmdArguments *args) const = 0;
 };
@@ -187,7 +317,8 @@ public:
 class SmartCmd : public SmartCmdBase
 {
 public:
-    SmartCmd(const char *command, smartCmdCB_t callback);
+    constexpr SmartCmd(const char *command, smartCmdCB_t callback)
+    : SmartCmdBase(command, callback, __smartCmdHash(command)) {}
     bool is_command(const char *str) const;
     void callback(Stream *stream, const SmartCmdArguments *args) const;
 };
@@ -196,7 +327,10 @@ public:
 class SmartCmdF : public SmartCmdBase
 {
 public:
+    // the name can't be read from flash at compile time, so without its hash it's hashed when constructed
     SmartCmdF(const PROGMEM char *command, smartCmdCB_t callback);
+    constexpr SmartCmdF(const PROGMEM char *command, smartCmdCB_t callback, uint32_t hash)
+    : SmartCmdBase(command, callback, hash) {}
     bool is_command(const char *str) const;
     void callback(Stream *stream, const SmartCmdArguments *args) const;
 };
@@ -208,7 +342,7 @@ public:
 #ifdef PROGMEM
 #define SMART_CMD_CREATE(className, command, callback) \
     const PROGMEM char __##className##_pstr_cmd[] = command; \
-    SmartCmdF className(__##className##_pstr_cmd, (callback));
+    SmartCmdF className(__##className##_pstr_cmd, (callback), __smartCmdHash(command));
 #else
 #define SMART_CMD_CREATE(className, command, callback) SMART_CMD_CREATE_RAM(className, command, (callback))
 #endif
@@ -221,6 +355,88 @@ public:
 // void __removeUnwantedChars(char *&str, char endChar, char sepChar);
 bool __extractArguments(char *buffer, char endChar, char sepChar, char *&command, char *args[MAX_ARGUMENTS], _smart_comm_size_t &nArgs);
 
+/*
+ * Splits a message into its command and arguments one char at a time, as the chars arrive. Unwanted chars are dropped,
+ * any run of sepChars ends the current token, and the tokens are stored back to back in buffer, each ended by '\0'.
+ * The tokens past MAX_ARGUMENTS are dropped. Every push is O(1), once buffer is full the rest of the message is ignored
+ * and overflow() is set, until reset() starts the next message.
+ */
+class SmartTokenizer
+{
+private:
+    char *const _buffer;
+    const _smart_comm_size_t _size; // chars that fit in buffer, it must have room for one more '\0'
+    const char _endChar, _sepChar;
+    _smart_comm_size_t _pos = 0;
+    enum : uint8_t { _BETWEEN, _KEEP, _DROP } _state = _BETWEEN;
+    bool _overflow = false;
+
+public:
+    char *command = NULL;
+    char *args[MAX_ARGUMENTS] = {0};
+    _smart_comm_size_t nArgs = 0;
+
+    SmartTokenizer(char *buffer, _smart_comm_size_t size, char endChar, char sepChar);
+    // in the header so it inlines into the loops that feed it, it runs for every received char
+    void push(char c);
+    // ends the last token. true if there is a command
+    bool finish();
+    void reset();
+    inline bool overflow() const { return _overflow; }
+};
+
+static inline bool __isCharUnwanted(char c, char endChar, char sepChar)
+{
+    return !(c == endChar || c == sepChar || (c > 32 && c < 127) || c == '\0');
+}
+
+inline void SmartTokenizer::push(char c)
+{
+    if (_overflow) return;
+
+    if (c == _sepChar)
+    {
+        // _pos <= _size while in a token, the '\0' can take the extra char of buffer
+        if (_state == _KEEP)
+            _buffer[_pos++] = '\0';
+        _state = _BETWEEN;
+        return;
+    }
+    // '\0' would end the token early, it's dropped with the rest
+    if (c == '\0' || __isCharUnwanted(c, _endChar, _sepChar)) return;
+
+    if (_state == _BETWEEN)
+    {
+        if (command == NULL || nArgs < MAX_ARGUMENTS)
+        {
+            if (_pos >= _size) goto overflow;
+            if (command == NULL)
+                command = _buffer + _pos;
+            else
+                args[nArgs++] = _buffer + _pos;
+            _state = _KEEP;
+        }
+        else
+            // the arguments past MAX_ARGUMENTS are dropped
+            _state = _DROP;
+    }
+    if (_state == _DROP) return;
+
+    if (_pos >= _size) goto overflow;
+    _buffer[_pos++] = c;
+    return;
+
+    overflow:
+    _overflow = true;
+    finish();
+}
+
+// smallest power of two >= 2*n, so the command table is at most half full and every probe ends on an empty slot
+constexpr _smart_comm_size_t __smartCommTableSize(_smart_comm_size_t n, _smart_comm_size_t size = 1)
+{
+    return size >= 2 * n ? size : __smartCommTableSize(n, 2 * size);
+}
+
 template
 <_smart_comm_size_t N_CMDS>
 class SmartComm
@@ -230,83 +446,205 @@ private:
     const SmartCmdBase *const *const _cmds;
     serialDefaultCmdCB_t _defaultCB;
     const char _endChar, _sepChar;
+    serialDefaultCmdCB_t _lineTooLongCB;
     char _buffer[STREAM_BUFFER_LEN+1] = {'\0'};
-    _smart_comm_size_t _bufferPos = 0;
+    SmartTokenizer _tokenizer;
+
+    static constexpr _smart_comm_size_t _TABLE_SIZE = __smartCommTableSize(N_CMDS);
+    _smart_comm_size_t _table[_TABLE_SIZE] = {0}; // index+1 into _cmds, 0 is an empty slot
+
+    const SmartCmdBase *_find(const char *command) const;
+
+    bool _binary = false;
+    _smart_comm_size_t _binLen = 0;
+    bool _binOverflow = false;
+    SmartFrameStream _frameStream;
+
+    void _binaryPush(uint8_t c);
+    void _binaryDispatch();
 
 public:
-    constexpr SmartComm(const SmartCmdBase *const cmds[N_CMDS], Stream &stream=Serial, char endChar = '\n', char sepChar = ' ', serialDefaultCmdCB_t defaultCB=__defaultCommandNotRecognizedCB);
+    SmartComm(const SmartCmdBase *const cmds[N_CMDS], Stream &stream=Serial, char endChar = '\n', char sepChar = ' ', serialDefaultCmdCB_t defaultCB=__defaultCommandNotRecognizedCB, serialDefaultCmdCB_t lineTooLongCB=__defaultLineTooLongCB);
     void tick();
+
+    // switches between lines of text and binary frames. it takes effect from the next received byte
+    void setBinary(bool binary);
+    inline bool binary() const { return _binary; }
+    inline void setBinaryEncoder(smartBinEncoderCB_t encoder) { _frameStream.setEncoder(encoder); }
+    // the stream the commands get in binary mode, to send replies after the command returned
+    inline SmartFrameStream *frameStream() { return &_frameStream; }
 };
 
 template<_smart_comm_size_t N_CMDS>
-constexpr SmartComm<N_CMDS>::SmartComm(const SmartCmdBase *const cmds[N_CMDS], Stream &stream, char endChar, char sepChar, serialDefaultCmdCB_t defaultCB)
-: _cmds(cmds), _stream(&stream), _defaultCB(defaultCB), _endChar(endChar), _sepChar(sepChar)
+SmartComm<N_CMDS>::SmartComm(const SmartCmdBase *const cmds[N_CMDS], Stream &stream, char endChar, char sepChar, serialDefaultCmdCB_t defaultCB, serialDefaultCmdCB_t lineTooLongCB)
+: _cmds(cmds), _stream(&stream), _defaultCB(defaultCB), _endChar(endChar), _sepChar(sepChar), _lineTooLongCB(lineTooLongCB),
+  _tokenizer(_buffer, STREAM_BUFFER_LEN, endChar, sepChar), _frameStream(&stream)
 {
     static_assert(N_CMDS <= MAX_COMMANDS, "Can't have this many commands");
+
+    // linear probing. a repeated command name keeps the slot of its first appearance, like the first match of a scan
+    for (_smart_comm_size_t i = 0; i < N_CMDS; i++)
+    {
+        if (!_cmds[i])
+            // to prevent the edge case where the user specifies N_CMDS to be a greater number than the provided commands in the cmds array
+            // or when the cmds array has nullprts inside
+            continue;
+        _smart_comm_size_t slot = _cmds[i]->hash() & (_TABLE_SIZE - 1);
+        while (_table[slot])
+            slot = (slot + 1) & (_TABLE_SIZE - 1);
+        _table[slot] = i + 1;
+    }
+}
+
+template<_smart_comm_size_t N_CMDS>
+const SmartCmdBase *SmartComm<N_CMDS>::_find(const char *command) const
+{
+    const uint32_t hash = __smartCmdHash(command);
+    for (_smart_comm_size_t slot = hash & (_TABLE_SIZE - 1); _table[slot]; slot = (slot + 1) & (_TABLE_SIZE - 1))
+    {
+        const SmartCmdBase *cmd = _cmds[_table[slot] - 1];
+        // the full hash filters out the other names of the probe chain, the string compare only confirms the match
+        if (cmd->hash() == hash && cmd->is_command(command))
+            return cmd;
+    }
+    return NULL;
 }
 
 template<_smart_comm_size_t N_CMDS>
 void SmartComm<N_CMDS>::tick()
 {
+    // the message is split as it arrives, so when endChar comes in it only has to be dispatched
     while (_stream->available())
     {
         char c = _stream->read();
 
-        if (c == _endChar)
+        if (_binary)
         {
-            _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: Processing message: '");_SMART_COMM_DEBUG_PRINT(_buffer);_SMART_COMM_DEBUG_PRINT_STATIC("'\n");
-
-            char *command, *args[MAX_ARGUMENTS] = {0};
-            _smart_comm_size_t nArgs = 0;
+            _binaryPush(c);
+            continue;
+        }
 
-            if (__extractArguments(_buffer, _endChar, _sepChar, command, args, nArgs))
-            {
-                // get the serial command selected
-                const SmartCmdBase *sc = NULL;
-                for (_smart_comm_size_t i = 0; i < N_CMDS; i++)
-                {
-                    if (!_cmds[i])
-                        // to prevent the edge case where the user specifies N_CMDS to be a greater number than the provided commands in the cmds array
-                        // or when the cmds array has nullprts inside
-                        continue;
-                    if (_cmds[i]->is_command(command))
-                    {
-                        sc = _cmds[i];
-                        break;
-                    }
-                }
-
-                if (sc)
-                {
-                    _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: Found SmartCmd for command '");_SMART_COMM_DEBUG_PRINT(command);_SMART_COMM_DEBUG_PRINT_STATIC("'. Calling the SmartCmd callback\n");
-                    // execute command
-                    const SmartCmdArguments smartArgs(nArgs, args);
-                    sc->callback(_stream, &smartArgs);
-                }
-                else
-                {
-                    // execute default command
-                    _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: Coundln't find SmartCmd for command '");_SMART_COMM_DEBUG_PRINT(command);_SMART_COMM_DEBUG_PRINT_STATIC("'. Calling default callback\n");
-                    _defaultCB(_stream, command);
-                }
-            }
+        if (c != _endChar)
+        {
+            _tokenizer.push(c);
+            continue;
+        }
 
-            memset(_buffer, '\0', STREAM_BUFFER_LEN);
-            _bufferPos = 0;
+        const bool hasCommand = _tokenizer.finish();
+        if (_tokenizer.overflow())
+        {
+            _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: Message too long, it was discarded\n");
+            _lineTooLongCB(_stream, hasCommand ? _tokenizer.command : "");
         }
-        else
+        else if (hasCommand)
         {
-            if (_bufferPos < STREAM_BUFFER_LEN-1)
-                _buffer[_bufferPos++] = c;
+            const char *command = _tokenizer.command;
+            _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: Processing command '");_SMART_COMM_DEBUG_PRINT(command);_SMART_COMM_DEBUG_PRINT_STATIC("'\n");
+
+            // get the serial command selected
+            const SmartCmdBase *sc = _find(command);
+
+            if (sc)
+            {
+                _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: Found SmartCmd for command '");_SMART_COMM_DEBUG_PRINT(command);_SMART_COMM_DEBUG_PRINT_STATIC("'. Calling the SmartCmd callback\n");
+                // execute command
+                const SmartCmdArguments smartArgs(_tokenizer.nArgs, _tokenizer.args);
+                sc->callback(_stream, &smartArgs);
+            }
             else
             {
-                // forget old inputs (but slow)
-                _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: Buffer input overflowing");
-                memmove(_buffer+1, _buffer, STREAM_BUFFER_LEN-1);
-                _buffer[STREAM_BUFFER_LEN-2] = c;
+                // execute default command
+                _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: Coundln't find SmartCmd for command '");_SMART_COMM_DEBUG_PRINT(command);_SMART_COMM_DEBUG_PRINT_STATIC("'. Calling default callback\n");
+                _defaultCB(_stream, command);
             }
         }
+
+        _tokenizer.reset();
+    }
+}
+
+
+template<_smart_comm_size_t N_CMDS>
+void SmartComm<N_CMDS>::setBinary(bool binary)
+{
+    // both modes share _buffer, whatever was half received is dropped
+    _binary = binary;
+    _binLen = 0;
+    _binOverflow = false;
+    _tokenizer.reset();
+}
+
+template<_smart_comm_size_t N_CMDS>
+void SmartComm<N_CMDS>::_binaryPush(uint8_t c)
+{
+    // COBS frames have no 0x00 inside, so like a line they're collected until their delimiter, and an overflowing one
+    // is dropped without copying anything
+    if (c != 0)
+    {
+        if (_binLen < STREAM_BUFFER_LEN)
+            _buffer[_binLen++] = c;
+        else
+            _binOverflow = true;
+        return;
+    }
+
+    if (_binOverflow)
+    {
+        _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: Frame too long, it was discarded\n");
+        _frameStream.begin(SMART_BIN_ID_ERROR, 0);
+        _lineTooLongCB(&_frameStream, "");
+        _frameStream.flush();
+    }
+    else if (_binLen)
+        _binaryDispatch();
+
+    _binLen = 0;
+    _binOverflow = false;
+}
+
+template<_smart_comm_size_t N_CMDS>
+void SmartComm<N_CMDS>::_binaryDispatch()
+{
+    uint8_t *frame = reinterpret_cast<uint8_t *>(_buffer);
+    const size_t len = __cobsDecode(frame, _binLen);
+    if (len < SMART_BIN_OVERHEAD || __smartCrc16(frame, len - 2) != (frame[len - 2] | (frame[len - 1] << 8)))
+    {
+        // the host gets no reply and can send it again
+        _SMART_COMM_DEBUG_PRINT_STATIC("SMARTCOMM DEBUG: Dropped a corrupted frame\n");
+        return;
+    }
+
+    const uint8_t id = frame[0];
+    _frameStream.begin(id, frame[1]);
+
+    if (id == SMART_BIN_ID_TEXT)
+    {
+        _frameStream.println("text");
+        _frameStream.flush();
+        setBinary(false);
+        return;
+    }
+
+    // the text arguments go in the part of _buffer after the frame
+    char *args[MAX_ARGUMENTS] = {0};
+    _smart_comm_size_t nArgs = 0;
+    if (id >= N_CMDS || !_cmds[id])
+    {
+        char name[4];
+        snprintf(name, sizeof(name), "%u", id);
+        _defaultCB(&_frameStream, name);
+    }
+    else if (!__msgpackToArguments(frame + 2, len - SMART_BIN_OVERHEAD, _buffer + len, STREAM_BUFFER_LEN + 1 - len, args, nArgs))
+    {
+        _frameStream.print("ERROR: Bad arguments for command ");
+        _frameStream.println(id);
+    }
+    else
+    {
+        const SmartCmdArguments smartArgs(nArgs, args);
+        _cmds[id]->callback(&_frameStream, &smartArgs);
     }
+    _frameStream.flush();
 }
 
 
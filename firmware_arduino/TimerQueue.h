@@ -0,0 +1,196 @@
+#ifndef _TIMER_QUEUE_H_
+#define _TIMER_QUEUE_H_
+
+#include <Arduino.h>
+
+typedef uint32_t TimerHandle;
+#define TIMER_QUEUE_INVALID_HANDLE 0
+
+/*
+ * Fixed capacity queue of timers ordered by deadline (e.g. time_us_64()), without allocations. It's a binary min-heap of
+ * indices into a pool of entries, and every entry knows its position in the heap, so cancel and reschedule are
+ * O(log N) as well as schedule and pop.
+ *
+ * A handle holds the index of the entry and a generation that changes every time the entry is reused, so a handle to
+ * a timer that already fired or was cancelled is rejected instead of touching whatever timer took its place.
+ * Timers with the same deadline fire in the order they were scheduled.
+ */
+template <typename T, size_t N>
+class TimerQueue
+{
+private:
+    struct Entry
+    {
+        uint64_t deadline;
+        uint32_t seq;
+        uint16_t heap_pos;
+        uint16_t generation;
+        T data;
+    };
+
+    Entry _entries[N];
+    uint16_t _heap[N]; // entry indices, _heap[0] is the earliest deadline
+    uint16_t _free[N]; // stack of unused entry indices
+    size_t _size = 0, _n_free = N;
+    uint32_t _seq = 0;
+
+    inline bool _before(uint16_t a, uint16_t b) const
+    {
+        const Entry &ea = _entries[a], &eb = _entries[b];
+        if (ea.deadline != eb.deadline) return ea.deadline < eb.deadline;
+        // wraps after 2^32 timers, only matters for timers with the same deadline that far apart
+        return static_cast<int32_t>(ea.seq - eb.seq) < 0;
+    }
+
+    inline void _place(size_t pos, uint16_t idx)
+    {
+        _heap[pos] = idx;
+        _entries[idx].heap_pos = pos;
+    }
+
+    void _sift_up(size_t pos)
+    {
+        const uint16_t idx = _heap[pos];
+        while (pos > 0)
+        {
+            const size_t parent = (pos - 1) / 2;
+            if (!_before(idx, _heap[parent])) break;
+            _place(pos, _heap[parent]);
+            pos = parent;
+        }
+        _place(pos, idx);
+    }
+
+    void _sift_down(size_t pos)
+    {
+        const uint16_t idx = _heap[pos];
+        for (;;)
+        {
+            size_t child = 2 * pos + 1;
+            if (child >= _size) break;
+            if (child + 1 < _size && _before(_heap[child + 1], _heap[child])) ++child;
+            if (!_before(_heap[child], idx)) break;
+            _place(pos, _heap[child]);
+            pos = child;
+        }
+        _place(pos, idx);
+    }
+
+    void _remove_at(size_t pos)
+    {
+        const uint16_t idx = _heap[pos];
+        ++_entries[idx].generation;
+        _free[_n_free++] = idx;
+
+        --_size;
+        if (pos == _size) return;
+        // fill the hole with the last leaf and restore the order in whichever direction it's broken
+        _place(pos, _heap[_size]);
+        if (pos > 0 && _before(_heap[pos], _heap[(pos - 1) / 2]))
+            _sift_up(pos);
+        else
+            _sift_down(pos);
+    }
+
+    // returns the entry index or -1
+    inline int32_t _lookup(TimerHandle handle) const
+    {
+        if (handle == TIMER_QUEUE_INVALID_HANDLE) return -1;
+        const uint16_t idx = (handle & 0xFFFF) - 1;
+        if (idx >= N) return -1;
+        const Entry &e = _entries[idx];
+        if (e.generation != (handle >> 16)) return -1;
+        if (e.heap_pos >= _size || _heap[e.heap_pos] != idx) return -1;
+        return idx;
+    }
+
+public:
+    TimerQueue()
+    {
+        static_assert(N > 0, "Can't have an empty timer queue");
+        static_assert(N < 0xFFFF, "TimerQueue indices are 16 bits");
+        for (size_t i = 0; i < N; i++)
+        {
+            _free[i] = N - 1 - i;
+            _entries[i].generation = 0;
+            _entries[i].heap_pos = N;
+        }
+    }
+
+    // returns TIMER_QUEUE_INVALID_HANDLE if the queue is full
+    TimerHandle schedule(uint64_t deadline, const T *data)
+    {
+        if (_n_free == 0) return TIMER_QUEUE_INVALID_HANDLE;
+        const uint16_t idx = _free[--_n_free];
+        Entry &e = _entries[idx];
+        e.deadline = deadline;
+        e.seq = _seq++;
+        e.data = *data;
+        _place(_size, idx);
+        _sift_up(_size++);
+        return (static_cast<uint32_t>(e.generation) << 16) | (idx + 1);
+    }
+
+    bool cancel(TimerHandle handle)
+    {
+        const int32_t idx = _lookup(handle);
+        if (idx < 0) return false;
+        _remove_at(_entries[idx].heap_pos);
+        return true;
+    }
+
+    // moves a pending timer to a new deadline, keeping its handle
+    bool reschedule(TimerHandle handle, uint64_t deadline)
+    {
+        const int32_t idx = _lookup(handle);
+        if (idx < 0) return false;
+        Entry &e = _entries[idx];
+        const bool earlier = deadline < e.deadline;
+        e.deadline = deadline;
+        e.seq = _seq++;
+        if (earlier) _sift_up(e.heap_pos);
+        else _sift_down(e.heap_pos);
+        return true;
+    }
+
+    inline bool pending(TimerHandle handle) const { return _lookup(handle) >= 0; }
+
+    // earliest deadline, false if empty
+    bool next_deadline(uint64_t *deadline) const
+    {
+        if (_size == 0) return false;
+        (*deadline) = _entries[_heap[0]].deadline;
+        return true;
+    }
+
+    // pops the earliest timer if its deadline is <= now
+    bool pop_due(uint64_t now, T *data, uint64_t *deadline=NULL)
+    {
+        if (_size == 0 || _entries[_heap[0]].deadline > now) return false;
+        return pop(data, deadline);
+    }
+
+    // pops the earliest timer whether it's due or not
+    bool pop(T *data, uint64_t *deadline=NULL)
+    {
+        if (_size == 0) return false;
+        const Entry &e = _entries[_heap[0]];
+        (*data) = e.data;
+        if (deadline) (*deadline) = e.deadline;
+        _remove_at(0);
+        return true;
+    }
+
+    inline void clean()
+    {
+        while (_size > 0) _remove_at(_size - 1);
+    }
+
+    inline size_t buffer_size() const { return N; }
+    inline size_t size() const { return _size; }
+    inline bool empty() const { return _size == 0; }
+    inline bool available() const { return _size > 0; }
+    inline bool full() const { return _n_free == 0; }
+};
+
+#endif /* _TIMER_QUEUE_H_ */
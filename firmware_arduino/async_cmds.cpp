@@ -0,0 +1,146 @@
+#include "async_cmds.h"
+#include "json_reply.h"
+
+#include <hardware/sync.h>
+
+bool AsyncCmds::submit(Stream *stream, const SmartCmdArguments *args, const char *cmd, smartCmdCB_t cb)
+{
+    AsyncCmdJob job;
+    job.cb = cb;
+    job.target.stream = stream;
+    job.target.framed = _frames && stream == _frames;
+    if (job.target.framed)
+    {
+        job.target.frame_id = _frames->id();
+        job.target.frame_seq = _frames->seq();
+    }
+    strncpy(job.cmd, cmd, SMART_CMD_MAX_LEN);
+    job.cmd[SMART_CMD_MAX_LEN] = '\0';
+
+    // the arguments back to back, they only live until the command returns
+    size_t w = 0;
+    job.n_args = args->N;
+    for (_smart_comm_size_t i = 0; i < args->N; i++)
+    {
+        const char *arg = args->arg(i);
+        const size_t len = strlen(arg) + 1;
+        if (w + len > ASYNC_CMDS_ARGS_LEN)
+        {
+            JsonReply(stream, cmd, JsonReply::Kind::ERR).add("msg", "Arguments too long").send();
+            return false;
+        }
+        memcpy(job.args + w, arg, len);
+        w += len;
+    }
+
+    job.id = _next_id + 1;
+    if (!_jobs.push(&job))
+    {
+        JsonReply(stream, cmd, JsonReply::Kind::ERR).add("msg", "Too many requests in flight").send();
+        return false;
+    }
+    ++_next_id;
+    __sev();
+
+    JsonReply(stream, cmd, JsonReply::Kind::INFO).add("processing", true).add("id", job.id).send();
+    return true;
+}
+
+void AsyncCmds::forward()
+{
+    AsyncCmdReply reply;
+    while (_replies.pop(&reply))
+    {
+        // there's room for the other core again
+        __sev();
+
+        Stream *out = reply.target.stream;
+        if (reply.target.framed)
+        {
+            // a frame is sent when its line ends, the pieces before only fill it
+            if (reply.first) _frames->begin(reply.target.frame_id, reply.target.frame_seq);
+            out = _frames;
+        }
+
+        // {"a":1} becomes {"id":7,"a":1}, written over the room in front of it. lines that aren't json objects go as
+        // they are
+        char *text = reply.buf + ASYNC_CMDS_ID_ROOM;
+        size_t len = reply.len;
+        if (reply.first && len >= 2 && text[0] == '{')
+        {
+            char id[ASYNC_CMDS_ID_ROOM + 2];
+            const int n = snprintf(id, sizeof(id), "{\"id\":%lu%s", static_cast<unsigned long>(reply.id),
+                text[1] == '}' ? "" : ",");
+            text -= n - 1;
+            memcpy(text, id, n);
+            len += n - 1;
+        }
+        if (reply.last) text[len++] = '\n';
+        out->write(reinterpret_cast<const uint8_t *>(text), len);
+        _mid_line = !reply.last;
+    }
+}
+
+bool AsyncCmds::run_next()
+{
+    AsyncCmdJob job;
+    if (!_jobs.pop(&job)) return false;
+
+    const char *argv[MAX_ARGUMENTS] = {0};
+    const char *arg = job.args;
+    for (_smart_comm_size_t i = 0; i < job.n_args; i++)
+    {
+        argv[i] = arg;
+        arg += strlen(arg) + 1;
+    }
+    const SmartCmdArguments args(job.n_args, argv);
+
+    ReplyStream out(this, &job);
+    job.cb(&out, &args, job.cmd);
+    out.flush();
+    return true;
+}
+
+void AsyncCmds::_push_reply(const AsyncCmdReply *reply)
+{
+    // the command waits for the serial instead of losing lines
+    while (!_replies.push(reply))
+        __wfe();
+}
+
+AsyncCmds::ReplyStream::ReplyStream(AsyncCmds *owner, const AsyncCmdJob *job)
+: _owner(owner), _job(job)
+{
+    _reply.id = job->id;
+    _reply.target = job->target;
+    _reply.first = true;
+    _reply.len = 0;
+}
+
+void AsyncCmds::ReplyStream::_push(bool last)
+{
+    _reply.last = last;
+    _owner->_push_reply(&_reply);
+    _reply.first = last;
+    _reply.len = 0;
+}
+
+size_t AsyncCmds::ReplyStream::write(uint8_t c)
+{
+    if (c == '\r') return 1;
+    if (c == '\n')
+    {
+        if (_reply.len > 0 || !_reply.first) _push(true);
+        return 1;
+    }
+    // the line goes on in the next piece
+    if (_reply.len == ASYNC_CMDS_REPLY_LEN) _push(false);
+    _reply.buf[ASYNC_CMDS_ID_ROOM + _reply.len++] = c;
+    return 1;
+}
+
+void AsyncCmds::ReplyStream::flush()
+{
+    // a line the command didn't end
+    if (_reply.len > 0 || !_reply.first) _push(true);
+}
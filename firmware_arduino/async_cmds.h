@@ -0,0 +1,109 @@
+#ifndef _ASYNC_CMDS_H_
+#define _ASYNC_CMDS_H_
+
+#include <Arduino.h>
+
+#include "SmartComm.h"
+#include "Queues.h"
+
+#ifndef ASYNC_CMDS_QUEUE_LEN
+#define ASYNC_CMDS_QUEUE_LEN 4 // requests in flight, a power of two
+#endif
+#ifndef ASYNC_CMDS_REPLY_QUEUE_LEN
+#define ASYNC_CMDS_REPLY_QUEUE_LEN 4 // reply lines waiting for the serial, a power of two
+#endif
+#ifndef ASYNC_CMDS_ARGS_LEN
+#define ASYNC_CMDS_ARGS_LEN 128 // the arguments of a request, each with its '\0'
+#endif
+#ifndef ASYNC_CMDS_REPLY_LEN
+#define ASYNC_CMDS_REPLY_LEN 256 // longer reply lines go in several pieces
+#endif
+// room in front of a reply for {"id":4294967295, so it goes out with a single write
+#define ASYNC_CMDS_ID_ROOM 16
+
+// where the replies of a request go. in binary mode also the frame id and seq of the request, the frame stream only
+// remembers the last one
+struct AsyncCmdTarget
+{
+    Stream *stream;
+    bool framed;
+    uint8_t frame_id, frame_seq;
+};
+
+struct AsyncCmdJob
+{
+    uint32_t id;
+    smartCmdCB_t cb;
+    AsyncCmdTarget target;
+    char cmd[SMART_CMD_MAX_LEN+1];
+    char args[ASYNC_CMDS_ARGS_LEN];
+    _smart_comm_size_t n_args;
+};
+
+struct AsyncCmdReply
+{
+    uint32_t id;
+    AsyncCmdTarget target;
+    bool first, last; // a piece of a line, the id goes in front of the first and the '\n' after the last
+    size_t len;
+    char buf[ASYNC_CMDS_ID_ROOM + ASYNC_CMDS_REPLY_LEN + 1]; // the text starts at ASYNC_CMDS_ID_ROOM
+};
+
+/*
+ * Runs commands on the other core. submit() is called from the command (on the core that runs SmartComm), it copies
+ * the arguments into a job, answers {"cmd":..,"processing":true,"id":..} right away and returns, so the serial and the
+ * main loop keep going. The other core runs the same command callback from run_next(), with a stream that collects
+ * every line the command writes. forward() (back on the first core) sends those lines, with the "id" of the request
+ * added to every json object, so the host can have several requests in flight and match the replies.
+ *
+ * Jobs and replies go through lock-free single producer single consumer rings, one per direction. The core that's
+ * waiting on them sleeps with __wfe, and the other one wakes it with __sev after every push or pop.
+ */
+class AsyncCmds
+{
+private:
+    QueueSPSC<AsyncCmdJob, ASYNC_CMDS_QUEUE_LEN> _jobs;
+    QueueSPSC<AsyncCmdReply, ASYNC_CMDS_REPLY_QUEUE_LEN> _replies;
+    SmartFrameStream *_frames = NULL;
+    uint32_t _next_id = 0;
+    bool _mid_line = false;
+
+    // the stream the command writes to on the other core
+    class ReplyStream : public Stream
+    {
+    private:
+        AsyncCmds *const _owner;
+        const AsyncCmdJob *const _job;
+        AsyncCmdReply _reply;
+
+        void _push(bool last);
+
+    public:
+        ReplyStream(AsyncCmds *owner, const AsyncCmdJob *job);
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+        size_t write(uint8_t c) override;
+        void flush() override;
+    };
+
+    void _push_reply(const AsyncCmdReply *reply);
+
+public:
+    // replies to requests that came in binary mode are sent through frames, with the id and seq of their request
+    inline void set_frame_stream(SmartFrameStream *frames) { _frames = frames; }
+
+    // false if the job couldn't be queued, the error was already sent
+    bool submit(Stream *stream, const SmartCmdArguments *args, const char *cmd, smartCmdCB_t cb);
+    // from the core that runs SmartComm, sends every reply line that's ready
+    void forward();
+    // a long line went out in part and the rest is still on the other core. nothing else may be written to the
+    // serial until it's done, or it lands in the middle of the line (and in binary mode begin() drops it)
+    inline bool mid_line() const { return _mid_line; }
+
+    // from the other core. runs the next job, false if there was none
+    bool run_next();
+    inline bool pending() const { return !_jobs.empty(); }
+};
+
+#endif /* _ASYNC_CMDS_H_ */
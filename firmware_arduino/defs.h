@@ -13,6 +13,11 @@
 #define HX711_MULT_3   7
 #define HX711_MULT_4   4
 
+// several HX711 clocked together, each with its own DOUT (HX711Array, the hx_array command). the rig has a single HX711
+// behind the multiplexers, so it's off. it needs its own SCK, the one above also clocks the multiplexed HX711
+// #define HX711_ARRAY_SCK       18
+// #define HX711_ARRAY_DOUT_PINS {19, 20, 21, 26}
+
 #define SERVO_PIN      11
 // #define SERVO_MIN_DUTY 800
 // #define SERVO_MAX_DUTY 2200
@@ -57,5 +62,12 @@
 
 
 #define HX_STATS_N 30
+// the run loop stops sampling a scale once the standard error of its mean is below this (in calibrated units)
+#define HX_STATS_TARGET_SE 0.05
+#define HX_STATS_DEADLINE_MS 3000
+// drop single-sample spikes (bumps, pump vibration) before they get into the statistics
+#define HX_REJECT_OUTLIERS true
+// carry a weight estimate per slot between visits, so every visit only needs a few fresh samples
+#define HX_TRACK_WEIGHT true
 
 #endif /* _DEFS_H_ */
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include "bme280_helper.h"
 #include "stepper.h"
 #include "hx711_mult.h"
+#ifdef HX711_ARRAY_DOUT_PINS
+#include "hx711_array.h"
+#endif
 #include "sd_helper.h"
 #include "servo_helper.h"
 #include "pump_helper.h"
@@ -10,8 +13,12 @@
 #include "run_data.h"
 #include "Queues.h"
 #include "eeprom_helper.h"
+#include "json_pool.h"
+#include "json_reply.h"
+#include "async_cmds.h"
 
-#include <stdarg.h>
+#include <pico/mutex.h>
+#include <hardware/sync.h>
 
 /// Sensor handler classes ////////////////////////////////////////////////////////////////////////////////////////////////
 BME280I2C bme;
@@ -19,13 +26,44 @@ HX711_Mult hx(HX711_MULT_1, HX711_MULT_2, HX711_MULT_3, HX711_MULT_4, HX711_SCK,
 ServoRPI servo(SERVO_PIN, true);
 Stepper stepper(STEPPER_PIN_1, STEPPER_PIN_2, STEPPER_PIN_3, STEPPER_PIN_4, Stepper::StepType::HALF);
 Pump pump(PUMP_PIN);
+#ifdef HX711_ARRAY_DOUT_PINS
+const pin_size_t hx_array_douts[] = HX711_ARRAY_DOUT_PINS;
+HX711Array hx_array(HX711_ARRAY_SCK, hx_array_douts, ARRAY_LENGTH(hx_array_douts));
+#endif
+
+/// Peripherals lock //////////////////////////////////////////////////////////////////////////////////////////////////////
+// the async commands use the peripherals from core1 while core0 keeps running. it's recursive so whoever holds it can
+// still call begin_peripherals
+auto_init_recursive_mutex(peripherals_mutex);
+class PeripheralsLock
+{
+private:
+    const bool _locked;
+
+public:
+    // blocking waits for the other core to release it, otherwise locked() tells if it was free
+    PeripheralsLock(bool blocking=false)
+    : _locked(blocking ? (recursive_mutex_enter_blocking(&peripherals_mutex), true) : recursive_mutex_try_enter(&peripherals_mutex, NULL))
+    {}
+    ~PeripheralsLock() { if (_locked) recursive_mutex_exit(&peripherals_mutex); }
+    inline bool locked() const { return _locked; }
+};
+#define PERIPHERALS_BUSY_MSG "Busy with an async command, try again"
 
-bool init_peripherals_flag = false;
+volatile bool init_peripherals_flag = false;
 void begin_peripherals()
 {
+    if (init_peripherals_flag) return;
+    // checked again, the other core could have done it while this one waited for the lock
+    PeripheralsLock lock(true);
     if (init_peripherals_flag) return;
     BME_HELPER::begin(&bme, BME280_SDA_PIN, BME280_SCL_PIN);
     hx.begin();
+    hx.set_outlier_rejection(HX_REJECT_OUTLIERS);
+    hx.set_tracking(HX_TRACK_WEIGHT);
+#ifdef HX711_ARRAY_DOUT_PINS
+    hx_array.begin();
+#endif
     stepper.begin();
     RTC::begin();
     init_peripherals_flag = true;
@@ -37,52 +75,31 @@ RunData run_data;
 
 /// Runtime ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 bool stomasense_setup(const char *rundata_json = NULL);
-void stomasense_loop();
+bool stomasense_loop();
 volatile bool run_stomasense_loop = false;
 
+/// Async commands //////////////////////////////////////////////////////////////////////////////////////////////////////
+// the commands that take seconds (hx, hx_raw, hx_calib offset/slope, pos) run on core1
+AsyncCmds async_cmds;
+
 /// Commands //////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// void cmd_error(Stream *stream, const char *cmd, const char *msg)
-// {
-//     stream->printf("{\"err\":true,\"cmd\":\"%s\",\"msg\":\"%s\"}\n", cmd, msg);
-// }
+// every reply is one JsonReply, written on the stack and sent with a single write. the ones with more fields build it
+// themselves
 void cmd_success(Stream *stream, const char *cmd)
 {
-    stream->printf("{\"success\":true,\"cmd\":\"%s\"}\n", cmd);
+    JsonReply(stream, cmd).send();
 }
 void cmd_success(Stream *stream, const char *cmd, JsonDocument *doc)
 {
-    (*doc)["success"] = true;
-    (*doc)["cmd"] = cmd;
-    serializeJson(*doc, *stream);
-    stream->println();
-}
-void cmd_success_va_args(Stream *stream, const char *cmd, const char *fmt, ...)
-{
-    va_list args;
-    va_start(args, fmt);
-
-    stream->printf("{\"success\":true,\"cmd\":\"%s\",", cmd);
-    stream->printf(fmt, args);
-    stream->println("}");
-}
-void cmd_error_va_args(Stream *stream, const char *cmd, const char *fmt, ...)
-{
-    va_list args;
-    va_start(args, fmt);
-
-    stream->printf("{\"err\":true,\"cmd\":\"%s\",", cmd);
-    stream->printf(fmt, args);
-    stream->println("}");
-
-    va_end(args);
+    JsonReply(stream, cmd).add(doc->as<JsonObjectConst>()).send();
 }
 void cmd_error(Stream *stream, const char *cmd, const char *msg)
 {
-    cmd_error_va_args(stream, cmd, "\"msg\":\"%s\"", msg);
+    JsonReply(stream, cmd, JsonReply::Kind::ERR).add("msg", msg).send();
 }
 void cmd_received(Stream *stream, const char *cmd)
 {
-    stream->printf("{\"cmd\":\"%s\",\"processing\":true}\n", cmd);
+    JsonReply(stream, cmd, JsonReply::Kind::INFO).add("processing", true).send();
 }
 
 SmartCmd cmd_ok("OK", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
@@ -93,82 +110,59 @@ SmartCmd cmd_bme("bme", [](Stream *stream, const SmartCmdArguments *args, const
     // bme <literal_union[h, t, p]:data_to_retrieve>
     // example: bme ht -> returns humidity and temperature
 
+    // begin_peripherals would block the serial until an async command is done
+    PeripheralsLock lock;
+    if (!lock.locked())
+    {
+        cmd_error(stream, cmd, PERIPHERALS_BUSY_MSG);
+        return;
+    }
     float hum, temp, pres;
     begin_peripherals();
-    bool res = BME_HELPER::read(&bme, &hum, &temp, &pres);
-    const uint8_t err_msg_len = 29;
-    const uint8_t min_size_for_new_entry = 9; // 11;
-    const uint8_t buf_size = 3*min_size_for_new_entry + 3;
-    static_assert(buf_size >= err_msg_len);
-    // char buf[buf_size+1] = "{";
-    char buf[buf_size+1] = {0};
-
-    char *buf_last = buf+1;
-    const char default_buf[] = "htp";
-    const char *arg;
-
-    if (!res)
+    if (!BME_HELPER::read(&bme, &hum, &temp, &pres))
     {
-        strncpy(buf, "Error reading bme", buf_size);
-        goto error;
+        cmd_error(stream, cmd, "Error reading bme");
+        return;
     }
 
-    if (args->N == 0)
-        arg = default_buf;
-    else
+    const char *arg = "htp";
+    if (args->N > 0 && !args->to(0, &arg))
+    {
+        cmd_error(stream, cmd, "Error getting arg 0");
+        return;
+    }
+    // checked before the reply is started, so an error isn't sent in the middle of it
+    for (const char *c = arg; *c; c++)
     {
-        buf[0] = '{';
-        if (!args->to(0, arg))
+        if (*c != 'h' && *c != 't' && *c != 'p')
         {
-            strncpy(buf, "Error getting arg 0", buf_size);
-            goto error;
+            char msg[32];
+            snprintf(msg, sizeof(msg), "Invalid char in arg 0 '%c'", *c);
+            cmd_error(stream, cmd, msg);
+            return;
         }
     }
 
-    for (;;)
+    JsonReply reply(stream, cmd);
+    for (; *arg; arg++)
     {
-        switch (*(arg++))
-        {
-        case 'h':
-            buf_last += snprintf(buf_last, buf_size-(buf-buf_last), "\"h\":%3.3f", fmod(hum,1000));
-            break;
-        case 't':
-            buf_last += snprintf(buf_last, buf_size-(buf-buf_last), "\"t\":%3.3f", fmod(temp,1000));
-            break;
-        case 'p':
-            buf_last += snprintf(buf_last, buf_size-(buf-buf_last), "\"p\":%4.2f", fmod(pres,10000));
-            break;
-        default:
-            snprintf(buf, buf_size, "Invalid char in arg 0 '%c'", *(arg-1));
-            goto error;
-        }
-        
-        if (buf_last - buf >= buf_size || *arg == '\0')
-        {
-            // *(buf_last) = '}';
-            break;
-        }
-        else if (buf_last - buf < buf_size-min_size_for_new_entry)
+        switch (*arg)
         {
-            *(buf_last++) = ',';
-        }
-        else
-        {
-            snprintf(buf, buf_size, "Error. Not enough space (%i)", (buf_last - buf < 1000 ? buf_last - buf : -1));
-            goto error;
+        case 'h': reply.add("h", fmod(hum, 1000), 3); break;
+        case 't': reply.add("t", fmod(temp, 1000), 3); break;
+        case 'p': reply.add("p", fmod(pres, 10000), 2); break;
         }
     }
-    // stream->println(buf);
-    cmd_success_va_args(stream, cmd, "%s", buf);
-    return;
-
-    // error
-    error:
-    cmd_error(stream, cmd, buf);
+    reply.send();
 });
 
-void hx_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd, bool(HX711_Mult::*hx_read)(uint8_t, uint32_t, float*, float*, uint32_t*, uint32_t), bool raw) {
-    // hx | hx_raw <uint8_t:slot> <uint32_t:n_stat> <uint32_t:timeout_ms>
+void hx_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd,
+    bool(HX711_Mult::*hx_read)(uint8_t, uint32_t, float*, float*, uint32_t*, uint32_t),
+    bool(HX711_Mult::*hx_read_adaptive)(uint8_t, uint32_t, float, uint32_t, float*, float*, float*, uint32_t*, uint32_t),
+    bool raw) {
+    // hx | hx_raw <uint8_t:slot> <uint32_t:n_stat> <uint32_t:timeout_ms> <float:target_se> <uint32_t:deadline_ms>
+    // if target_se is given, n_stat is the maximum number of samples and sampling stops as soon as the standard error
+    // of the mean reaches target_se, or deadline_ms passes
 
     if (args->N < 2)
     {
@@ -176,7 +170,8 @@ void hx_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd, bool(
         return;
     }
 
-    uint32_t timeout_ms = HX711_DEFAULT_TIMEOUT_MS;
+    // the timeout bounds the whole read. by default it's sized for n_stat samples
+    uint32_t timeout_ms = 0;
     if (args->N >= 3)
     {
         if (!args->to(2, &timeout_ms))
@@ -186,6 +181,25 @@ void hx_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd, bool(
         }
     }
 
+    float target_se = 0;
+    uint32_t deadline_ms = 0;
+    if (args->N >= 4)
+    {
+        if (!args->to(3, &target_se) || target_se <= 0)
+        {
+            cmd_error(stream, cmd, "Couldn't read target_se (arg 3) or it wasn't positive");
+            return;
+        }
+    }
+    if (args->N >= 5)
+    {
+        if (!args->to(4, &deadline_ms))
+        {
+            cmd_error(stream, cmd, "Couldn't read deadline_ms (arg 4)");
+            return;
+        }
+    }
+
     uint8_t slot;
     uint16_t n_stat;
     if (!args->to(0, &slot) || !args->to(1, &n_stat))
@@ -193,42 +207,176 @@ void hx_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd, bool(
         cmd_error(stream, cmd, "Not all arguments were ints");
         return;
     }
-
-    cmd_received(stream, cmd);
+    if (args->N < 3)
+        timeout_ms = hx711_stats_timeout_ms(n_stat);
 
     float mean;
     float stdev;
+    float se;
     uint32_t resulting_n;
     begin_peripherals();
-    bool res = ((hx).*(hx_read))(slot, n_stat, &mean, &stdev, &resulting_n, timeout_ms);
+    bool res;
+    if (target_se > 0)
+        res = ((hx).*(hx_read_adaptive))(slot, n_stat, target_se, deadline_ms, &mean, &stdev, &se, &resulting_n, timeout_ms);
+    else
+    {
+        res = ((hx).*(hx_read))(slot, n_stat, &mean, &stdev, &resulting_n, timeout_ms);
+        se = stdev / sqrt(resulting_n);
+    }
 
     if (!res)
     {
-        const uint8_t buf_len = 33;
-        char buf[buf_len] = "Error reading hx raw in slot ";
-        snprintf(buf, buf_len-1, "%u", slot%1000);
-        cmd_error(stream, cmd, buf);
+        char msg[40];
+        snprintf(msg, sizeof(msg), "Error reading %s in slot %u", raw ? "hx raw" : "hx", slot);
+        cmd_error(stream, cmd, msg);
+        return;
     }
 
-    // stream->printf("{\"mean\":%.4f,\"stdev\":%.4f,\"n\":%ul,\"slot\":%u,\"raw\":%s}\n", mean, stdev, resulting_n, slot, raw ? "true" : "false");
-    cmd_success_va_args(stream, cmd, "\"mean\":%.4f,\"stdev\":%.4f,\"n\":%ul,\"slot\":%u,\"raw\":%s", mean, stdev, resulting_n, slot, raw ? "true" : "false");
+    JsonReply(stream, cmd)
+        .add("mean", mean).add("stdev", stdev).add("se", se).add("n", resulting_n).add("rejected", hx.rejected())
+        .add("slot", slot).add("raw", raw)
+        .send();
 }
 SmartCmd cmd_hx("hx", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
-    hx_cb(stream, args, cmd, &HX711_Mult::read_calib_stats, false);
+    async_cmds.submit(stream, args, cmd, [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
+        hx_cb(stream, args, cmd, &HX711_Mult::read_calib_stats, &HX711_Mult::read_calib_stats_adaptive, false);
+    });
 });
 SmartCmd cmd_hx_raw("hx_raw", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
-    hx_cb(stream, args, cmd, &HX711_Mult::read_raw_stats, true);
+    async_cmds.submit(stream, args, cmd, [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
+        hx_cb(stream, args, cmd, &HX711_Mult::read_raw_stats, &HX711_Mult::read_raw_stats_adaptive, true);
+    });
+});
+
+// hx_stream frame: sync byte, sequence number (u16), time since the previous sample in 10us units (u16, saturates) and
+// the raw sample (24 bit two's complement). everything little endian
+#define HX_STREAM_SYNC 0xA5
+#define HX_STREAM_FRAME_LEN 8
+#define HX_STREAM_TIMEOUT_MS 1000
+
+// defined with sc, below
+bool serial_binary();
+
+SmartCmd cmd_hx_stream("hx_stream", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
+    // hx_stream <uint8_t:slot> <uint32_t:count | literal "forever">
+    // streams every raw sample of a slot in binary frames (see HX_STREAM_SYNC) until count samples were taken or any
+    // byte is received. frames that don't fit in the serial buffer are dropped (and counted) instead of slowing the
+    // sampling down, the gap shows in the sequence numbers. a json line with the counters closes the stream
+
+    // the frames are raw bytes for the serial itself. in binary mode they would go through the line frames, which
+    // split them at every 0x0A and can't tell how much room the serial has
+    if (serial_binary())
+    {
+        cmd_error(stream, cmd, "Not available in binary mode");
+        return;
+    }
+
+    if (args->N < 2)
+    {
+        cmd_error(stream, cmd, "Not enough arguments");
+        return;
+    }
+
+    uint8_t slot;
+    if (!args->to(0, &slot) || slot >= N_MULTIPLEXERS)
+    {
+        cmd_error(stream, cmd, "Couldn't read slot (arg 0) or it was out of range");
+        return;
+    }
+
+    uint32_t count = 0; // 0 is forever
+    if (!args->to(1, &count))
+    {
+        const char *s = args->arg(1);
+        if (!s || strcmp(s, "forever") != 0)
+        {
+            cmd_error(stream, cmd, "Second argument should be a count or 'forever'");
+            return;
+        }
+    }
+    else if (count == 0)
+    {
+        cmd_error(stream, cmd, "Count should be positive");
+        return;
+    }
+
+    PeripheralsLock lock;
+    if (!lock.locked())
+    {
+        cmd_error(stream, cmd, PERIPHERALS_BUSY_MSG);
+        return;
+    }
+    begin_peripherals();
+    cmd_received(stream, cmd);
+
+    // drop whatever was sent before the stream started, so only new input stops it
+    while (stream->available()) stream->read();
+
+    uint8_t frame[HX_STREAM_FRAME_LEN];
+    frame[0] = HX_STREAM_SYNC;
+    uint16_t seq = 0;
+    uint32_t n = 0, dropped = 0;
+    bool timed_out = false;
+    int32_t raw;
+    uint32_t last_us = time_us_32();
+    while (count == 0 || n < count)
+    {
+        if (stream->available())
+        {
+            while (stream->available()) stream->read();
+            break;
+        }
+
+        if (!hx.read_raw_single(slot, &raw, HX_STREAM_TIMEOUT_MS))
+        {
+            timed_out = true;
+            break;
+        }
+        const uint32_t now_us = time_us_32();
+        const uint32_t dt = (now_us - last_us) / 10;
+        last_us = now_us;
+        ++n;
+
+        frame[1] = seq & 0xFF;
+        frame[2] = seq >> 8;
+        frame[3] = dt > 0xFFFF ? 0xFF : dt & 0xFF;
+        frame[4] = dt > 0xFFFF ? 0xFF : (dt >> 8) & 0xFF;
+        frame[5] = raw & 0xFF;
+        frame[6] = (raw >> 8) & 0xFF;
+        frame[7] = (raw >> 16) & 0xFF;
+        ++seq;
+
+        if (stream->availableForWrite() < HX_STREAM_FRAME_LEN)
+        {
+            ++dropped;
+            continue;
+        }
+        stream->write(frame, HX_STREAM_FRAME_LEN);
+    }
+    stream->flush();
+    stream->println();
+
+    if (timed_out)
+    {
+        char msg[32];
+        snprintf(msg, sizeof(msg), "Timeout reading slot %u", slot);
+        JsonReply(stream, cmd, JsonReply::Kind::ERR).add("msg", msg).add("n", n).add("dropped", dropped).send();
+        return;
+    }
+    JsonReply(stream, cmd).add("slot", slot).add("n", n).add("dropped", dropped).send();
 });
 
 SmartCmd cmd_rundata("rundata", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
-    // first argument is the literal "set", "save"
+    // first argument is the literal "set", "payload", "save"
     // second argument is the json str to set (if first is "set")
+    // or the length in bytes of the json that follows the line (if first is "payload"). it isn't limited by the line
+    // buffer and can have spaces
 
     const char def_sub_cmd[] = "get";
     const char *sub_cmd = def_sub_cmd;
     if (args->N > 0)
     {
-        if (!args->to(0, sub_cmd))
+        if (!args->to(0, &sub_cmd))
         {
             cmd_error(stream, cmd, "Couldn't cast first argument to const char * (sub_cmd)");
             return;
@@ -245,27 +393,51 @@ SmartCmd cmd_rundata("rundata", [](Stream *stream, const SmartCmdArguments *args
         else if (strcmp(sub_cmd, "set") == 0)
         {
             const char *json;
-            if (!args->to(1, json))
+            if (!args->to(1, &json))
             {
                 cmd_error(stream, cmd, "Couldn't cast first argument to const char * (json), or not enough arguments");
                 return;
             }
             if (!run_data.set_data(json))
             {
-                cmd_error_va_args(stream, cmd, "\"msg\":\"Couldn't set run_data\",\"json\":\"%s\"", json);
+                JsonReply(stream, cmd, JsonReply::Kind::ERR).add("msg", "Couldn't set run_data").add("json", json).send();
                 // stream->printf("{\"err\":true,\"cmd\":\"rundata\",\"msg\":\"Couldn't set run_data with json '%s'\"}\n", json);
                 return;
             }
         }
+        else if (strcmp(sub_cmd, "payload") == 0)
+        {
+            uint32_t len;
+            if (!args->to(1, &len))
+            {
+                cmd_error(stream, cmd, "Couldn't cast second argument to uint32_t (len)");
+                return;
+            }
+            SmartPayloadStream payload(stream, len);
+            const bool res = run_data.set_data(&payload);
+            // whatever the parser didn't read is still payload, not commands
+            if (!payload.skip())
+            {
+                cmd_error(stream, cmd, "Timeout while receiving the payload");
+                return;
+            }
+            if (!res)
+            {
+                cmd_error(stream, cmd, "Couldn't set run_data from the payload");
+                return;
+            }
+        }
         else
         {
-            cmd_error_va_args(stream, cmd, "\"msg\":\"Unknown subcommand '%s'\"", sub_cmd);
+            char msg[SMART_CMD_MAX_LEN+24];
+            snprintf(msg, sizeof(msg), "Unknown subcommand '%s'", sub_cmd);
+            cmd_error(stream, cmd, msg);
             // stream->printf("{\"err\":true,\"cmd\":\"rundata\",\"msg\":\"Unknown subcommand '%s'\"}\n", sub_cmd);
             return;
         }
     }
 
-    JsonDocument doc;
+    JsonDocument doc(&json_pool);
     JsonObject obj = doc.to<JsonObject>();
     if (!run_data.get_data(&obj))
     {
@@ -296,7 +468,7 @@ SmartCmd cmd_run("run", [](Stream *stream, const SmartCmdArguments *args, const
         {
             // stop
             run_stomasense_loop = false;
-            cmd_success_va_args(stream, cmd, "\"stopped\":true,\"state\":%s", run_stomasense_loop ? "true" : "false");
+            JsonReply(stream, cmd).add("stopped", true).add("state", run_stomasense_loop).send();
             // stream->printf("{\"cmd\":\"run\",\"stopped\":true,\"state\":%s}\n", run_stomasense_loop ? "true" : "false");
             return;
         }
@@ -308,16 +480,31 @@ SmartCmd cmd_run("run", [](Stream *stream, const SmartCmdArguments *args, const
                 cmd_error(stream, cmd, "mainloop setup failed");
                 return;
             }
+            PeripheralsLock lock;
+            if (!lock.locked())
+            {
+                cmd_error(stream, cmd, PERIPHERALS_BUSY_MSG);
+                return;
+            }
             begin_peripherals();
+
+            // find unplugged scales now instead of timing out on them in the loop
+            hx.probe(run_data.get_scales_in_use());
             run_stomasense_loop = true;
-            cmd_success_va_args(stream, cmd, "\"state\":%s", run_stomasense_loop ? "true" : "false");
+
+            JsonReply reply(stream, cmd);
+            reply.add("state", run_stomasense_loop).begin_array("dead");
+            const HX711SlotHealth *health = hx.get_health();
+            for (uint8_t slot = 0; slot < N_MULTIPLEXERS; slot++)
+                if (health[slot].dead) reply.item(slot);
+            reply.end_array().send();
             return;
         }
     }
     else
     {
         const char *s;
-        if (!args->to(0, s))
+        if (!args->to(0, &s))
         {
             cmd_error(stream, cmd, "Couldn't cast first argument to boolean or const char *");
             return;
@@ -326,13 +513,15 @@ SmartCmd cmd_run("run", [](Stream *stream, const SmartCmdArguments *args, const
         if (strcmp(s, "state") == 0)
         {
             // get state
-            cmd_success_va_args(stream, cmd, "\"state\":%s", run_stomasense_loop ? "true" : "false");
+            JsonReply(stream, cmd).add("state", run_stomasense_loop).send();
             // stream->printf("{\"cmd\":\"run\",\"state\":%s}\n", run_stomasense_loop ? "true" : "false");
             return;
         }
         else
         {
-            cmd_error_va_args(stream, cmd, "\"msg\":\"unknown sub_cmd '%s'\"", s);
+            char msg[SMART_CMD_MAX_LEN+16];
+            snprintf(msg, sizeof(msg), "unknown sub_cmd '%s'", s);
+            cmd_error(stream, cmd, msg);
             // stream->printf("{\"err\":true,\"cmd\":\"run\",\"msg\":\"unknown sub_cmd '%s'\"}\n", s);
             return;
         }
@@ -341,12 +530,44 @@ SmartCmd cmd_run("run", [](Stream *stream, const SmartCmdArguments *args, const
     cmd_error(stream, cmd, "This shouldn't be reachable");
 });
 
-SmartCmd cmd_calib("hx_calib", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
-    // first argument should be one of the literals "offset", "slope", "save", "get", "set"
+// "calibs":[..] with the populated calibrations. written field by field like HX711Calibration::to_json, offset and
+// slope run on core1 and the json pool belongs to core0
+void reply_calibs(JsonReply *reply, const HX711Calibration *calibs, size_t n)
+{
+    reply->begin_array("calibs");
+    for (size_t i = 0; i < n; i++)
+    {
+        const HX711Calibration &calib = calibs[i];
+        if (!calib.populated()) continue;
+        reply->begin_object();
+        if (calib.set_offset)
+        {
+            reply->add(HX711_CALIBRATION_JSON_KEY_SLOT, calib.slot)
+                .add(HX711_CALIBRATION_JSON_KEY_OFFSET, calib.offset)
+                .add(HX711_CALIBRATION_JSON_KEY_OFFSET_ERROR, calib.offset_e);
+            if (calib.set_slope)
+                reply->add(HX711_CALIBRATION_JSON_KEY_SLOPE, calib.slope)
+                    .add(HX711_CALIBRATION_JSON_KEY_SLOPE_ERROR, calib.slope_e);
+        }
+        else
+        {
+            WARN_PRINTFLN("Couldn't retrieve the json from calibration from slot %u", i);
+        }
+        reply->end_object();
+    }
+    reply->end_array();
+}
+
+void calib_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd)
+{
+    // first argument should be one of the literals "offset", "slope", "save", "get", "set", "payload"
     //
     // if first argument is "set":
     //  second argument should be a json string containing the calibration
     //
+    // if first argument is "payload":
+    //  second argument is the length in bytes of the calibration json, which follows the line
+    //
     // if first argument is "offset", "slope":
     //  second argument is a uin8_t indicating slot to calibrate
     //  third argument is a uint32_t indicating the number of samples to take for the calibration (n)
@@ -364,7 +585,7 @@ SmartCmd cmd_calib("hx_calib", [](Stream *stream, const SmartCmdArguments *args,
     begin_peripherals();
 
     const char *calib_stage;
-    if (!args->to(0, calib_stage))
+    if (!args->to(0, &calib_stage))
     {
         cmd_error(stream, cmd, "Couldn't cast first argument to const char * (calib_stage)");
         return;
@@ -391,19 +612,42 @@ SmartCmd cmd_calib("hx_calib", [](Stream *stream, const SmartCmdArguments *args,
             return;
         }
         const char *json;
-        if (!args->to(1, json))
+        if (!args->to(1, &json))
         {
             cmd_error(stream, cmd, "Couldn't cast second argument to const char * while setting (json)");
             return;
         }
         if (!hx.load_calibration(json))
         {
-            cmd_error_va_args(stream, cmd, "\"msg\":\"Couldn't load calibration\",\"json\":\"%s\"", json);
+            JsonReply(stream, cmd, JsonReply::Kind::ERR).add("msg", "Couldn't load calibration").add("json", json).send();
             // stream->printf("{\"err\":true,\"cmd\":\"hx_calib\",\"msg\":\"Couldn't load calibration\",\"json\":\"%s\"}\n", json);
             return;
         }
         goto end;
     }
+    else if (strcmp(calib_stage, "payload") == 0)
+    {
+        uint32_t len;
+        if (!args->to(1, &len))
+        {
+            cmd_error(stream, cmd, "Couldn't cast second argument to uint32_t (len)");
+            return;
+        }
+        SmartPayloadStream payload(stream, len);
+        const bool res = hx.load_calibration(&payload);
+        // whatever the parser didn't read is still payload, not commands
+        if (!payload.skip())
+        {
+            cmd_error(stream, cmd, "Timeout while receiving the payload");
+            return;
+        }
+        if (!res)
+        {
+            cmd_error(stream, cmd, "Couldn't load calibration from the payload");
+            return;
+        }
+        goto end;
+    }
 
     if (args->N < 3)
     {
@@ -419,7 +663,9 @@ SmartCmd cmd_calib("hx_calib", [](Stream *stream, const SmartCmdArguments *args,
     }
     if (slot >= N_MULTIPLEXERS)
     {
-        cmd_error_va_args(stream, cmd, "\"msg\":\"Slot can't be %u when there are %u slots\"", slot, N_MULTIPLEXERS);
+        char msg[48];
+        snprintf(msg, sizeof(msg), "Slot can't be %u when there are %u slots", slot, N_MULTIPLEXERS);
+        cmd_error(stream, cmd, msg);
         // stream->printf("{\"err\":true,\"cmd\":\"hx_calib\",\"msg\":\"Slot can't be %u when there are %u slots\"}\n", slot, N_MULTIPLEXERS);
         return;
     }
@@ -435,8 +681,7 @@ SmartCmd cmd_calib("hx_calib", [](Stream *stream, const SmartCmdArguments *args,
     if (strcmp(calib_stage, "offset") == 0)
     {
         // bool calib_offset(uint8_t slot, uint32_t n, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
-        cmd_received(stream, cmd);
-        if (!hx.calib_offset(slot, n, &resulting_n))
+        if (!hx.calib_offset(slot, n, &resulting_n, hx711_stats_timeout_ms(n)))
         {
             cmd_error(stream, cmd, "Error while calibrating offset");
             return;
@@ -457,8 +702,7 @@ SmartCmd cmd_calib("hx_calib", [](Stream *stream, const SmartCmdArguments *args,
             cmd_error(stream, cmd, "Couldn't cast fifth argument to float (weight_error)");
             return;
         }
-        cmd_received(stream, cmd);
-        if (!hx.calib_slope(slot, n, weight, weight_error, &resulting_n))
+        if (!hx.calib_slope(slot, n, weight, weight_error, &resulting_n, hx711_stats_timeout_ms(n)))
         {
             cmd_error(stream, cmd, "Error while calibrating slope");
             return;
@@ -466,29 +710,144 @@ SmartCmd cmd_calib("hx_calib", [](Stream *stream, const SmartCmdArguments *args,
     }
     else
     {
-        cmd_error(stream, cmd, "Bad first argument. Should have been 'offset', 'slope', 'save' or 'get'");
+        cmd_error(stream, cmd, "Bad first argument. Should have been 'offset', 'slope', 'save', 'get', 'set' or 'payload'");
         return;
     }
 
     end:
 
-    JsonDocument doc;
-    JsonObject obj = doc.to<JsonObject>();
+    JsonReply reply(stream, cmd);
+    reply_calibs(&reply, hx.get_calibs(), N_MULTIPLEXERS);
+    reply.add("sub_cmd", calib_stage).send();
+}
+SmartCmd cmd_calib("hx_calib", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
+    // offset and slope sample for seconds, they run on core1. the rest is quick, but still needs the scales
+    const char *calib_stage;
+    if (args->to(0, &calib_stage) && (strcmp(calib_stage, "offset") == 0 || strcmp(calib_stage, "slope") == 0))
+    {
+        async_cmds.submit(stream, args, cmd, calib_cb);
+        return;
+    }
+
+    PeripheralsLock lock;
+    if (!lock.locked())
+    {
+        cmd_error(stream, cmd, PERIPHERALS_BUSY_MSG);
+        return;
+    }
+    calib_cb(stream, args, cmd);
+});
+
+#ifdef HX711_ARRAY_DOUT_PINS
+void hx_array_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd)
+{
+    // hx_array read <uint32_t:n> <bool:raw>
+    //        | offset <uint8_t:channel> <uint32_t:n>
+    //        | slope <uint8_t:channel> <uint32_t:n> <float:weight> <float:weight_error>
+    //        | save | load
+    // read takes n frames of every channel at once and answers the stats per channel, calibrated unless raw is true.
+    // offset and slope calibrate one channel, like hx_calib. the calibrations go in their own file
+    const char *sub_cmd;
+    if (!args->to(0, &sub_cmd))
+    {
+        cmd_error(stream, cmd, "Couldn't cast first argument to const char * (sub_cmd)");
+        return;
+    }
+    begin_peripherals();
 
-    JsonArray calibs = obj["calibs"].to<JsonArray>();
-    const HX711Calibration *calib_ptr = hx.get_calibs();
-    for (size_t i = 0; i < N_MULTIPLEXERS; i++)
+    if (strcmp(sub_cmd, "read") == 0)
     {
-        if (!calib_ptr[i].populated()) continue;
-        JsonObject calib_obj = calibs.add<JsonObject>();
-        if (!calib_ptr[i].to_json(&calib_obj))
+        uint32_t n;
+        bool raw = false;
+        if (!args->to(1, &n) || (args->N > 2 && !args->to(2, &raw)))
         {
-            WARN_PRINTFLN("Couldn't retrieve the json from calibration from slot %u", i);
+            cmd_error(stream, cmd, "Couldn't read n (arg 1) or raw (arg 2)");
+            return;
         }
+        float mean[HX711_ARRAY_MAX_CHANNELS], stdev[HX711_ARRAY_MAX_CHANNELS];
+        uint32_t resulting_n[HX711_ARRAY_MAX_CHANNELS];
+        const uint32_t timeout_ms = hx711_stats_timeout_ms(n);
+        const bool res = raw ? hx_array.read_raw_stats(n, mean, stdev, resulting_n, timeout_ms)
+            : hx_array.read_calib_stats(n, mean, stdev, resulting_n, timeout_ms);
+        if (!res)
+        {
+            cmd_error(stream, cmd, "Error reading the hx711 array");
+            return;
+        }
+
+        JsonReply reply(stream, cmd);
+        reply.add("raw", raw).begin_array("mean");
+        for (uint8_t ch = 0; ch < hx_array.channels(); ch++) reply.item(mean[ch]);
+        reply.end_array().begin_array("stdev");
+        for (uint8_t ch = 0; ch < hx_array.channels(); ch++) reply.item(stdev[ch]);
+        reply.end_array().begin_array("n");
+        for (uint8_t ch = 0; ch < hx_array.channels(); ch++) reply.item(resulting_n[ch]);
+        reply.end_array().send();
+        return;
     }
-    obj["sub_cmd"] = calib_stage;
-    cmd_success(stream, cmd, &doc);
+    else if (strcmp(sub_cmd, "offset") == 0 || strcmp(sub_cmd, "slope") == 0)
+    {
+        uint8_t channel;
+        uint32_t n, resulting_n;
+        if (!args->to(1, &channel) || !args->to(2, &n))
+        {
+            cmd_error(stream, cmd, "Couldn't read channel (arg 1) or n (arg 2)");
+            return;
+        }
+        if (sub_cmd[0] == 'o')
+        {
+            if (!hx_array.calib_offset(channel, n, &resulting_n, hx711_stats_timeout_ms(n)))
+            {
+                cmd_error(stream, cmd, "Error while calibrating offset");
+                return;
+            }
+        }
+        else
+        {
+            float weight, weight_error;
+            if (!args->to(3, &weight) || !args->to(4, &weight_error))
+            {
+                cmd_error(stream, cmd, "Couldn't read weight (arg 3) or weight_error (arg 4)");
+                return;
+            }
+            if (!hx_array.calib_slope(channel, n, weight, weight_error, &resulting_n, hx711_stats_timeout_ms(n)))
+            {
+                cmd_error(stream, cmd, "Error while calibrating slope");
+                return;
+            }
+        }
+    }
+    else if (strcmp(sub_cmd, "save") == 0)
+    {
+        if (!hx_array.save_calibration())
+        {
+            cmd_error(stream, cmd, "Couldn't save calibration");
+            return;
+        }
+    }
+    else if (strcmp(sub_cmd, "load") == 0)
+    {
+        if (!hx_array.load_calibration())
+        {
+            cmd_error(stream, cmd, "Couldn't load calibration");
+            return;
+        }
+    }
+    else
+    {
+        cmd_error(stream, cmd, "Bad first argument. Should have been 'read', 'offset', 'slope', 'save' or 'load'");
+        return;
+    }
+
+    JsonReply reply(stream, cmd);
+    reply_calibs(&reply, hx_array.get_calibs(), hx_array.channels());
+    reply.add("sub_cmd", sub_cmd).send();
+}
+SmartCmd cmd_hx_array("hx_array", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
+    // every subcommand samples or uses the sd card, they run on core1
+    async_cmds.submit(stream, args, cmd, hx_array_cb);
 });
+#endif
 
 SmartCmd cmd_rtc("rtc", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
     // if first argument present, it is used to set the rtc. Should have format yyyy-mm-dd_HH-MM-SS
@@ -496,25 +855,26 @@ SmartCmd cmd_rtc("rtc", [](Stream *stream, const SmartCmdArguments *args, const
     const char *rtc_str;
     if (args->N > 0)
     {
-        if (!args->to(0, rtc_str))
+        if (!args->to(0, &rtc_str))
         {
             cmd_error(stream, cmd, "Couldn't cast first argument to const char * (rtc_str)");
             return;
         }
         if (!RTC::set_datetime(rtc_str))
         {
-            cmd_error_va_args(stream, cmd, "\"msg\":\"Coudln't set datetime for rtc with rtc_str '%s'\"", rtc_str);
+            JsonReply(stream, cmd, JsonReply::Kind::ERR).add("msg", "Coudln't set datetime for rtc").add("rtc_str", rtc_str).send();
             // stream->printf("{\"err\":true,\"cmd\":\"rtc\",\"msg\":\"Coudln't set datetime for rtc with rtc_str '%s'\"}\n", rtc_str);
             return;
         }
     }
 
     rtc_str = RTC::get_timestamp();
-    cmd_success_va_args(stream, cmd, "\"rtc\",\"rtc_init\":%s,\"rtc_str\":\"%s\"", rtc_str ? "true" : "false", rtc_str);
+    JsonReply(stream, cmd).add("rtc_init", rtc_str != NULL).add("rtc_str", rtc_str).send();
     // stream->printf("{\"success\":true,\"cmd\":\"rtc\",\"rtc_init\":%s,\"rtc_str\":\"%s\"}\n", rtc_str ? "true" : "false", rtc_str);
 });
 
-SmartCmd cmd_pos("pos", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
+void pos_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd)
+{
     // without arguments, it gets the current stepper pos and servo angle
     // with arguments, the first is the stepper position (optional), and the second is the servo angle (optional)
 
@@ -544,13 +904,14 @@ SmartCmd cmd_pos("pos", [](Stream *stream, const SmartCmdArguments *args, const
     }
 
     begin_peripherals();
-    cmd_received(stream, cmd);
 
     if (servo_angle_arg)
     {
         if (!servo.set_angle_slow_blocking(servo_angle))
         {
-            cmd_error_va_args(stream, cmd, "\"msg\":\"Couldn't set servo to angle %u\"", servo_angle);
+            char msg[40];
+            snprintf(msg, sizeof(msg), "Couldn't set servo to angle %u", servo_angle);
+            cmd_error(stream, cmd, msg);
             // stream->printf("{\"err\":true,\"cmd\":\"pos\",\"msg\":\"Couldn't set servo to angle %u\"}\n", servo_angle);
             return;
         }
@@ -566,8 +927,12 @@ SmartCmd cmd_pos("pos", [](Stream *stream, const SmartCmdArguments *args, const
         stepper.move_to_pos_blocking(stepper_pos, true);
     }
 
-    cmd_success_va_args(stream, cmd, "\"pos\",\"stepper\":%li,\"servo\":%u", stepper.get_curr_pos(), servo.get_curr_angle());
+    JsonReply(stream, cmd).add("stepper", stepper.get_curr_pos()).add("servo", servo.get_curr_angle()).send();
     // stream->printf("{\"success\":true,\"cmd\":\"pos\",\"stepper\":%li,\"servo\":%u}\n", stepper.get_curr_pos(), servo.get_curr_angle());
+}
+SmartCmd cmd_pos("pos", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
+    // moving takes seconds, it runs on core1
+    async_cmds.submit(stream, args, cmd, pos_cb);
 });
 
 SmartCmd cmd_stp_force("stp_force", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
@@ -587,16 +952,29 @@ SmartCmd cmd_stp_force("stp_force", [](Stream *stream, const SmartCmdArguments *
         cmd_error(stream, cmd, "Couldn't cast first arg to int32_t (new_pos)");
         return;
     }
+    PeripheralsLock lock;
+    if (!lock.locked())
+    {
+        cmd_error(stream, cmd, PERIPHERALS_BUSY_MSG);
+        return;
+    }
     // set_curr_pos_forced
     stepper.set_curr_pos_forced(new_pos);
 
-    cmd_success_va_args(stream, cmd, "\"stepper\":%li", new_pos);
+    JsonReply(stream, cmd).add("stepper", new_pos).send();
 });
 
 SmartCmd cmd_stp_flag("std_flag", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
     // this command should be used to either read if the moving flag was left set, and eventually reset it
     // to reset, state first argument as boolean true
 
+    // pos may be moving the stepper on core1, and saving its state
+    PeripheralsLock lock;
+    if (!lock.locked())
+    {
+        cmd_error(stream, cmd, PERIPHERALS_BUSY_MSG);
+        return;
+    }
     bool save_ok = stepper.is_save_state_ok();
     bool reset_arg = false;
     bool reset;
@@ -613,29 +991,103 @@ SmartCmd cmd_stp_flag("std_flag", [](Stream *stream, const SmartCmdArguments *ar
             stepper.reset_save_state();
     }
 
-    cmd_success_va_args(stream, cmd, "\"state_ok\":%s,\"state_reset\":",
-        save_ok ? "true" : "false",
-        reset_arg ? (reset ? "true" : "false") : "false"
-    );
+    JsonReply(stream, cmd).add("state_ok", save_ok).add("state_reset", reset_arg && reset).send();
 });
 
+SmartCmd cmd_mem("mem", [](Stream *stream, const SmartCmdArguments *args, const char *cmd) {
+    // reports how much of the json pool the commands used at most, and how often they had to go to the heap anyway
+    JsonReply(stream, cmd)
+        .add("json_small_hw", json_pool.small_high_water())
+        .add("json_large_hw", json_pool.large_high_water())
+        .add("json_in_use", json_pool.in_use())
+        .add("json_heap", json_pool.heap_fallbacks())
+        .add("free_heap", rp2040.getFreeHeap())
+        .send();
+});
+
+// needs the commands array and sc, defined below
+void bin_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd);
+SmartCmd cmd_bin("bin", bin_cb);
+
 const SmartCmdBase *cmds[] = {
-    &cmd_ok, &cmd_bme, &cmd_hx, &cmd_hx_raw, &cmd_run, &cmd_rundata, &cmd_calib, &cmd_rtc, &cmd_pos, &cmd_stp_force, &cmd_stp_flag
+    &cmd_ok, &cmd_bme, &cmd_hx, &cmd_hx_raw, &cmd_hx_stream, &cmd_run, &cmd_rundata, &cmd_calib, &cmd_rtc, &cmd_pos, &cmd_stp_force, &cmd_stp_flag, &cmd_mem,
+#ifdef HX711_ARRAY_DOUT_PINS
+    &cmd_hx_array,
+#endif
+    &cmd_bin
 };
 
 SmartComm<ARRAY_LENGTH(cmds)> sc(cmds, Serial);
 
+bool serial_binary() { return sc.binary(); }
+
+void bin_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd)
+{
+    // switches the serial to binary frames (see SmartComm.h). the reply is still text, and lists the commands in the
+    // order of their ids
+    JsonReply reply(stream, cmd);
+    reply.begin_array("cmds");
+    for (const SmartCmdBase *c : cmds)
+        reply.item(c->command());
+    reply.end_array().send();
+    sc.setBinary(true);
+}
+
+// in binary mode the json reply lines are sent as MessagePack
+size_t json_line_to_msgpack(const char *line, size_t len, uint8_t *out, size_t out_len)
+{
+    JsonDocument doc(&json_pool);
+    if (deserializeJson(doc, line, len)) return 0;
+    if (measureMsgPack(doc) > out_len) return 0;
+    return serializeMsgPack(doc, out, out_len);
+}
+
 void setup() {
     Serial.begin(115200);
+    sc.setBinaryEncoder(json_line_to_msgpack);
+    async_cmds.set_frame_stream(sc.frameStream());
     Serial.println("StomaSense v1.0.0");
 }
 
 
+#define LOOP_PERIOD_MS 250
+// the synchronous commands and the main loop write to the serial too, they wait while an async line is half sent
 void loop() {
-    sc.tick();
-    if (run_stomasense_loop)
-        stomasense_loop();
-    delay(250);
+    if (!async_cmds.mid_line()) sc.tick();
+    async_cmds.forward();
+    bool round_done = true;
+    if (run_stomasense_loop && !async_cmds.mid_line())
+    {
+        // one slot per call, the lock is released in between. while an async command uses the scales the slot is
+        // tried again after LOOP_PERIOD_MS
+        PeripheralsLock lock;
+        if (lock.locked())
+            round_done = stomasense_loop();
+    }
+    // the next slot of the round comes right after the serial had its turn
+    if (!round_done) return;
+
+    // keep answering commands and forwarding the async replies until the next round
+    const uint32_t start_ms = millis();
+    while (millis() - start_ms < LOOP_PERIOD_MS)
+    {
+        if (!async_cmds.mid_line()) sc.tick();
+        async_cmds.forward();
+        delay(1);
+    }
+}
+
+// core1 only runs the async commands, and sleeps in between
+void setup1() {}
+
+void loop1() {
+    if (!async_cmds.pending())
+    {
+        __wfe();
+        return;
+    }
+    PeripheralsLock lock(true);
+    async_cmds.run_next();
 }
 
 
@@ -685,43 +1137,47 @@ bool log_to_sd()
         goto end;
     }
     
-    LogData ld;
+    // write the entries straight from the queue, a contiguous chunk at a time, and only drop them once written. an entry
+    // that fails stays queued for the next file
+    QueueSpan<const LogData> spans[2];
     while (log_data_queue.available())
     {
-        if (!log_data_queue.pop(&ld))
-        {
-            ERROR_PRINTLN("Error popping log data from queue");
-            goto end;
-        }
-
-
-        if (!file.write(ld.timestamp))
-        {
-            ERROR_PRINTFLN("Couldn't write timestamp to file '%s'", fname);
-            next_file = true;
-            goto end;
-        }
-
-        const float max_float = 100000000000;
-        const size_t buf_len = 77;
-        char buf[buf_len+1];
-        snprintf(buf, buf_len, ",%u,%f10.4,%f10.4,%lu,%3.3f,%3.3f,%4.2f,%u,%u,%u",
-            ld.slot,
-            fmod(ld.mean, max_float),
-            fmod(ld.stdev, max_float),
-            ld.resulting_n % 100000000,
-            fmod(ld.hum, 1000),
-            fmod(ld.temp, 1000),
-            fmod(ld.pres, 10000),
-            ld.watered,
-            ld.finished_protocol,
-            ld.protocol_step
-        );
-        if (!file.println(buf))
+        log_data_queue.pop_n(log_data_queue.size(), spans);
+        for (const QueueSpan<const LogData> &span : spans)
         {
-            ERROR_PRINTFLN("Couldn't write to file '%s'", fname);
-            next_file = true;
-            goto end;
+            for (size_t i = 0; i < span.n; i++)
+            {
+                const LogData *ld = &span.data[i];
+                if (!file.write(ld->timestamp))
+                {
+                    ERROR_PRINTFLN("Couldn't write timestamp to file '%s'", fname);
+                    next_file = true;
+                    goto end;
+                }
+
+                const float max_float = 100000000000;
+                const size_t buf_len = 77;
+                char buf[buf_len+1];
+                snprintf(buf, buf_len, ",%u,%f10.4,%f10.4,%lu,%3.3f,%3.3f,%4.2f,%u,%u,%u",
+                    ld->slot,
+                    fmod(ld->mean, max_float),
+                    fmod(ld->stdev, max_float),
+                    ld->resulting_n % 100000000,
+                    fmod(ld->hum, 1000),
+                    fmod(ld->temp, 1000),
+                    fmod(ld->pres, 10000),
+                    ld->watered,
+                    ld->finished_protocol,
+                    ld->protocol_step
+                );
+                if (!file.println(buf))
+                {
+                    ERROR_PRINTFLN("Couldn't write to file '%s'", fname);
+                    next_file = true;
+                    goto end;
+                }
+                log_data_queue.release(1);
+            }
         }
     }
 
@@ -740,8 +1196,14 @@ bool log_to_sd()
 }
 
 
+// the slots the current round of the main loop didn't visit yet
+bool stomasense_round[N_MULTIPLEXERS] = {false};
+bool stomasense_round_open = false;
+
 bool stomasense_setup(const char *rundata_json)
 {
+    // a run starts with a fresh round
+    stomasense_round_open = false;
     if (rundata_json)
     {
 
@@ -755,53 +1217,37 @@ bool stomasense_setup(const char *rundata_json)
 }
 
 
-void stomasense_loop()
+void stomasense_process_slot(uint8_t slot, const HX711ScanResult *reading)
 {
-    if (!init_peripherals_flag)
+    const ScalePosition *pos = run_data.get_slot_position(slot);
+    ScaleProtocol *protocol = run_data.get_slot_protocol(slot);
+    if (!pos || !protocol)
     {
-        ERROR_PRINTLN("Init peripherals flag not set");
-        return;
-    }
-
-    static unsigned long bme_last_time = millis();
-    static unsigned long hx_last_time = millis();
-    static uint8_t curr_slot = 0;
-
-    const ScalePosition *pos;
-    ScaleProtocol *protocol;
-
-    // wrap around
-    if (curr_slot >= N_MULTIPLEXERS)
-        curr_slot = 0;
-
-    // check if current slot is in use
-    if (!(run_data.get_scales_in_use()[curr_slot++]))
-        return;
-
-    // get data
-    if (!run_data.get_slot_data(curr_slot, pos, protocol))
-    {
-        ERROR_PRINTFLN("Couldn't get data for slot in use %u. Doing nothing", curr_slot > 0 ? curr_slot - 1 : N_MULTIPLEXERS-1);
+        ERROR_PRINTFLN("Couldn't get data for slot in use %u. Doing nothing", slot);
         return;
     }
 
-    LogData ld = {.slot = curr_slot};
-
-    // get weight
-    float mean;
-    // bool read_calib_stats(uint8_t slot, uint32_t n, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
-    if (!hx.read_calib_stats(curr_slot, HX_STATS_N, &mean, &ld.stdev, &ld.resulting_n))
+    // build the log entry in its slot of the queue. if the queue couldn't be flushed the protocol still runs, but the
+    // entry is lost
+    LogData unlogged;
+    LogData *ld = log_data_queue.reserve();
+    if (!ld)
     {
-        ERROR_PRINTFLN("Couldn't read calib stats for slot %u", curr_slot);
-        return;
+        ERROR_PRINTFLN("Log queue full, the reading of slot %u won't be logged", slot);
+        ld = &unlogged;
     }
-    ld.mean = mean;
+    (*ld) = {.slot = slot};
+    ld->mean = reading->mean;
+    ld->stdev = reading->stdev;
+    ld->resulting_n = reading->n;
 
-    // tick protocol
+    // tick protocol with the tracked weight, which also carries the previous visits
     // void tick(float weight, bool *should_water, bool *finished_protocol, uint8_t *curr_step=NULL);
+    const HX711SlotEstimate *est = &hx.get_estimates()[slot];
+    const float weight = est->valid ? est->weight : reading->mean;
     bool should_water;
-    protocol->tick(mean, &should_water, &ld.finished_protocol, &ld.protocol_step);
-    ld.watered = should_water;
+    protocol->tick(weight, &should_water, &ld->finished_protocol, &ld->protocol_step);
+    ld->watered = should_water;
 
     // water if necessary
     // TODO: make this async! (use queues)
@@ -812,9 +1258,12 @@ void stomasense_loop()
         servo.set_angle_slow_blocking(pos->servo);
         pump.pump_blocking(pos->pump_intensity, pos->pump_time_us);
         servo.detach();
+        // the weight just jumped on purpose
+        hx.reset_estimate(slot);
     }
 
-    log_data_queue.push(&ld);
+    if (ld != &unlogged)
+        log_data_queue.commit();
     if (log_data_queue.full())
     {
         if (!log_to_sd())
@@ -823,3 +1272,58 @@ void stomasense_loop()
         }
     }
 }
+
+// visits the next slot in use of the round, and returns true once the round is done. a slot takes seconds (the settle
+// discards, up to HX_STATS_N samples), so a round goes slot by slot and the serial is serviced in between
+bool stomasense_loop()
+{
+    if (!init_peripherals_flag)
+    {
+        ERROR_PRINTLN("Init peripherals flag not set");
+        return true;
+    }
+
+    const bool *scales_in_use = run_data.get_scales_in_use();
+    if (!stomasense_round_open)
+    {
+        memcpy(stomasense_round, scales_in_use, sizeof(stomasense_round));
+        stomasense_round_open = true;
+    }
+    // a slot taken out of use halfway through the round isn't visited anymore
+    for (uint8_t slot = 0; slot < N_MULTIPLEXERS; slot++)
+        stomasense_round[slot] = stomasense_round[slot] && scales_in_use[slot];
+
+    // in the gray code order of a full scan
+    const int8_t slot = hx.next_slot(stomasense_round);
+    if (slot < 0)
+    {
+        stomasense_round_open = false;
+        return true;
+    }
+    stomasense_round[slot] = false;
+
+    bool visit[N_MULTIPLEXERS] = {false};
+    visit[slot] = true;
+    HX711ScanResult readings[N_MULTIPLEXERS];
+    if (!hx.scan(visit, HX_STATS_N, readings, true, HX_STATS_TARGET_SE, HX_STATS_DEADLINE_MS, hx711_stats_timeout_ms(HX_STATS_N + HX711_MULT_SETTLE_DISCARD)))
+    {
+        ERROR_PRINTFLN("Couldn't read calib stats for slot %u", slot);
+    }
+
+    if (readings[slot].dead)
+    {
+        WARN_PRINTFLN("Slot %u is dead, skipping it", slot);
+    }
+    else if (readings[slot].ok)
+        stomasense_process_slot(slot, &readings[slot]);
+
+    // switch now, so the next slot settles while the serial is serviced, like a full scan switches early
+    const int8_t next = hx.next_slot(stomasense_round);
+    if (next >= 0)
+    {
+        hx.set_slot(next);
+        return false;
+    }
+    stomasense_round_open = false;
+    return true;
+}
\ No newline at end of file
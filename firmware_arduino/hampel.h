@@ -0,0 +1,73 @@
+#ifndef _HAMPEL_H_
+#define _HAMPEL_H_
+
+#include <Arduino.h>
+
+// threshold in (scaled) median absolute deviations. 3 is the usual choice for the hampel identifier
+#ifndef HAMPEL_THRESHOLD
+#define HAMPEL_THRESHOLD 3
+#endif
+// the MAD of a quiet or quantized signal can be 0, which would reject every sample that isn't exactly the median
+#ifndef HAMPEL_MIN_MAD
+#define HAMPEL_MIN_MAD 2
+#endif
+// don't judge samples until the window holds this many, a median of 1 or 2 values says nothing
+#define HAMPEL_MIN_N 3
+
+/*
+ * Streaming hampel identifier on integer samples. Every sample goes into a window of the last K samples and is flagged
+ * as an outlier if it is further than HAMPEL_THRESHOLD * 1.4826 * MAD from the median of that window (1.4826 * MAD
+ * estimates the stdev of gaussian noise). A single spike barely moves the median or the MAD, so it is caught while a
+ * real step in the signal is accepted after half a window.
+ *
+ * K is small (5 to 9), so the median is taken by insertion sorting a copy of the window.
+ */
+template <size_t K>
+class HampelFilter
+{
+private:
+    int32_t _window[K];
+    size_t _head = 0, _n = 0;
+
+    static int32_t _median(int32_t *arr, size_t n)
+    {
+        for (size_t i = 1; i < n; i++)
+        {
+            const int32_t x = arr[i];
+            size_t j = i;
+            for (; j > 0 && arr[j-1] > x; j--)
+                arr[j] = arr[j-1];
+            arr[j] = x;
+        }
+        // for an even n take the lower one, keeps everything in integers
+        return arr[(n - 1) / 2];
+    }
+
+public:
+    static_assert(K >= HAMPEL_MIN_N, "HampelFilter window should be at least HAMPEL_MIN_N long");
+
+    void reset() { _head = 0; _n = 0; }
+
+    // returns false if new_value is an outlier
+    bool update(int32_t new_value)
+    {
+        _window[_head] = new_value;
+        _head = (_head + 1) % K;
+        if (_n < K) ++_n;
+        if (_n < HAMPEL_MIN_N) return true;
+
+        int32_t temp[K];
+        memcpy(temp, _window, _n * sizeof(int32_t));
+        const int32_t med = _median(temp, _n);
+        for (size_t i = 0; i < _n; i++)
+            temp[i] = abs(_window[i] - med);
+        int32_t mad = _median(temp, _n);
+        if (mad < HAMPEL_MIN_MAD) mad = HAMPEL_MIN_MAD;
+
+        // |x - med| > t * 1.4826 * mad, scaled by 10000 to stay in integers
+        const int64_t dev = abs(static_cast<int64_t>(new_value) - med);
+        return dev * 10000 <= static_cast<int64_t>(HAMPEL_THRESHOLD) * 14826 * mad;
+    }
+};
+
+#endif /* _HAMPEL_H_ */
@@ -1,8 +1,9 @@
 #include "hx711.h"
 
-#include <limits>
 #include <hardware/sync.h>
+#include <pico/time.h>
 #include "welfords.h"
+#include "sd_helper.h"
 #include "debug_helper.h"
 
 
@@ -129,6 +130,184 @@ bool HX711Calibration::populated() const
     return set_offset || set_slope;
 }
 
+void HX711Calibration::apply(float raw_mean, float raw_stdev, float *mean, float *stdev) const
+{
+    (*mean) = slope * raw_mean + offset;
+    (*stdev) = sqrt( sq(offset_e) + sq(slope_e)*sq(raw_mean) + sq(slope)*sq(raw_stdev) );
+}
+
+void HX711Calibration::set_offset_from_raw(float raw_mean, float raw_stdev)
+{
+    offset = raw_mean;
+    offset_e = raw_stdev;
+    set_offset = true;
+}
+
+bool HX711Calibration::set_slope_from_raw(float raw_mean, float raw_stdev, float weight, float weight_error)
+{
+    if (!set_offset)
+    {
+        ERROR_PRINTLN("Cannot calibrate slope when offset is not set");
+        return false;
+    }
+
+    slope = (weight - offset) / raw_mean;
+
+    float raw_mean2 = sq(raw_mean);
+    float temp = raw_stdev / raw_mean2;
+    temp = abs(temp); // this shouldn't be necessary
+    slope_e = sqrt( (sq(offset_e) + sq(weight_error)) / raw_mean2 + sq(weight - offset) * abs(temp) );
+    set_slope = true;
+
+    return true;
+}
+
+bool HX711Calibrations::from_json(JsonDocument *doc, HX711Calibration *calibs, bool *set_calibs, size_t n)
+{
+    /*
+     It takes in a JsonDocument with the following structure
+     [
+        {
+            "r": <slot:uint8_t>,
+            "o": <offset:float>,
+            "p": <offset_error:float>,
+            "s": <slope:float>,
+            "t": <slope_error:float>
+        },
+        ...
+     ]
+
+     And populates de calibration array so that calibs[x] points to the HX711Calibration for the slot x
+     */
+    JsonArray arr = doc->as<JsonArray>();
+    if (!arr)
+    {
+        ERROR_PRINTLN("Couldn't load calibrations: document wasn't a JsonArray");
+        return false;
+    }
+
+    size_t for_len = arr.size();
+    if (for_len > n)
+    {
+        WARN_PRINTFLN("Calibrations array has %lu elements but there are only %lu scales. Will only load first %lu calibrations",
+        for_len, n, n);
+        for_len = n;
+    }
+
+    // set_calibs keeps track of which slots have already been assigned a calibration
+    memset(set_calibs, false, n * sizeof(bool));
+
+    for (size_t i = 0; i < for_len; i++)
+    {
+        JsonObject obj = arr[i].as<JsonObject>();
+        if (!obj)
+        {
+            WARN_PRINTFLN("The element %lu of the calibration array couldn't be loaded because it wasn't a JsonObject", i);
+            continue;
+        }
+
+        // check slot
+        if (!obj[HX711_CALIBRATION_JSON_KEY_SLOT].is<uint8_t>())
+        {
+            WARN_PRINTFLN("The element %lu of the calibration array didn't have the key '%s' for the slot, so it will be skipped", i, HX711_CALIBRATION_JSON_KEY_SLOT);
+            continue;
+        }
+        uint8_t slot = obj[HX711_CALIBRATION_JSON_KEY_SLOT].as<uint8_t>();
+        if (slot >= n)
+        {
+            WARN_PRINTFLN("The element %lu of the calibration array has the slot %u, but there are only %lu scales. skipping it", i, slot, n);
+            continue;
+        }
+        if (set_calibs[slot])
+        {
+            WARN_PRINTFLN("The element %lu of the calibration array has the slot %u, but that slot has already been assigned a calibration. overriding with this calibration",
+            i, slot);
+        }
+
+        if (!calibs[slot].from_json(&obj))
+        {
+            WARN_PRINTFLN("Couldn't get calib from json for slot %u", slot);
+            continue;
+        }
+
+        set_calibs[slot] = true;
+    }
+
+    return true;
+}
+
+bool HX711Calibrations::load(const char *fname, HX711Calibration *calibs, bool *set_calibs, size_t n)
+{
+    File file;
+
+    if (!SD_Helper::open_read(&file, fname))
+    {
+        SD_Helper::close(&file);
+        ERROR_PRINTFLN("HX711: Couldn't open file '%s' for reading", fname);
+        return false;
+    }
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, file);
+    SD_Helper::close(&file);
+
+    if (error)
+    {
+        ERROR_PRINTFLN("Can't load calibrations json: deserialization failed with error: '%s'", error.c_str());
+        return false;
+    }
+
+    return from_json(&doc, calibs, set_calibs, n);
+}
+
+bool HX711Calibrations::load(const char *json, size_t json_len, HX711Calibration *calibs, bool *set_calibs, size_t n)
+{
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, json, json_len);
+
+    if (error)
+    {
+        ERROR_PRINTFLN("Can't load calibrations json: deserialization failed with error: '%s'", error.c_str());
+        return false;
+    }
+
+    return from_json(&doc, calibs, set_calibs, n);
+}
+
+bool HX711Calibrations::save(const char *fname, const HX711Calibration *calibs, size_t n)
+{
+    JsonDocument doc;
+    JsonArray arr = doc.to<JsonArray>();
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!calibs[i].populated()) continue;
+        JsonObject obj = arr.add<JsonObject>();
+        calibs[i].to_json(&obj);
+    }
+
+    File file;
+
+    if (!SD_Helper::open_write(&file, fname))
+    {
+        SD_Helper::close(&file);
+        ERROR_PRINTFLN("HX711: Couldn't open file '%s' for writing", fname);
+        return false;
+    }
+
+    size_t min_size = measureJson(arr);
+    size_t actual_size = serializeJson(arr, file);
+    SD_Helper::close(&file);
+
+    if (min_size < actual_size)
+    {
+        ERROR_PRINTFLN("Couldn't save calibrations: written %u bytes when the json was %u bytes long", actual_size, min_size);
+        return false;
+    }
+
+    return true;
+}
+
 inline void HX711::pulse()
 {
     // pulse
@@ -142,10 +321,23 @@ HX711::HX711(pin_size_t pin_sck, pin_size_t pin_dout, HX711Gain gain)
 : _pin_sck(pin_sck), _pin_dout(pin_dout), _gain(gain)
 {}
 
+void HX711::_dout_falling_isr(void *param)
+{
+    // DOUT going low means a conversion is ready. we only need to send an event, the waiting
+    // loop checks is_ready itself so spurious edges (while clocking out bits) are harmless
+    (void)param;
+    __sev();
+}
+
 void HX711::begin()
 {
     pinMode(_pin_sck, OUTPUT);
     pinMode(_pin_dout, INPUT);
+    attachInterruptParam(digitalPinToInterrupt(_pin_dout), &HX711::_dout_falling_isr, FALLING, this);
+#ifdef HX711_USE_PIO
+    if (!_pio_reader.begin(_pin_sck, _pin_dout, _gain))
+        WARN_PRINTLN("HX711: Couldn't start the PIO reader. Falling back to bit banging");
+#endif
 }
 
 bool HX711::is_ready()
@@ -155,60 +347,77 @@ bool HX711::is_ready()
 
 void HX711::wait_ready()
 {
+    // if the edge happens between is_ready and __wfe, the event register is already set by
+    // the isr and __wfe returns immediately, so no wake up is lost
     while (!is_ready())
-        sleep_us(HX711_IS_READY_POLLING_DELAY_US);
+        __wfe();
 }
 
 bool HX711::wait_ready_timeout(unsigned long timeout_ms)
 {
-    const unsigned long start_time_ms = millis();
-    unsigned long ms, time_diff = 0;
-    while (time_diff < timeout_ms)
+    const absolute_time_t timeout_time = make_timeout_time_ms(timeout_ms);
+    while (!is_ready())
     {
-        if (is_ready()) return true;
-        sleep_us(HX711_IS_READY_POLLING_DELAY_US);
-
-        ms = millis();
-        if (ms > start_time_ms)
-            time_diff = ms - start_time_ms;
-        else
-            time_diff = (std::numeric_limits<unsigned long>::max() - start_time_ms) + ms;
+        // returns true when the timeout was reached
+        if (best_effort_wfe_or_timeout(timeout_time))
+        {
+            if (is_ready()) return true;
+            WARN_PRINTLN("HX711 timed out waiting for to be ready");
+            return false;
+        }
     }
+    return true;
+}
 
-    WARN_PRINTLN("HX711 timed out waiting for to be ready");
-    return false;
+void HX711::flush()
+{
+    // drops frames that were converted before now (i.e. before switching the input)
+#ifdef HX711_USE_PIO
+    _pio_reader.flush();
+#endif
 }
 
 bool HX711::read_raw_single(int32_t *raw, uint32_t timeout_ms)
 {
-    uint32_t ints;
-    uint8_t i, j, data[3] = {0}, filler;
+#ifdef HX711_USE_PIO
+    if (_pio_reader.running())
+    {
+        if (!_pio_reader.wait_pop(raw, timeout_ms))
+        {
+            ERROR_PRINTLN("Timeout error in HX711::read_raw_single");
+            return false;
+        }
+        return true;
+    }
+#endif
+
+    uint32_t ints, frame = 0;
+    uint8_t i;
 
     // send ready request
     power_on();
 
     // wait for ready
     if (timeout_ms > 0)
+    {
         if (!wait_ready_timeout(timeout_ms))
         {
             ERROR_PRINTLN("Timeout error in HX711::read_raw_single");
             return false;
         }
+    }
     else
         wait_ready();
 
-    // read
-    for (i = 0; i < 3; i++)
+    // read 24 bits, MSB first
+    for (i = 0; i < 24; i++)
     {
-        for (j = 0; i < 8; i++)
-        {
-            ints = save_and_disable_interrupts(); 
-            pulse();
-            restore_interrupts(ints);
+        ints = save_and_disable_interrupts();
+        pulse();
+        restore_interrupts(ints);
 
-            // shift
-            data[i] |= digitalRead(_pin_dout) << (7 - j);
-        }
+        // shift
+        frame = (frame << 1) | (digitalRead(_pin_dout) == HIGH);
     }
 
     // set correct gain
@@ -220,18 +429,24 @@ bool HX711::read_raw_single(int32_t *raw, uint32_t timeout_ms)
     restore_interrupts(ints);
 
     // to twos complement
-    if (data[2] & 0x80)
-        filler = 0xFF;
-    else
-        filler = 0x00;
-
-    (*raw) = static_cast<int32_t>(static_cast<uint32_t>(filler) << 24 |
-             static_cast<uint32_t>(data[2]) << 16 |
-             static_cast<uint32_t>(data[1]) << 8 |
-             static_cast<uint32_t>(data[0]));
+    (*raw) = hx711_frame_to_raw(frame);
     return true;
 }
 
+void HX711::reset_outlier_filter()
+{
+    _outlier_filter.reset();
+    _n_rejected = 0;
+}
+
+bool HX711::accept_sample(int32_t raw)
+{
+    if (!_reject_outliers) return true;
+    if (_outlier_filter.update(raw)) return true;
+    ++_n_rejected;
+    return false;
+}
+
 bool HX711::read_raw_stats(uint32_t n, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms)
 {
     int32_t raw;
@@ -253,12 +468,61 @@ bool HX711::read_raw_stats(uint32_t n, float *mean, float *stdev, uint32_t *resu
         return true;
     }
 
-    Welfords::Aggregate agg;
-    float temp_mean, temp_stdev;
+    const absolute_time_t deadline = hx711_deadline(timeout_ms);
+    Welfords::AggregateInt agg;
+    reset_outlier_filter();
     for (uint32_t i = 0; i < n; i++)
     {
-        if (!read_raw_single(&raw, timeout_ms)) continue;
-        Welfords::update(&agg, static_cast<float>(raw));
+        if (time_reached(deadline))
+        {
+            WARN_PRINTFLN("HX711::read_raw_stats timed out after %lu of %lu samples", agg.count, n);
+            break;
+        }
+        if (!read_raw_single(&raw, hx711_ms_left(deadline))) continue;
+        if (!accept_sample(raw)) continue;
+        Welfords::update(&agg, raw);
+    }
+
+    if (!Welfords::finalize(&agg, mean, stdev))
+    {
+        ERROR_PRINTFLN("Couldn't finalize welford's algorithm because there weren't enough samples (%lu)", agg.count);
+        return false;
+    }
+    (*resulting_n) = agg.count;
+    return true;
+}
+
+bool HX711::read_raw_stats_adaptive(uint32_t n_max, float target_se, uint32_t deadline_ms, float *mean, float *stdev, float *se, uint32_t *resulting_n, uint32_t timeout_ms)
+{
+    if (n_max < 2)
+    {
+        ERROR_PRINTFLN("Can't read adaptive stats with n_max = %lu", n_max);
+        return false;
+    }
+
+    const absolute_time_t deadline = make_timeout_time_ms(deadline_ms);
+    const absolute_time_t timeout_time = hx711_deadline(timeout_ms);
+    Welfords::AggregateInt agg;
+    int32_t raw;
+    reset_outlier_filter();
+    for (uint32_t i = 0; i < n_max; i++)
+    {
+        if (time_reached(timeout_time))
+        {
+            WARN_PRINTFLN("HX711::read_raw_stats_adaptive timed out after %lu samples", agg.count);
+            break;
+        }
+        if (read_raw_single(&raw, hx711_ms_left(timeout_time)) && accept_sample(raw))
+        {
+            Welfords::update(&agg, raw);
+            if (agg.count >= HX711_ADAPTIVE_MIN_N && Welfords::standard_error_reached(&agg, target_se))
+                break;
+        }
+        if (deadline_ms > 0 && time_reached(deadline))
+        {
+            WARN_PRINTFLN("HX711 adaptive read reached its deadline after %lu samples", agg.count);
+            break;
+        }
     }
 
     if (!Welfords::finalize(&agg, mean, stdev))
@@ -266,10 +530,28 @@ bool HX711::read_raw_stats(uint32_t n, float *mean, float *stdev, uint32_t *resu
         ERROR_PRINTFLN("Couldn't finalize welford's algorithm because there weren't enough samples (%lu)", agg.count);
         return false;
     }
+    (*se) = (*stdev) / sqrt(agg.count);
     (*resulting_n) = agg.count;
     return true;
 }
 
+bool HX711::read_calib_stats_adaptive(uint32_t n_max, float target_se, uint32_t deadline_ms, HX711Calibration *calib, float *mean, float *stdev, float *se, uint32_t *resulting_n, uint32_t timeout_ms)
+{
+    // the target is in calibrated units, the raw counts are scaled by the slope
+    const float slope = abs(calib->slope);
+    const float raw_target_se = slope > 0 ? target_se / slope : target_se;
+    float raw_mean, raw_stdev, raw_se;
+    if (!read_raw_stats_adaptive(n_max, raw_target_se, deadline_ms, &raw_mean, &raw_stdev, &raw_se, resulting_n, timeout_ms))
+    {
+        ERROR_PRINTLN("Error in HX711::read_calib_stats_adaptive due to error in HX711::read_raw_stats_adaptive");
+        return false;
+    }
+
+    calib->apply(raw_mean, raw_stdev, mean, stdev);
+    (*se) = slope * raw_se;
+    return true;
+}
+
 bool HX711::read_calib_stats(uint32_t n, HX711Calibration *calib, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms)
 {
     float raw_mean, raw_stdev;
@@ -279,9 +561,7 @@ bool HX711::read_calib_stats(uint32_t n, HX711Calibration *calib, float *mean, f
         return false;
     }
 
-    (*mean) = calib->slope * raw_mean + calib->offset;
-    (*stdev) = sqrt( sq(calib->offset_e) + sq(calib->slope_e)*sq(raw_mean) + sq(calib->slope)*sq(raw_stdev) );
-
+    calib->apply(raw_mean, raw_stdev, mean, stdev);
     return true;
 }
 
@@ -294,10 +574,7 @@ bool HX711::calib_offset(uint32_t n, HX711Calibration *calib, uint32_t *resultin
         return false;
     }
 
-    calib->offset = raw_mean;
-    calib->offset_e = raw_stdev;
-    calib->set_offset = true;
-
+    calib->set_offset_from_raw(raw_mean, raw_stdev);
     return true;
 }
 
@@ -315,19 +592,20 @@ bool HX711::calib_slope(uint32_t n, float weight, float weight_error, HX711Calib
         return false;
     }
 
-    calib->slope = (weight - calib->offset) / raw_mean;
-
-    float raw_mean2 = sq(raw_mean);
-    float temp = raw_stdev / raw_mean2;
-    temp = abs(temp); // this shouldn't be necessary
-    calib->slope_e = sqrt( (sq(calib->offset_e) + sq(weight_error)) / raw_mean2 + sq(weight - calib->offset) * abs(temp) );
-    calib->set_slope = true;
-
-    return true;
+    return calib->set_slope_from_raw(raw_mean, raw_stdev, weight, weight_error);
 }
 
 void HX711::power_off(bool wait_until_power_off)
 {
+#ifdef HX711_USE_PIO
+    if (_pio_reader.running())
+    {
+        _pio_reader.pause(true);
+        if (wait_until_power_off)
+            sleep_us(HX711_POWER_DOWN_DELAY_US);
+        return;
+    }
+#endif
     digitalWrite(_pin_sck, LOW);
     digitalWrite(_pin_sck, HIGH);
     if (wait_until_power_off)
@@ -336,5 +614,12 @@ void HX711::power_off(bool wait_until_power_off)
 
 void HX711::power_on()
 {
+#ifdef HX711_USE_PIO
+    if (_pio_reader.running())
+    {
+        _pio_reader.resume();
+        return;
+    }
+#endif
     digitalWrite(_pin_sck, LOW);
 }
\ No newline at end of file
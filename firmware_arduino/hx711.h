@@ -4,13 +4,26 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <pico/time.h>
 #include "debug_helper.h"
+#include "hx711_pio.h"
+#include "hampel.h"
 
 // inspired by https://github.com/bogde/HX711
 
+// uncomment to clock the HX711 out with a PIO state machine and stream the frames to a DMA ring (see hx711_pio.h)
+// #define HX711_USE_PIO
+
 #define HX711_PULSE_DELAY_US 1
-#define HX711_IS_READY_POLLING_DELAY_US 1000
+// adaptive reads take at least this many samples before trusting the running stdev
+#define HX711_ADAPTIVE_MIN_N 5
 #define HX711_POWER_DOWN_DELAY_US 60
+// slowest output rate of the converter (10 SPS), used to size timeouts for n samples
+#define HX711_SAMPLE_PERIOD_MS 100
+// window of the outlier filter that runs in front of the statistics
+#ifndef HX711_OUTLIER_WINDOW
+#define HX711_OUTLIER_WINDOW 7
+#endif
 
 #define HX711_CALIBRATION_JSON_BUF_LEN          96
 #define HX711_CALIBRATION_JSON_KEY_SLOT         "r"
@@ -19,6 +32,27 @@
 #define HX711_CALIBRATION_JSON_KEY_SLOPE        "s"
 #define HX711_CALIBRATION_JSON_KEY_SLOPE_ERROR  "t"
 
+// timeouts passed to the stats methods bound the whole read, not each sample. 0 means no timeout
+static inline absolute_time_t hx711_deadline(uint32_t timeout_ms)
+{
+    return timeout_ms > 0 ? make_timeout_time_ms(timeout_ms) : at_the_end_of_time;
+}
+
+// time left until deadline, to be passed as the timeout of a single read. check time_reached(deadline) first, 0 means
+// no timeout
+static inline uint32_t hx711_ms_left(absolute_time_t deadline)
+{
+    if (is_at_the_end_of_time(deadline)) return 0;
+    const int64_t left_ms = absolute_time_diff_us(get_absolute_time(), deadline) / 1000;
+    return left_ms > 1 ? static_cast<uint32_t>(left_ms) : 1;
+}
+
+// a reasonable timeout for a read of n samples at the slowest output rate
+static inline uint32_t hx711_stats_timeout_ms(uint32_t n)
+{
+    return 1000 + n * HX711_SAMPLE_PERIOD_MS;
+}
+
 enum HX711Gain : uint8_t
 {
     A128 = 1,
@@ -37,16 +71,39 @@ struct HX711Calibration
     bool from_json(JsonObject *obj);
     bool from_json(char *buf, size_t buf_len);
     bool populated() const;
+
+    void apply(float raw_mean, float raw_stdev, float *mean, float *stdev) const;
+    void set_offset_from_raw(float raw_mean, float raw_stdev);
+    bool set_slope_from_raw(float raw_mean, float raw_stdev, float weight, float weight_error);
 };
 
+namespace HX711Calibrations
+{
+    // (de)serialization of a whole set of calibrations, indexed by slot/channel
+    bool from_json(JsonDocument *doc, HX711Calibration *calibs, bool *set_calibs, size_t n);
+    bool load(const char *fname, HX711Calibration *calibs, bool *set_calibs, size_t n);
+    bool load(const char *json, size_t json_len, HX711Calibration *calibs, bool *set_calibs, size_t n);
+    bool save(const char *fname, const HX711Calibration *calibs, size_t n);
+}
+
 class HX711
 {
 private:
     const pin_size_t _pin_sck, _pin_dout;
     const HX711Gain _gain;
+#ifdef HX711_USE_PIO
+    HX711PIO _pio_reader;
+#endif
+
+    HampelFilter<HX711_OUTLIER_WINDOW> _outlier_filter;
+    bool _reject_outliers = false;
+    uint32_t _n_rejected = 0;
 
     inline void pulse();
 
+    // called from the falling edge interrupt on DOUT. It wakes up any core sleeping in wait_ready
+    static void _dout_falling_isr(void *param);
+
 public:
     HX711(pin_size_t pin_sck, pin_size_t pin_dout, HX711Gain gain=HX711Gain::A128);
     
@@ -55,10 +112,27 @@ public:
     bool is_ready();
     void wait_ready();
     bool wait_ready_timeout(unsigned long timeout_ms=5000);
+    void flush();
     
     bool read_raw_single(int32_t *raw, uint32_t timeout_ms=5000);
+
+    // optional outlier rejection (hampel filter) in front of the statistics. spikes from bumps or a loose connector are
+    // dropped instead of inflating the mean and stdev. rejected() is the number of samples dropped by the last read
+    inline void set_outlier_rejection(bool enabled) { _reject_outliers = enabled; }
+    inline bool outlier_rejection() const { return _reject_outliers; }
+    inline uint32_t rejected() const { return _n_rejected; }
+    void reset_outlier_filter();
+    // returns false if raw should be left out of the statistics
+    bool accept_sample(int32_t raw);
+
     bool read_raw_stats(uint32_t n, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms=5000);
     bool read_calib_stats(uint32_t n, HX711Calibration *calib, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms=5000);
+
+    // timeout_ms bounds the whole read. whatever was sampled until then is used
+    // take samples until the standard error of the mean reaches target_se, n_max samples were taken or deadline_ms passed.
+    // se is the standard error actually reached
+    bool read_raw_stats_adaptive(uint32_t n_max, float target_se, uint32_t deadline_ms, float *mean, float *stdev, float *se, uint32_t *resulting_n, uint32_t timeout_ms=5000);
+    bool read_calib_stats_adaptive(uint32_t n_max, float target_se, uint32_t deadline_ms, HX711Calibration *calib, float *mean, float *stdev, float *se, uint32_t *resulting_n, uint32_t timeout_ms=5000);
     
     bool calib_offset(uint32_t n, HX711Calibration *calib, uint32_t *resulting_n, uint32_t timeout_ms=5000);
     bool calib_slope(uint32_t n, float weight, float weight_error, HX711Calibration *calib, uint32_t *resulting_n, uint32_t timeout_ms=5000);
@@ -0,0 +1,240 @@
+#include "hx711_array.h"
+
+#include <hardware/gpio.h>
+#include <hardware/sync.h>
+#include <pico/time.h>
+#include "welfords.h"
+#include "debug_helper.h"
+
+static void _hx711_array_dout_falling_isr()
+{
+    // any DOUT going low may complete the set of ready converters, let the waiting loop check
+    __sev();
+}
+
+inline void HX711Array::pulse()
+{
+    gpio_put(_pin_sck, true);
+    sleep_us(HX711_PULSE_DELAY_US);
+    gpio_put(_pin_sck, false);
+    sleep_us(HX711_PULSE_DELAY_US);
+}
+
+HX711Array::HX711Array(pin_size_t pin_sck, const pin_size_t *pins_dout, uint8_t n_channels, HX711Gain gain)
+: _pin_sck(pin_sck), _n_channels(n_channels <= HX711_ARRAY_MAX_CHANNELS ? n_channels : HX711_ARRAY_MAX_CHANNELS), _gain(gain)
+{
+    memcpy(_pins_dout, pins_dout, _n_channels * sizeof(pin_size_t));
+    memset(_set_calibs, false, HX711_ARRAY_MAX_CHANNELS * sizeof(bool));
+    for (uint8_t i = 0; i < _n_channels; i++)
+        _dout_mask |= 1u << _pins_dout[i];
+}
+
+void HX711Array::begin()
+{
+    if (_n_channels == 0)
+        ERROR_PRINTLN("HX711Array has no channels");
+    pinMode(_pin_sck, OUTPUT);
+    for (uint8_t i = 0; i < _n_channels; i++)
+    {
+        pinMode(_pins_dout[i], INPUT);
+        attachInterrupt(digitalPinToInterrupt(_pins_dout[i]), _hx711_array_dout_falling_isr, FALLING);
+    }
+}
+
+bool HX711Array::is_ready()
+{
+    // all the converters pull their DOUT low when they have data
+    return (gpio_get_all() & _dout_mask) == 0;
+}
+
+bool HX711Array::wait_ready_timeout(uint32_t timeout_ms)
+{
+    const absolute_time_t timeout_time = timeout_ms > 0 ? make_timeout_time_ms(timeout_ms) : at_the_end_of_time;
+    while (!is_ready())
+    {
+        if (best_effort_wfe_or_timeout(timeout_time))
+        {
+            if (is_ready()) return true;
+            WARN_PRINTFLN("HX711Array timed out waiting for all channels to be ready (not ready mask 0x%08lx)", gpio_get_all() & _dout_mask);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HX711Array::read_raw_single(int32_t *raw, uint32_t timeout_ms)
+{
+    uint32_t ints, all;
+    uint32_t frames[HX711_ARRAY_MAX_CHANNELS] = {0};
+    uint8_t i, ch;
+
+    power_on();
+
+    if (!wait_ready_timeout(timeout_ms))
+    {
+        ERROR_PRINTLN("Timeout error in HX711Array::read_raw_single");
+        return false;
+    }
+
+    // read 24 bits, MSB first, from every channel at once
+    for (i = 0; i < 24; i++)
+    {
+        ints = save_and_disable_interrupts();
+        pulse();
+        restore_interrupts(ints);
+
+        all = gpio_get_all();
+        for (ch = 0; ch < _n_channels; ch++)
+            frames[ch] = (frames[ch] << 1) | ((all >> _pins_dout[ch]) & 1u);
+    }
+
+    // set correct gain
+    ints = save_and_disable_interrupts();
+    for (i = 0; i < _gain; i++)
+    {
+        pulse();
+    }
+    restore_interrupts(ints);
+
+    for (ch = 0; ch < _n_channels; ch++)
+        raw[ch] = hx711_frame_to_raw(frames[ch]);
+    return true;
+}
+
+bool HX711Array::read_raw_stats(uint32_t n, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms)
+{
+    if (n < 2)
+    {
+        ERROR_PRINTFLN("Can't read stats with n = %lu. Use read_raw_single instead", n);
+        return false;
+    }
+
+    int32_t raw[HX711_ARRAY_MAX_CHANNELS];
+    Welfords::AggregateInt aggs[HX711_ARRAY_MAX_CHANNELS];
+    uint8_t ch;
+    const absolute_time_t deadline = hx711_deadline(timeout_ms);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (time_reached(deadline))
+        {
+            WARN_PRINTFLN("HX711Array::read_raw_stats timed out after %lu of %lu frames", aggs[0].count, n);
+            break;
+        }
+        if (!read_raw_single(raw, hx711_ms_left(deadline))) continue;
+        for (ch = 0; ch < _n_channels; ch++)
+            Welfords::update(&aggs[ch], raw[ch]);
+    }
+
+    // all channels get the same frames, so they all have the same count
+    for (ch = 0; ch < _n_channels; ch++)
+    {
+        if (!Welfords::finalize(&aggs[ch], &mean[ch], &stdev[ch]))
+        {
+            ERROR_PRINTFLN("Couldn't finalize welford's algorithm because there weren't enough samples (%lu)", aggs[ch].count);
+            return false;
+        }
+        resulting_n[ch] = aggs[ch].count;
+    }
+    return true;
+}
+
+bool HX711Array::read_calib_stats(uint32_t n, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms)
+{
+    uint8_t ch;
+    for (ch = 0; ch < _n_channels; ch++)
+    {
+        if (!_calibs[ch].set_offset || !_calibs[ch].set_slope)
+        {
+            ERROR_PRINTFLN("Cannot call HX711Array::read_calib_stats when offset or slope is not set (channel %u)", ch);
+            return false;
+        }
+    }
+
+    float raw_mean[HX711_ARRAY_MAX_CHANNELS], raw_stdev[HX711_ARRAY_MAX_CHANNELS];
+    if (!read_raw_stats(n, raw_mean, raw_stdev, resulting_n, timeout_ms))
+    {
+        ERROR_PRINTLN("Error in HX711Array::read_calib_stats due to error in HX711Array::read_raw_stats");
+        return false;
+    }
+
+    for (ch = 0; ch < _n_channels; ch++)
+        _calibs[ch].apply(raw_mean[ch], raw_stdev[ch], &mean[ch], &stdev[ch]);
+    return true;
+}
+
+bool HX711Array::calib_offset(uint8_t channel, uint32_t n, uint32_t *resulting_n, uint32_t timeout_ms)
+{
+    if (!is_channel_valid(channel))
+    {
+        ERROR_PRINTFLN("Channel %u is invalid. Channel should be in range [0,%u]", channel, _n_channels-1);
+        return false;
+    }
+    float raw_mean[HX711_ARRAY_MAX_CHANNELS], raw_stdev[HX711_ARRAY_MAX_CHANNELS];
+    uint32_t ns[HX711_ARRAY_MAX_CHANNELS];
+    if (!read_raw_stats(n, raw_mean, raw_stdev, ns, timeout_ms))
+    {
+        ERROR_PRINTLN("Error in HX711Array::calib_offset due to error in HX711Array::read_raw_stats");
+        return false;
+    }
+    _calibs[channel].slot = channel;
+    _calibs[channel].set_offset_from_raw(raw_mean[channel], raw_stdev[channel]);
+    _set_calibs[channel] = true;
+    (*resulting_n) = ns[channel];
+    return true;
+}
+
+bool HX711Array::calib_slope(uint8_t channel, uint32_t n, float weight, float weight_error, uint32_t *resulting_n, uint32_t timeout_ms)
+{
+    if (!is_channel_valid(channel))
+    {
+        ERROR_PRINTFLN("Channel %u is invalid. Channel should be in range [0,%u]", channel, _n_channels-1);
+        return false;
+    }
+    if (!_calibs[channel].set_offset)
+    {
+        ERROR_PRINTLN("Cannot calibrate slope when offset is not set");
+        return false;
+    }
+    float raw_mean[HX711_ARRAY_MAX_CHANNELS], raw_stdev[HX711_ARRAY_MAX_CHANNELS];
+    uint32_t ns[HX711_ARRAY_MAX_CHANNELS];
+    if (!read_raw_stats(n, raw_mean, raw_stdev, ns, timeout_ms))
+    {
+        ERROR_PRINTLN("Error in HX711Array::calib_slope due to error in HX711Array::read_raw_stats");
+        return false;
+    }
+    (*resulting_n) = ns[channel];
+    return _calibs[channel].set_slope_from_raw(raw_mean[channel], raw_stdev[channel], weight, weight_error);
+}
+
+void HX711Array::power_off(bool wait_until_power_off)
+{
+    gpio_put(_pin_sck, false);
+    gpio_put(_pin_sck, true);
+    if (wait_until_power_off)
+        sleep_us(HX711_POWER_DOWN_DELAY_US);
+}
+
+void HX711Array::power_on()
+{
+    gpio_put(_pin_sck, false);
+}
+
+bool HX711Array::load_calibration(JsonDocument *doc)
+{
+    return HX711Calibrations::from_json(doc, _calibs, _set_calibs, _n_channels);
+}
+
+bool HX711Array::load_calibration()
+{
+    return HX711Calibrations::load(HX711_ARRAY_SAVEFILE, _calibs, _set_calibs, _n_channels);
+}
+
+bool HX711Array::load_calibration(const char *json)
+{
+    return HX711Calibrations::load(json, strlen(json), _calibs, _set_calibs, _n_channels);
+}
+
+bool HX711Array::save_calibration()
+{
+    return HX711Calibrations::save(HX711_ARRAY_SAVEFILE, _calibs, _n_channels);
+}
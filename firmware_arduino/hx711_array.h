@@ -0,0 +1,67 @@
+#ifndef _HX711_ARRAY_H_
+#define _HX711_ARRAY_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "hx711.h"
+
+#ifndef HX711_ARRAY_MAX_CHANNELS
+#define HX711_ARRAY_MAX_CHANNELS 8
+#endif
+
+#ifndef HX711_DEFAULT_TIMEOUT_MS
+#define HX711_DEFAULT_TIMEOUT_MS 5000
+#endif
+
+#define HX711_ARRAY_SAVEFILE "HXACALIB.JSN"
+
+/*
+ * Several HX711 that share a single SCK line, each one with its own DOUT pin. Every bit of the frame is clocked once for
+ * all the converters and all the DOUT pins are sampled at the same time with one gpio_get_all(), so N scales deliver a
+ * reading in the same conversion window a single scale would.
+ *
+ * Arrays passed to and from the methods are indexed by channel, i.e. the position of the DOUT pin in the constructor.
+ */
+class HX711Array
+{
+private:
+    const pin_size_t _pin_sck;
+    pin_size_t _pins_dout[HX711_ARRAY_MAX_CHANNELS];
+    const uint8_t _n_channels;
+    uint32_t _dout_mask = 0;
+    const HX711Gain _gain;
+    HX711Calibration _calibs[HX711_ARRAY_MAX_CHANNELS];
+    bool _set_calibs[HX711_ARRAY_MAX_CHANNELS];
+
+    inline void pulse();
+    inline bool is_channel_valid(uint8_t channel) const { return channel < _n_channels; }
+
+public:
+    HX711Array(pin_size_t pin_sck, const pin_size_t *pins_dout, uint8_t n_channels, HX711Gain gain=HX711Gain::A128);
+
+    void begin();
+    inline uint8_t channels() const { return _n_channels; }
+
+    bool is_ready();
+    bool wait_ready_timeout(uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
+
+    bool read_raw_single(int32_t *raw, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
+    bool read_raw_stats(uint32_t n, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
+    bool read_calib_stats(uint32_t n, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
+
+    bool calib_offset(uint8_t channel, uint32_t n, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
+    bool calib_slope(uint8_t channel, uint32_t n, float weight, float weight_error, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
+
+    void power_off(bool wait_until_power_off=false);
+    void power_on();
+
+    bool load_calibration();
+    bool load_calibration(const char *json);
+    bool load_calibration(JsonDocument *doc);
+    bool save_calibration();
+
+    inline const HX711Calibration *get_calibs() const { return (const HX711Calibration *)_calibs; }
+    inline const bool *get_set_calibs() const { return (const bool *)_set_calibs; }
+};
+
+#endif /* _HX711_ARRAY_H_ */
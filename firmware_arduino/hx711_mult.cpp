@@ -1,11 +1,13 @@
 // #include <sys/_stdint.h>
 #include "hx711_mult.h"
 
+#include <pico/time.h>
 #include "debug_helper.h"
-#include "sd_helper.h"
+#include "welfords.h"
 #include "algos.h"
+#include "json_pool.h"
 
-static const bool multiplexer_configs[N_MULTIPLEXERS][N_MULTIPLEXER_PINS] = {
+static constexpr bool multiplexer_configs[N_MULTIPLEXERS][N_MULTIPLEXER_PINS] = {
     {0, 0, 0, 0},
     {0, 1, 0, 0},
     {0, 0, 1, 0},
@@ -24,6 +26,48 @@ static const bool multiplexer_configs[N_MULTIPLEXERS][N_MULTIPLEXER_PINS] = {
     {1, 1, 1, 1}
 };
 
+// order in which scan visits the slots: a gray code over the select pins, so only one pin changes per hop
+// (including the wrap around from the last slot back to the first one)
+struct _ScanOrder
+{
+    uint8_t slots[N_MULTIPLEXERS];
+};
+
+static constexpr bool _config_matches(uint8_t slot, uint8_t pins)
+{
+    for (uint8_t p = 0; p < N_MULTIPLEXER_PINS; p++)
+        if (multiplexer_configs[slot][p] != static_cast<bool>((pins >> p) & 1)) return false;
+    return true;
+}
+
+static constexpr _ScanOrder _make_scan_order()
+{
+    _ScanOrder order = {};
+    for (uint8_t i = 0; i < N_MULTIPLEXERS; i++)
+    {
+        const uint8_t gray = i ^ (i >> 1);
+        for (uint8_t slot = 0; slot < N_MULTIPLEXERS; slot++)
+            if (_config_matches(slot, gray)) order.slots[i] = slot;
+    }
+    return order;
+}
+
+static constexpr bool _is_one_pin_per_hop(const _ScanOrder &order)
+{
+    for (uint8_t i = 0; i < N_MULTIPLEXERS; i++)
+    {
+        const uint8_t a = order.slots[i], b = order.slots[(i + 1) % N_MULTIPLEXERS];
+        uint8_t changes = 0;
+        for (uint8_t p = 0; p < N_MULTIPLEXER_PINS; p++)
+            changes += multiplexer_configs[a][p] != multiplexer_configs[b][p];
+        if (changes != 1) return false;
+    }
+    return true;
+}
+
+static constexpr _ScanOrder scan_order = _make_scan_order();
+static_assert(_is_one_pin_per_hop(scan_order), "multiplexer_configs should have every combination of the select pins");
+
 inline bool is_slot_valid(uint8_t slot)
 {
     return slot < N_MULTIPLEXERS;
@@ -32,11 +76,17 @@ inline bool is_slot_valid(uint8_t slot)
 void HX711_Mult::_set_slot(uint8_t slot)
 {
     if (_curr_slot == slot) return;
-    digitalWrite(_mult_pin_1, multiplexer_configs[slot][0]);
-    digitalWrite(_mult_pin_2, multiplexer_configs[slot][1]);
-    digitalWrite(_mult_pin_3, multiplexer_configs[slot][2]);
-    digitalWrite(_mult_pin_4, multiplexer_configs[slot][3]);
+    // only write the select pins that change
+    const bool all = _curr_slot < 0;
+    const bool *prev = multiplexer_configs[all ? 0 : _curr_slot];
+    const bool *next = multiplexer_configs[slot];
+    if (all || prev[0] != next[0]) digitalWrite(_mult_pin_1, next[0]);
+    if (all || prev[1] != next[1]) digitalWrite(_mult_pin_2, next[1]);
+    if (all || prev[2] != next[2]) digitalWrite(_mult_pin_3, next[2]);
+    if (all || prev[3] != next[3]) digitalWrite(_mult_pin_4, next[3]);
     _curr_slot = slot;
+    // frames already in the ring belong to the previous slot
+    _hx.flush();
 }
 
 HX711_Mult::HX711_Mult(pin_size_t mult_pin_1, pin_size_t mult_pin_2, pin_size_t mult_pin_3, pin_size_t mult_pin_4,
@@ -113,7 +163,7 @@ bool HX711_Mult::read_calib_stats(uint8_t slot, uint32_t n, float *mean, float *
     return res;
 }
 
-bool HX711_Mult::calib_offset(uint8_t slot, uint32_t n, uint32_t *resulting_n, uint32_t timeout_ms)
+bool HX711_Mult::read_raw_stats_adaptive(uint8_t slot, uint32_t n_max, float target_se, uint32_t deadline_ms, float *mean, float *stdev, float *se, uint32_t *resulting_n, uint32_t timeout_ms)
 {
     if (!is_slot_valid(slot))
     {
@@ -121,193 +171,373 @@ bool HX711_Mult::calib_offset(uint8_t slot, uint32_t n, uint32_t *resulting_n, u
         return false;
     }
     _set_slot(slot);
-    bool res = _hx.calib_offset(n, &_calibs[slot], resulting_n, timeout_ms);
+    bool res = _hx.read_raw_stats_adaptive(n_max, target_se, deadline_ms, mean, stdev, se, resulting_n, timeout_ms);
     if (!res)
     {
-        ERROR_PRINTLN("Error in HX711_Mult::calib_offset due to error in HX711::calib_offset");
+        ERROR_PRINTLN("Error in HX711_Mult::read_raw_stats_adaptive due to error in HX711::read_raw_stats_adaptive");
     }
     return res;
 }
 
-bool HX711_Mult::calib_slope(uint8_t slot, uint32_t n, float weight, float weight_error, uint32_t *resulting_n, uint32_t timeout_ms)
+bool HX711_Mult::read_calib_stats_adaptive(uint8_t slot, uint32_t n_max, float target_se, uint32_t deadline_ms, float *mean, float *stdev, float *se, uint32_t *resulting_n, uint32_t timeout_ms)
 {
     if (!is_slot_valid(slot))
     {
         ERROR_PRINTFLN("Slot %u is invalid. Slot should be in range [0,%u]", N_MULTIPLEXERS-1);
         return false;
     }
+    HX711Calibration *c = &_calibs[slot];
+    if (!c->set_offset || !c->set_slope)
+    {
+        ERROR_PRINTFLN("Cannot call HX711_Mult::read_calib_stats_adaptive when offset or slope is not set (slot %u)", slot);
+        return false;
+    }
     _set_slot(slot);
-    bool res = _hx.calib_slope(n, weight, weight_error, &_calibs[slot], resulting_n, timeout_ms);
+    bool res = _hx.read_calib_stats_adaptive(n_max, target_se, deadline_ms, c, mean, stdev, se, resulting_n, timeout_ms);
     if (!res)
     {
-        ERROR_PRINTLN("Error in HX711_Mult::calib_slope due to error in HX711::calib_slope");
+        ERROR_PRINTLN("Error in HX711_Mult::read_calib_stats_adaptive due to error in HX711::read_calib_stats_adaptive");
     }
     return res;
 }
 
-bool HX711_Mult::power_down(uint8_t slot, bool wait_until_power_off)
+bool HX711_Mult::calib_offset(uint8_t slot, uint32_t n, uint32_t *resulting_n, uint32_t timeout_ms)
 {
     if (!is_slot_valid(slot))
     {
         ERROR_PRINTFLN("Slot %u is invalid. Slot should be in range [0,%u]", N_MULTIPLEXERS-1);
         return false;
     }
-    _hx.power_off(wait_until_power_off);
-    return true;
+    _set_slot(slot);
+    // the estimate is in the units of the old calibration
+    _estimates[slot].valid = false;
+    _calibs[slot].slot = slot;
+    bool res = _hx.calib_offset(n, &_calibs[slot], resulting_n, timeout_ms);
+    if (!res)
+    {
+        ERROR_PRINTLN("Error in HX711_Mult::calib_offset due to error in HX711::calib_offset");
+    }
+    return res;
 }
 
-bool HX711_Mult::power_up(uint8_t slot)
+bool HX711_Mult::calib_slope(uint8_t slot, uint32_t n, float weight, float weight_error, uint32_t *resulting_n, uint32_t timeout_ms)
 {
     if (!is_slot_valid(slot))
     {
         ERROR_PRINTFLN("Slot %u is invalid. Slot should be in range [0,%u]", N_MULTIPLEXERS-1);
         return false;
     }
-    _hx.power_on();
-    return true;
+    _set_slot(slot);
+    // the estimate is in the units of the old calibration
+    _estimates[slot].valid = false;
+    bool res = _hx.calib_slope(n, weight, weight_error, &_calibs[slot], resulting_n, timeout_ms);
+    if (!res)
+    {
+        ERROR_PRINTLN("Error in HX711_Mult::calib_slope due to error in HX711::calib_slope");
+    }
+    return res;
 }
 
-
-bool HX711_Mult::load_calibration(JsonDocument *doc)
+int8_t HX711_Mult::next_slot(const bool *slots) const
 {
-    /*
-     It takes in a JsonDocument with the following structure
-     [
-        {
-            "r": <slot:uint8_t>,
-            "o": <offset:float>,
-            "p": <offset_error:float>,
-            "s": <slope:float>,
-            "t": <slope_error:float>
-        },
-        ...
-     ]
-
-     And populates de calibration array so that _calibs[x] points to the HX711Calibration for the slot x
-     */
-    JsonArray arr = doc->as<JsonArray>();
-    if (!arr)
-    {
-        ERROR_PRINTLN("Couldn't load calibrations: document wasn't a JsonArray");
-        return false;
+    uint8_t start = 0;
+    for (uint8_t i = 0; i < N_MULTIPLEXERS; i++)
+        if (scan_order.slots[i] == _curr_slot) start = i;
+    for (uint8_t i = 0; i < N_MULTIPLEXERS; i++)
+    {
+        const uint8_t slot = scan_order.slots[(start + i) % N_MULTIPLEXERS];
+        if (slots[slot]) return slot;
     }
+    return -1;
+}
 
-    size_t for_len = arr.size();
-    if (for_len > N_MULTIPLEXERS)
+bool HX711_Mult::scan(const bool *slots, uint32_t n, HX711ScanResult *results, bool calibrated, float target_se, uint32_t deadline_ms, uint32_t timeout_ms)
+{
+    if (n < 2)
     {
-        WARN_PRINTFLN("Calibrations array has %lu elements but there are only %lu multiplexed scales. Will only load first %lu calibrations",
-        for_len, N_MULTIPLEXERS, N_MULTIPLEXERS);
-        for_len = N_MULTIPLEXERS;
+        ERROR_PRINTFLN("Can't scan with n = %lu", n);
+        return false;
     }
 
-    // set_calibs keeps track of which slots have already been assigned a calibration
-    memset(_set_calibs, false, N_MULTIPLEXERS * sizeof(bool));
-
-    for (size_t i = 0; i < for_len; i++)
+    // slots to visit, in gray code order. start from the slot the multiplexer is already on
+    uint8_t visit[N_MULTIPLEXERS];
+    uint8_t n_visit = 0, start = 0;
+    for (uint8_t i = 0; i < N_MULTIPLEXERS; i++)
+        if (scan_order.slots[i] == _curr_slot) start = i;
+    for (uint8_t i = 0; i < N_MULTIPLEXERS; i++)
     {
-        JsonObject obj = arr[i].as<JsonObject>();
-        if (!obj)
+        const uint8_t slot = scan_order.slots[(start + i) % N_MULTIPLEXERS];
+        results[slot] = {.mean = 0, .stdev = 0, .se = 0, .n = 0, .n_discarded = 0, .n_rejected = 0, .ok = false, .dead = false};
+        if (!slots[slot]) continue;
+        if (calibrated && (!_calibs[slot].set_offset || !_calibs[slot].set_slope))
         {
-            WARN_PRINTFLN("The element %lu of the calibration array couldn't be loaded because it wasn't a JsonObject", i);
+            ERROR_PRINTFLN("Can't scan slot %u calibrated when its offset or slope is not set", slot);
             continue;
         }
+        // dead slots are only visited again once their backoff runs out
+        if (_health[slot].dead && millis() - _health[slot].retry_ms < _health[slot].backoff_ms)
+        {
+            results[slot].dead = true;
+            continue;
+        }
+        visit[n_visit++] = slot;
+    }
 
-        // check slot
-        if (!obj[HX711_CALIBRATION_JSON_KEY_SLOT].is<uint8_t>())
+    bool all_ok = true;
+    int32_t raw;
+    for (uint8_t v = 0; v < n_visit; v++)
+    {
+        const uint8_t slot = visit[v];
+        HX711ScanResult *res = &results[slot];
+        _set_slot(slot);
+        const absolute_time_t timeout_time = hx711_deadline(timeout_ms);
+
+        // the conversion running while we switched mixes both inputs, so the first frame is always thrown away. a
+        // connected converter delivers it within a couple of sample periods, which makes it a cheap presence check
+        if (!_hx.read_raw_single(&raw, HX711_PROBE_TIMEOUT_MS))
         {
-            WARN_PRINTFLN("The element %lu of the calibration array didn't have the key '%s' for the slot, so it will be skipped", i, HX711_CALIBRATION_JSON_KEY_SLOT);
+            _report_visit(slot, false);
+            res->dead = _health[slot].dead;
+            if (v + 1 < n_visit)
+                _set_slot(visit[v + 1]);
             continue;
         }
-        uint8_t slot = obj[HX711_CALIBRATION_JSON_KEY_SLOT].as<uint8_t>();
-        if (_set_calibs[slot])
+        ++res->n_discarded;
+        for (uint8_t i = 1; i < HX711_MULT_SETTLE_DISCARD && !time_reached(timeout_time); i++)
+        {
+            if (_hx.read_raw_single(&raw, hx711_ms_left(timeout_time)))
+                ++res->n_discarded;
+        }
+
+        // target in raw counts
+        float raw_target_se = target_se;
+        if (calibrated && _calibs[slot].slope != 0)
+            raw_target_se /= abs(_calibs[slot].slope);
+        const absolute_time_t deadline = make_timeout_time_ms(deadline_ms);
+
+        // a slot with a prior only needs a few samples to update it
+        const bool tracked = _tracking && calibrated && _estimates[slot].valid;
+        const uint32_t n_slot = tracked && n > HX711_TRACKER_N ? HX711_TRACKER_N : n;
+
+        Welfords::AggregateInt agg;
+        _hx.reset_outlier_filter();
+        for (uint32_t i = 0; i < n_slot; i++)
         {
-            WARN_PRINTFLN("The element %lu of the calibration array has the slot %u, but that slot has already been assigned a calibration. overriding with this calibration",
-            i, slot);
+            bool last = i == n_slot - 1;
+            if (_hx.read_raw_single(&raw, hx711_ms_left(timeout_time)) && _hx.accept_sample(raw))
+            {
+                Welfords::update(&agg, raw);
+                _noise[slot].update(raw);
+                if (target_se > 0 && agg.count >= HX711_ADAPTIVE_MIN_N && Welfords::standard_error_reached(&agg, raw_target_se))
+                    last = true;
+            }
+            if (target_se > 0 && deadline_ms > 0 && time_reached(deadline))
+                last = true;
+            if (time_reached(timeout_time))
+            {
+                WARN_PRINTFLN("Scan of slot %u timed out after %lu samples", slot, agg.count);
+                last = true;
+            }
+
+            // switch as soon as the last frame is clocked out, so the next slot starts settling right away
+            if (last)
+            {
+                if (v + 1 < n_visit)
+                    _set_slot(visit[v + 1]);
+                break;
+            }
         }
 
-        if (!_calibs[slot].from_json(&obj))
+        res->n_rejected = _hx.rejected();
+        float raw_mean, raw_stdev;
+        if (!Welfords::finalize(&agg, &raw_mean, &raw_stdev))
         {
-            WARN_PRINTFLN("Couldn't get calib from json for slot %u", slot);
+            ERROR_PRINTFLN("Couldn't finalize scan of slot %u because there weren't enough samples (%lu)", slot, agg.count);
+            _report_visit(slot, false);
+            res->dead = _health[slot].dead;
             continue;
         }
+        _report_visit(slot, true);
+        res->se = raw_stdev / sqrt(agg.count);
+        if (calibrated)
+        {
+            _calibs[slot].apply(raw_mean, raw_stdev, &res->mean, &res->stdev);
+            res->se *= abs(_calibs[slot].slope);
+        }
+        else
+        {
+            res->mean = raw_mean;
+            res->stdev = raw_stdev;
+        }
+        res->n = agg.count;
+        res->ok = true;
 
-        _set_calibs[slot] = true;
+        if (_tracking && calibrated)
+            _track(slot, res);
     }
 
-    return true;
+    for (uint8_t slot = 0; slot < N_MULTIPLEXERS; slot++)
+        if (slots[slot] && !results[slot].ok && !results[slot].dead) all_ok = false;
+    return all_ok;
 }
 
-bool HX711_Mult::load_calibration()
+void HX711_Mult::_track(uint8_t slot, const HX711ScanResult *res)
 {
-    File file;
+    HX711SlotEstimate *est = &_estimates[slot];
+    const unsigned long now = millis();
+    // variance of this visit's mean. a handful of identical samples would claim a perfect reading
+    float r = res->se * res->se;
+    if (r < 1e-12) r = 1e-12;
 
-    if (!SD_Helper::open_read(&file, HX711_SAVEFILE))
+    if (!est->valid)
     {
-        SD_Helper::close(&file);
-        ERROR_PRINTLN("HX711: Couldn't read file for reading");
-        return false;
+        (*est) = {.weight = res->mean, .variance = r, .last_ms = now, .valid = true};
+        return;
     }
 
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, file);
-    SD_Helper::close(&file);
-
-    if (error)
+    // predict: the weight is assumed constant, its uncertainty grows with the time since the last visit
+    const float p = est->variance + HX711_TRACKER_PROCESS_NOISE * ((now - est->last_ms) / 1000.0f);
+    const float innovation = res->mean - est->weight;
+    const float s = p + r;
+    if (innovation * innovation > HX711_TRACKER_GATE * HX711_TRACKER_GATE * s)
     {
-        ERROR_PRINTFLN("Can't load calibrations json: deserialization failed with error: '%s'", error.c_str());
-        return false;
+        DEBUG_PRINTFLN("Slot %u moved %.4f since the last visit, restarting its estimate", slot, innovation);
+        (*est) = {.weight = res->mean, .variance = r, .last_ms = now, .valid = true};
+        return;
     }
 
-    return load_calibration(&doc);
+    // update
+    const float k = p / s;
+    est->weight += k * innovation;
+    est->variance = (1 - k) * p;
+    est->last_ms = now;
 }
 
-bool HX711_Mult::load_calibration(const char *json)
+void HX711_Mult::_report_visit(uint8_t slot, bool ok)
 {
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, json);
-    
-    if (error)
+    HX711SlotHealth *h = &_health[slot];
+    if (ok)
     {
-        ERROR_PRINTFLN("Can't load calibrations json: deserialization failed with error: '%s'", error.c_str());
-        return false;
+        if (h->dead)
+            WARN_PRINTFLN("Slot %u is back", slot);
+        (*h) = HX711SlotHealth();
+        return;
     }
 
-    return load_calibration(&doc);
+    h->retry_ms = millis();
+    if (h->dead)
+    {
+        // failed re-probe
+        h->backoff_ms = h->backoff_ms < HX711_BREAKER_BACKOFF_MAX_MS / 2 ? 2 * h->backoff_ms : HX711_BREAKER_BACKOFF_MAX_MS;
+        return;
+    }
+    if (++h->failures >= HX711_BREAKER_FAILURES)
+    {
+        WARN_PRINTFLN("Slot %u failed %u times in a row, marking it dead", slot, h->failures);
+        h->dead = true;
+        h->backoff_ms = HX711_BREAKER_BACKOFF_MS;
+    }
 }
 
-bool HX711_Mult::save_calibration()
+bool HX711_Mult::probe(const bool *slots)
 {
-    JsonDocument doc;
-    JsonArray arr = doc.to<JsonArray>();
-
-    for (size_t i = 0; i < N_MULTIPLEXERS; i++)
+    bool all_present = true;
+    int32_t raw;
+    for (uint8_t i = 0; i < N_MULTIPLEXERS; i++)
     {
-        if (!_calibs[i].populated()) continue;
-        JsonDocument sub_doc;
-        JsonObject obj = sub_doc.to<JsonObject>();
-        _calibs[i].to_json(&obj);
-        arr.add(obj);
+        const uint8_t slot = scan_order.slots[i];
+        if (!slots[slot]) continue;
+        _set_slot(slot);
+        _health[slot] = HX711SlotHealth();
+        if (_hx.read_raw_single(&raw, HX711_PROBE_TIMEOUT_MS)) continue;
+
+        // nothing there, don't wait for the usual failures to give up on it
+        WARN_PRINTFLN("Slot %u didn't answer the presence probe", slot);
+        _health[slot] = {.failures = HX711_BREAKER_FAILURES, .dead = true, .backoff_ms = HX711_BREAKER_BACKOFF_MS, .retry_ms = millis()};
+        all_present = false;
     }
+    return all_present;
+}
 
+void HX711_Mult::reset_estimate(uint8_t slot)
+{
+    if (!is_slot_valid(slot)) return;
+    _estimates[slot].valid = false;
+    // the samples from before the jump would count as noise
+    _noise[slot].reset();
+}
 
-    File file;
+bool HX711_Mult::noise(uint8_t slot, float *stdev, bool calibrated)
+{
+    if (!is_slot_valid(slot)) return false;
+    float raw_mean, raw_stdev;
+    if (!_noise[slot].finalize(&raw_mean, &raw_stdev)) return false;
+    if (calibrated)
+    {
+        if (!_calibs[slot].set_slope) return false;
+        raw_stdev *= abs(_calibs[slot].slope);
+    }
+    (*stdev) = raw_stdev;
+    return true;
+}
 
-    if (!SD_Helper::open_write(&file, HX711_SAVEFILE))
+bool HX711_Mult::power_down(uint8_t slot, bool wait_until_power_off)
+{
+    if (!is_slot_valid(slot))
     {
-        SD_Helper::close(&file);
-        ERROR_PRINTLN("HX711_Mult: Couldn't write file");
+        ERROR_PRINTFLN("Slot %u is invalid. Slot should be in range [0,%u]", N_MULTIPLEXERS-1);
         return false;
     }
+    _hx.power_off(wait_until_power_off);
+    return true;
+}
+
+bool HX711_Mult::power_up(uint8_t slot)
+{
+    if (!is_slot_valid(slot))
+    {
+        ERROR_PRINTFLN("Slot %u is invalid. Slot should be in range [0,%u]", N_MULTIPLEXERS-1);
+        return false;
+    }
+    _hx.power_on();
+    return true;
+}
+
+
+bool HX711_Mult::load_calibration(JsonDocument *doc)
+{
+    for (uint8_t slot = 0; slot < N_MULTIPLEXERS; slot++)
+        _estimates[slot].valid = false;
+    return HX711Calibrations::from_json(doc, _calibs, _set_calibs, N_MULTIPLEXERS);
+}
 
-    size_t min_size = measureJson(arr);
-    size_t actual_size = serializeJson(arr, file);
-    SD_Helper::close(&file);
+bool HX711_Mult::load_calibration()
+{
+    for (uint8_t slot = 0; slot < N_MULTIPLEXERS; slot++)
+        _estimates[slot].valid = false;
+    return HX711Calibrations::load(HX711_SAVEFILE, _calibs, _set_calibs, N_MULTIPLEXERS);
+}
 
-    if (min_size < actual_size)
+bool HX711_Mult::load_calibration(const char *json)
+{
+    for (uint8_t slot = 0; slot < N_MULTIPLEXERS; slot++)
+        _estimates[slot].valid = false;
+    return HX711Calibrations::load(json, strlen(json), _calibs, _set_calibs, N_MULTIPLEXERS);
+}
+
+bool HX711_Mult::load_calibration(Stream *stream)
+{
+    JsonDocument doc(&json_pool);
+    DeserializationError error = deserializeJson(doc, *stream);
+    if (error)
     {
-        ERROR_PRINTFLN("Couldn't save calibrations: written %u bytes when the json was %u bytes long", actual_size, min_size);
+        ERROR_PRINTFLN("Couldn't deserialize calibration with error: '%s'", error.c_str());
         return false;
     }
+    return load_calibration(&doc);
+}
 
-    return true;
+bool HX711_Mult::save_calibration()
+{
+    return HX711Calibrations::save(HX711_SAVEFILE, _calibs, N_MULTIPLEXERS);
 }
\ No newline at end of file
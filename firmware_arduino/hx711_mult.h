@@ -5,6 +5,7 @@
 #include <ArduinoJson.h>
 #include "hx711.h"
 #include "defs.h"
+#include "welfords.h"
 
 #ifndef HX711_DEFAULT_TIMEOUT_MS
 #define HX711_DEFAULT_TIMEOUT_MS 5000
@@ -12,10 +13,76 @@
 
 #define HX711_SAVEFILE "HXCALIB.JSN"
 
+// number of frames thrown away after switching the multiplexer, while the converter's input settles
+#ifndef HX711_MULT_SETTLE_DISCARD
+#define HX711_MULT_SETTLE_DISCARD 1
+#endif
+
+// per slot weight tracker (scalar kalman filter), in calibrated units. process noise is the variance the weight gains
+// per second between visits (slow drift from transpiration)
+#ifndef HX711_TRACKER_PROCESS_NOISE
+#define HX711_TRACKER_PROCESS_NOISE 1e-4
+#endif
+// a reading further than this many sigmas from the prediction is a step change (watering, someone touching the pot)
+// and restarts the estimate from that reading
+#ifndef HX711_TRACKER_GATE
+#define HX711_TRACKER_GATE 4
+#endif
+// fresh samples taken per visit once a slot has a valid estimate
+#ifndef HX711_TRACKER_N
+#define HX711_TRACKER_N 8
+#endif
+
+// the noise level of every slot is tracked over its last HX711_NOISE_WINDOW samples, across scans
+#ifndef HX711_NOISE_WINDOW
+#define HX711_NOISE_WINDOW 32
+#endif
+
+// circuit breaker: a slot that fails this many visits in a row is marked dead and skipped. it is re-probed after
+// HX711_BREAKER_BACKOFF_MS, doubling after every failed probe up to HX711_BREAKER_BACKOFF_MAX_MS
+#ifndef HX711_BREAKER_FAILURES
+#define HX711_BREAKER_FAILURES 3
+#endif
+#ifndef HX711_BREAKER_BACKOFF_MS
+#define HX711_BREAKER_BACKOFF_MS 10000
+#endif
+#ifndef HX711_BREAKER_BACKOFF_MAX_MS
+#define HX711_BREAKER_BACKOFF_MAX_MS 600000
+#endif
+// a connected converter delivers a frame within a sample period (100ms at 10 SPS)
+#ifndef HX711_PROBE_TIMEOUT_MS
+#define HX711_PROBE_TIMEOUT_MS 300
+#endif
+
 #if N_MULTIPLEXERS <= 0
 #error "There should be at least 1 scale"
 #endif
 
+struct HX711ScanResult
+{
+    float mean, stdev, se;
+    uint32_t n;
+    uint32_t n_discarded; // frames taken before the input settled
+    uint32_t n_rejected; // frames dropped as outliers
+    bool ok;
+    bool dead; // skipped or given up by the circuit breaker
+};
+
+struct HX711SlotHealth
+{
+    uint8_t failures = 0; // consecutive failed visits
+    bool dead = false;
+    uint32_t backoff_ms = 0;
+    unsigned long retry_ms = 0; // last failure, the slot is retried backoff_ms after it
+};
+
+struct HX711SlotEstimate
+{
+    float weight, variance;
+    unsigned long last_ms;
+    bool valid = false;
+};
+
 class HX711_Mult
 {
 private:
@@ -24,8 +91,14 @@ private:
     int8_t _curr_slot = -1;
     HX711Calibration _calibs[N_MULTIPLEXERS];
     bool _set_calibs[N_MULTIPLEXERS];
+    HX711SlotEstimate _estimates[N_MULTIPLEXERS];
+    bool _tracking = false;
+    HX711SlotHealth _health[N_MULTIPLEXERS];
+    Welfords::AggregateWindow<HX711_NOISE_WINDOW> _noise[N_MULTIPLEXERS];
 
     void _set_slot(uint8_t slot);
+    void _track(uint8_t slot, const HX711ScanResult *res);
+    void _report_visit(uint8_t slot, bool ok);
 
 public:
     HX711_Mult(pin_size_t mult_pin_1, pin_size_t mult_pin_2, pin_size_t mult_pin_3, pin_size_t mult_pin_4,
@@ -35,18 +108,49 @@ public:
 
     void set_slot(uint8_t slot);
 
+    inline void set_outlier_rejection(bool enabled) { _hx.set_outlier_rejection(enabled); }
+    // samples rejected as outliers by the last read
+    inline uint32_t rejected() const { return _hx.rejected(); }
+
     bool read_raw_single(uint8_t slot, int32_t *raw, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
     bool read_raw_stats(uint8_t slot, uint32_t n, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
     bool read_calib_stats(uint8_t slot, uint32_t n, float *mean, float *stdev, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
+    bool read_raw_stats_adaptive(uint8_t slot, uint32_t n_max, float target_se, uint32_t deadline_ms, float *mean, float *stdev, float *se, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
+    bool read_calib_stats_adaptive(uint8_t slot, uint32_t n_max, float target_se, uint32_t deadline_ms, float *mean, float *stdev, float *se, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
 
     bool calib_offset(uint8_t slot, uint32_t n, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
     bool calib_slope(uint8_t slot, uint32_t n, float weight, float weight_error, uint32_t *resulting_n, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
 
+    // reads n samples from every slot flagged in slots (array of N_MULTIPLEXERS) in a single sweep and stores them in
+    // results[slot]. returns true if every requested slot that isn't dead could be read. timeout_ms bounds each visit.
+    // if target_se > 0 every slot stops early once its standard error reaches target_se (or deadline_ms passes for that slot)
+    // if tracking is enabled, calibrated scans feed every slot's reading into its estimate and slots with a valid estimate
+    // only take HX711_TRACKER_N fresh samples
+    bool scan(const bool *slots, uint32_t n, HX711ScanResult *results, bool calibrated=true, float target_se=0, uint32_t deadline_ms=0, uint32_t timeout_ms=HX711_DEFAULT_TIMEOUT_MS);
+    // the slot flagged in slots that scan would visit first, in its order from the slot the multiplexer is on. -1 if
+    // none is. to visit the slots one scan at a time, in the same order a single scan would
+    int8_t next_slot(const bool *slots) const;
+
+    // per slot weight estimate carried over between scans. reset it when the weight is changed on purpose (watering)
+    inline void set_tracking(bool enabled) { _tracking = enabled; }
+    void reset_estimate(uint8_t slot);
+    inline const HX711SlotEstimate *get_estimates() const { return (const HX711SlotEstimate *)_estimates; }
+
+    // stdev of the last HX711_NOISE_WINDOW samples of slot, without sampling again. false if there aren't enough yet
+    bool noise(uint8_t slot, float *stdev, bool calibrated=true);
+
+    // quick presence check of the flagged slots, one frame each. slots that don't answer start out dead.
+    // returns true if all of them answered
+    bool probe(const bool *slots);
+    inline const HX711SlotHealth *get_health() const { return (const HX711SlotHealth *)_health; }
+
     bool power_down(uint8_t slot, bool wait_until_power_off=false);
     bool power_up(uint8_t slot);
 
     bool load_calibration();
     bool load_calibration(const char *json);
+    // deserializes straight from the stream, e.g. a SmartPayloadStream
+    bool load_calibration(Stream *stream);
     bool load_calibration(JsonDocument *doc);
     bool save_calibration();
 
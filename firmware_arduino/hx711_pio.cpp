@@ -0,0 +1,181 @@
+#include "hx711_pio.h"
+#include "hx711_pio_program.h"
+
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <pico/time.h>
+#include "debug_helper.h"
+
+static const pio_program_t hx711_pio_program = {
+    .instructions = hx711_pio_instructions,
+    .length = HX711_PIO_PROGRAM_LEN,
+    .origin = -1,
+};
+
+HX711PIO *HX711PIO::_active = NULL;
+
+void HX711PIO::_irq_handler()
+{
+    // the irq is raised after the gain pulses, by then the DMA has long moved the frame into the ring
+    HX711PIO *self = _active;
+    if (!self || !pio_interrupt_get(self->_pio, self->_sm)) return;
+    pio_interrupt_clear(self->_pio, self->_sm);
+    __sev();
+}
+
+void HX711PIO::_load_gain()
+{
+    // the number of gain pulses is loaded into the osr, mov y, osr doesn't consume it
+    pio_sm_put_blocking(_pio, _sm, _gain_pulses - 1);
+    pio_sm_exec(_pio, _sm, pio_encode_pull(false, true));
+}
+
+uint32_t HX711PIO::_write_count() const
+{
+    // the channel counts down from 0xFFFFFFFF, which at 80Hz takes well over a year to run out
+    return 0xFFFFFFFF - dma_channel_hw_addr(_dma_chan)->transfer_count;
+}
+
+bool HX711PIO::begin(pin_size_t pin_sck, pin_size_t pin_dout, uint8_t gain_pulses)
+{
+    if (_running) return true;
+    if (_active)
+    {
+        ERROR_PRINTLN("Only one HX711PIO can be running at a time");
+        return false;
+    }
+    if (gain_pulses < 1 || gain_pulses > 3)
+    {
+        ERROR_PRINTFLN("HX711PIO: gain pulses should be in range [1,3] but were %u", gain_pulses);
+        return false;
+    }
+
+    // find a free state machine with room for the program
+    PIO pios[] = {pio0, pio1};
+    int sm = -1;
+    for (PIO p : pios)
+    {
+        if (!pio_can_add_program(p, &hx711_pio_program)) continue;
+        sm = pio_claim_unused_sm(p, false);
+        if (sm < 0) continue;
+        _pio = p;
+        break;
+    }
+    if (sm < 0)
+    {
+        ERROR_PRINTLN("HX711PIO: no free PIO state machine");
+        return false;
+    }
+    _sm = static_cast<uint>(sm);
+    _offset = pio_add_program(_pio, &hx711_pio_program);
+
+    _dma_chan = dma_claim_unused_channel(false);
+    if (_dma_chan < 0)
+    {
+        ERROR_PRINTLN("HX711PIO: no free DMA channel");
+        pio_remove_program(_pio, &hx711_pio_program, _offset);
+        pio_sm_unclaim(_pio, _sm);
+        return false;
+    }
+
+    // state machine. dout stays a SIO input so digitalRead and the ready interrupt keep working
+    pio_gpio_init(_pio, pin_sck);
+    pio_sm_set_consecutive_pindirs(_pio, _sm, pin_sck, 1, true);
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, _offset, _offset + HX711_PIO_PROGRAM_LEN - 1);
+    sm_config_set_sideset(&c, 1, false, false);
+    sm_config_set_sideset_pins(&c, pin_sck);
+    sm_config_set_in_pins(&c, pin_dout);
+    sm_config_set_in_shift(&c, false, true, 24); // shift left (MSB first), autopush every 24 bits
+    sm_config_set_clkdiv(&c, static_cast<float>(clock_get_hz(clk_sys)) / HX711_PIO_CLOCK_HZ);
+    pio_sm_init(_pio, _sm, _offset, &c);
+
+    _gain_pulses = gain_pulses;
+    _load_gain();
+
+    // dma from the rx fifo into the ring
+    dma_channel_config dc = dma_channel_get_default_config(_dma_chan);
+    channel_config_set_transfer_data_size(&dc, DMA_SIZE_32);
+    channel_config_set_read_increment(&dc, false);
+    channel_config_set_write_increment(&dc, true);
+    channel_config_set_ring(&dc, true, HX711_PIO_RING_BITS);
+    channel_config_set_dreq(&dc, pio_get_dreq(_pio, _sm, false));
+    dma_channel_configure(_dma_chan, &dc, _ring, &_pio->rxf[_sm], 0xFFFFFFFF, true);
+    _read_count = 0;
+
+    // irq to wake up readers
+    _active = this;
+    const uint irq = _pio == pio0 ? PIO0_IRQ_0 : PIO1_IRQ_0;
+    pio_set_irq0_source_enabled(_pio, static_cast<pio_interrupt_source>(pis_interrupt0 + _sm), true);
+    irq_add_shared_handler(irq, &HX711PIO::_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(irq, true);
+
+    pio_sm_set_enabled(_pio, _sm, true);
+    _running = true;
+    return true;
+}
+
+size_t HX711PIO::available()
+{
+    if (!_running) return 0;
+    uint32_t written = _write_count();
+    if (written - _read_count > HX711_PIO_RING_LEN)
+    {
+        // the reader fell behind and the dma overwrote the oldest frames
+        WARN_PRINTFLN("HX711PIO: dropped %lu frames", written - _read_count - HX711_PIO_RING_LEN);
+        _read_count = written - HX711_PIO_RING_LEN;
+    }
+    return written - _read_count;
+}
+
+bool HX711PIO::pop(int32_t *raw)
+{
+    if (!available()) return false;
+    (*raw) = hx711_frame_to_raw(_ring[_read_count % HX711_PIO_RING_LEN]);
+    ++_read_count;
+    return true;
+}
+
+bool HX711PIO::wait_pop(int32_t *raw, uint32_t timeout_ms)
+{
+    if (!_running) return false;
+    const absolute_time_t timeout_time = timeout_ms > 0 ? make_timeout_time_ms(timeout_ms) : at_the_end_of_time;
+    while (!pop(raw))
+    {
+        if (best_effort_wfe_or_timeout(timeout_time))
+        {
+            if (pop(raw)) return true;
+            WARN_PRINTLN("HX711PIO timed out waiting for a frame");
+            return false;
+        }
+    }
+    return true;
+}
+
+void HX711PIO::flush()
+{
+    if (!_running) return;
+    _read_count = _write_count();
+}
+
+void HX711PIO::pause(bool sck_high)
+{
+    if (!_running) return;
+    pio_sm_set_enabled(_pio, _sm, false);
+    _paused = true;
+    // drive SCK from the side-set of a single nop
+    pio_sm_exec(_pio, _sm, pio_encode_nop() | pio_encode_sideset(1, sck_high ? 1 : 0));
+}
+
+void HX711PIO::resume()
+{
+    if (!_running || !_paused) return;
+    // start over from the beginning of the frame, dropping any half clocked frame
+    pio_sm_clear_fifos(_pio, _sm);
+    pio_sm_restart(_pio, _sm);
+    pio_sm_exec(_pio, _sm, pio_encode_jmp(_offset) | pio_encode_sideset(1, 0));
+    _load_gain();
+    pio_sm_set_enabled(_pio, _sm, true);
+    _paused = false;
+}
@@ -0,0 +1,77 @@
+#ifndef _HX711_PIO_H_
+#define _HX711_PIO_H_
+
+#include <Arduino.h>
+#include <hardware/pio.h>
+
+/*
+ * Clocks the HX711 out with a PIO state machine. The program waits for DOUT to go low, generates the 24 SCK pulses
+ * shifting DOUT into the ISR (autopushed at 24 bits), generates the gain pulses and raises a PIO irq so a sleeping reader
+ * wakes up. A DMA channel moves every finished frame from the RX FIFO into a ring in RAM, so the CPU never touches
+ * individual bits. The reader only consumes frames from the ring.
+ *
+ * The program, in pioasm syntax (side-set drives SCK):
+ *
+ *     .program hx711
+ *     .side_set 1
+ *     .wrap_target
+ *         set x, 23           side 0
+ *         wait 0 pin 0        side 0
+ *     bitloop:
+ *         nop                 side 1 [2]
+ *         in pins, 1          side 0 [1]
+ *         jmp x-- bitloop     side 0
+ *         mov y, osr          side 0      ; osr holds gain pulses - 1, pulled once at start up
+ *     gainloop:
+ *         nop                 side 1 [2]
+ *         jmp y-- gainloop    side 0 [2]
+ *         irq nowait 0 rel    side 0
+ *     .wrap
+ *
+ * With HX711_PIO_CLOCK_HZ at 1MHz SCK is high for 3us per bit, well between the 0.2us minimum and the 60us that
+ * would power the converter down.
+ */
+
+#define HX711_PIO_CLOCK_HZ 1000000
+// the DMA ring wraps on a power of two number of bytes
+#define HX711_PIO_RING_BITS 6
+#define HX711_PIO_RING_BYTES (1 << HX711_PIO_RING_BITS)
+#define HX711_PIO_RING_LEN (HX711_PIO_RING_BYTES / sizeof(uint32_t))
+
+// a frame is 24 bits in two's complement, MSB first
+static inline int32_t hx711_frame_to_raw(uint32_t frame)
+{
+    return static_cast<int32_t>(frame << 8) >> 8;
+}
+
+class HX711PIO
+{
+private:
+    alignas(HX711_PIO_RING_BYTES) volatile uint32_t _ring[HX711_PIO_RING_LEN];
+    PIO _pio = NULL;
+    uint _sm = 0, _offset = 0;
+    int _dma_chan = -1;
+    uint8_t _gain_pulses = 1;
+    uint32_t _read_count = 0;
+    bool _running = false, _paused = false;
+
+    static HX711PIO *_active;
+    static void _irq_handler();
+
+    uint32_t _write_count() const;
+    void _load_gain();
+
+public:
+    bool begin(pin_size_t pin_sck, pin_size_t pin_dout, uint8_t gain_pulses);
+    inline bool running() const { return _running; }
+
+    size_t available();
+    bool pop(int32_t *raw);
+    bool wait_pop(int32_t *raw, uint32_t timeout_ms);
+    void flush();
+
+    void pause(bool sck_high);
+    void resume();
+};
+
+#endif /* _HX711_PIO_H_ */
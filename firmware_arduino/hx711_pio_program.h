@@ -0,0 +1,32 @@
+#ifndef _HX711_PIO_PROGRAM_H_
+#define _HX711_PIO_PROGRAM_H_
+
+// the instructions of the program described in hx711_pio.h, kept apart from HX711PIO so the host tests can run them
+// through a model of the state machine (tests/test_hx711_pio.cpp)
+
+#include <hardware/pio_instructions.h>
+
+#define HX711_PIO_PROGRAM_LEN 9
+#define HX711_PIO_BITLOOP 2
+#define HX711_PIO_GAINLOOP 6
+
+// side-set is 1 bit and not optional, so every instruction carries the SCK level
+static inline uint16_t _sck(uint instr, uint sck, uint delay=0)
+{
+    return static_cast<uint16_t>(instr | pio_encode_sideset(1, sck) | pio_encode_delay(delay));
+}
+
+// jmp targets are relative to the start of the program, pio_add_program relocates them
+static const uint16_t hx711_pio_instructions[HX711_PIO_PROGRAM_LEN] = {
+    _sck(pio_encode_set(pio_x, 23), 0),
+    _sck(pio_encode_wait_pin(false, 0), 0),
+    _sck(pio_encode_nop(), 1, 2),                                   // bitloop
+    _sck(pio_encode_in(pio_pins, 1), 0, 1),
+    _sck(pio_encode_jmp_x_dec(HX711_PIO_BITLOOP), 0),
+    _sck(pio_encode_mov(pio_y, pio_osr), 0),
+    _sck(pio_encode_nop(), 1, 2),                                   // gainloop
+    _sck(pio_encode_jmp_y_dec(HX711_PIO_GAINLOOP), 0, 2),
+    _sck(pio_encode_irq_set(true, 0), 0),
+};
+
+#endif /* _HX711_PIO_PROGRAM_H_ */
@@ -0,0 +1,57 @@
+#include "json_pool.h"
+#include "debug_helper.h"
+
+JsonPool json_pool;
+
+size_t JsonPool::_block_size(const void *ptr) const
+{
+    if (_small.owns(ptr)) return sizeof(SmallBlock);
+    if (_large.owns(ptr)) return sizeof(LargeBlock);
+    return 0;
+}
+
+void *JsonPool::allocate(size_t size)
+{
+    void *ptr = NULL;
+    if (size <= sizeof(SmallBlock)) ptr = _small.alloc();
+    // a string can take a large block when the small ones run out
+    if (!ptr && size <= sizeof(LargeBlock)) ptr = _large.alloc();
+    if (ptr) return ptr;
+
+    ++_heap_fallbacks;
+    return malloc(size);
+}
+
+void JsonPool::deallocate(void *ptr)
+{
+    // a block freed twice mustn't end up in free() either
+    bool freed;
+    if (_small.owns(ptr)) freed = _small.free(reinterpret_cast<SmallBlock *>(ptr));
+    else if (_large.owns(ptr)) freed = _large.free(reinterpret_cast<LargeBlock *>(ptr));
+    else
+    {
+        free(ptr);
+        return;
+    }
+    if (!freed) ERROR_PRINTLN("Json pool block freed twice");
+}
+
+void *JsonPool::reallocate(void *ptr, size_t new_size)
+{
+    if (!ptr) return allocate(new_size);
+
+    const size_t block_size = _block_size(ptr);
+    if (block_size == 0)
+    {
+        // started on the heap, stays there
+        return realloc(ptr, new_size);
+    }
+    // shrinking, or growing a string inside the block it already has
+    if (new_size <= block_size) return ptr;
+
+    void *new_ptr = allocate(new_size);
+    if (!new_ptr) return NULL;
+    memcpy(new_ptr, ptr, block_size);
+    deallocate(ptr);
+    return new_ptr;
+}
@@ -0,0 +1,57 @@
+#ifndef _JSON_POOL_H_
+#define _JSON_POOL_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "Pool.h"
+
+// strings (and the small arrays ArduinoJson keeps of its pools) go in the small blocks, the slot pools of the
+// documents go in the large ones. ARDUINOJSON_POOL_CAPACITY slots of 8 to 16 bytes each have to fit a large block
+#ifndef JSON_POOL_SMALL_BLOCK
+#define JSON_POOL_SMALL_BLOCK 64
+#endif
+#ifndef JSON_POOL_SMALL_N
+#define JSON_POOL_SMALL_N 32
+#endif
+#ifndef JSON_POOL_LARGE_BLOCK
+#define JSON_POOL_LARGE_BLOCK 1024
+#endif
+#ifndef JSON_POOL_LARGE_N
+#define JSON_POOL_LARGE_N 6
+#endif
+
+/*
+ * ArduinoJson allocator backed by two fixed-block pools, so the documents of the command handlers don't allocate
+ * from the heap every time a command comes in. `JsonDocument doc(&json_pool);`
+ *
+ * A request that doesn't fit a block, or finds its pool empty, still goes to the heap so the document doesn't fail.
+ * heap_fallbacks() counts them, together with the high water marks it tells if the pools are big enough.
+ * It's not thread safe, only use it from the core that runs the commands.
+ */
+class JsonPool : public ArduinoJson::Allocator
+{
+private:
+    struct alignas(8) SmallBlock { uint8_t data[JSON_POOL_SMALL_BLOCK]; };
+    struct alignas(8) LargeBlock { uint8_t data[JSON_POOL_LARGE_BLOCK]; };
+
+    Pool<SmallBlock, JSON_POOL_SMALL_N> _small;
+    Pool<LargeBlock, JSON_POOL_LARGE_N> _large;
+    uint32_t _heap_fallbacks = 0;
+
+    size_t _block_size(const void *ptr) const;
+
+public:
+    void *allocate(size_t size) override;
+    void deallocate(void *ptr) override;
+    void *reallocate(void *ptr, size_t new_size) override;
+
+    inline uint32_t heap_fallbacks() const { return _heap_fallbacks; }
+    inline size_t small_high_water() const { return _small.high_water(); }
+    inline size_t large_high_water() const { return _large.high_water(); }
+    inline size_t in_use() const { return _small.in_use() + _large.in_use(); }
+};
+
+extern JsonPool json_pool;
+
+#endif /* _JSON_POOL_H_ */
@@ -0,0 +1,244 @@
+#include "json_reply.h"
+
+#include <math.h>
+
+JsonReply::JsonReply(Stream *stream, const char *cmd, Kind kind)
+: _stream(stream)
+{
+    _put("{");
+    if (kind == Kind::SUCCESS) _put("\"success\":true,");
+    else if (kind == Kind::ERR) _put("\"err\":true,");
+    _key("cmd");
+    _value(cmd);
+}
+
+void JsonReply::_flush()
+{
+    if (_len == 0) return;
+    _stream->write(reinterpret_cast<const uint8_t *>(_buf), _len);
+    _len = 0;
+}
+
+size_t JsonReply::write(uint8_t c)
+{
+    if (_len == JSON_REPLY_LEN) _flush();
+    _buf[_len++] = c;
+    return 1;
+}
+
+size_t JsonReply::write(const uint8_t *buffer, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        write(buffer[i]);
+    return size;
+}
+
+void JsonReply::_put(const char *s)
+{
+    while (*s) write(*(s++));
+}
+
+void JsonReply::_separate()
+{
+    if (_comma) write(',');
+    _comma = true;
+}
+
+void JsonReply::_key(const char *key)
+{
+    _separate();
+    _value(key);
+    write(':');
+}
+
+void JsonReply::_value(const char *s)
+{
+    if (!s)
+    {
+        _put("null");
+        return;
+    }
+    static const char hex[] = "0123456789abcdef";
+    write('"');
+    for (; *s; s++)
+    {
+        const char c = *s;
+        switch (c)
+        {
+        case '"': _put("\\\""); break;
+        case '\\': _put("\\\\"); break;
+        case '\n': _put("\\n"); break;
+        case '\r': _put("\\r"); break;
+        case '\t': _put("\\t"); break;
+        default:
+            if (static_cast<uint8_t>(c) < 0x20)
+            {
+                _put("\\u00");
+                write(hex[c >> 4]);
+                write(hex[c & 0xF]);
+            }
+            else
+                write(c);
+        }
+    }
+    write('"');
+}
+
+void JsonReply::_value(bool b)
+{
+    _put(b ? "true" : "false");
+}
+
+void JsonReply::_value_uint(uint64_t u)
+{
+    // printf can't do 64 bit integers on every board
+    char digits[21];
+    char *p = digits + sizeof(digits);
+    *(--p) = '\0';
+    do
+    {
+        *(--p) = '0' + (u % 10);
+        u /= 10;
+    } while (u);
+    _put(p);
+}
+
+void JsonReply::_value_int(int64_t i)
+{
+    if (i < 0)
+    {
+        write('-');
+        _value_uint(-static_cast<uint64_t>(i));
+    }
+    else
+        _value_uint(i);
+}
+
+void JsonReply::_fixed(double d, uint8_t decimals, bool trim)
+{
+    // like Print::printFloat, without going through printf. d*10^decimals has to fit 64 bits
+    if (d < 0)
+    {
+        write('-');
+        d = -d;
+    }
+    uint64_t scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+    // rounded as a whole, so 0.99999 with 4 decimals is 1.0000 and not 0.10000
+    const uint64_t fixed = static_cast<uint64_t>(d * scale + 0.5);
+    _value_uint(fixed / scale);
+
+    char frac[JSON_REPLY_MAX_DECIMALS];
+    uint8_t n = 0;
+    uint64_t rest = fixed % scale;
+    for (uint64_t div = scale / 10; div > 0; div /= 10)
+    {
+        frac[n++] = '0' + rest / div;
+        rest %= div;
+    }
+    if (trim)
+        while (n > 0 && frac[n-1] == '0') --n;
+    if (n == 0) return;
+    write('.');
+    write(reinterpret_cast<const uint8_t *>(frac), n);
+}
+
+void JsonReply::_value(double d)
+{
+    // 7 significant digits, what a float has. very big and very small values get an exponent, like ArduinoJson does.
+    // json has no nan or inf
+    if (isnan(d) || isinf(d))
+    {
+        _put("null");
+        return;
+    }
+    if (d == 0)
+    {
+        write('0');
+        return;
+    }
+
+    const double mag = fabs(d);
+    int16_t exp = floor(log10(mag));
+    if (exp >= -5 && exp < 7)
+    {
+        _fixed(d, 6 - exp, true);
+        return;
+    }
+
+    double mantissa = d / pow(10, exp);
+    // 9.9999999 would round up to 10.000000
+    if (fabs(mantissa) * 1e6 + 0.5 >= 1e7)
+    {
+        mantissa /= 10;
+        ++exp;
+    }
+    _fixed(mantissa, 6, true);
+    write('e');
+    _value_int(exp);
+}
+
+void JsonReply::_value(JsonVariantConst v)
+{
+    serializeJson(v, *this);
+}
+
+JsonReply &JsonReply::add(const char *key, double value, uint8_t decimals)
+{
+    _key(key);
+    if (decimals > JSON_REPLY_MAX_DECIMALS) decimals = JSON_REPLY_MAX_DECIMALS;
+    if (isnan(value) || isinf(value) || fabs(value) * pow(10, decimals) >= 1e18)
+        _value(value);
+    else
+        _fixed(value, decimals, false);
+    return *this;
+}
+
+JsonReply &JsonReply::add(JsonObjectConst obj)
+{
+    for (JsonPairConst kv : obj)
+    {
+        _key(kv.key().c_str());
+        _value(kv.value());
+    }
+    return *this;
+}
+
+JsonReply &JsonReply::begin_array(const char *key)
+{
+    _key(key);
+    write('[');
+    _comma = false;
+    return *this;
+}
+
+JsonReply &JsonReply::end_array()
+{
+    write(']');
+    _comma = true;
+    return *this;
+}
+
+JsonReply &JsonReply::begin_object(const char *key)
+{
+    if (key) _key(key);
+    else _separate();
+    write('{');
+    _comma = false;
+    return *this;
+}
+
+JsonReply &JsonReply::end_object()
+{
+    write('}');
+    _comma = true;
+    return *this;
+}
+
+void JsonReply::send()
+{
+    if (_sent) return;
+    _sent = true;
+    _put("}\n");
+    _flush();
+}
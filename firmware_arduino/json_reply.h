@@ -0,0 +1,99 @@
+#ifndef _JSON_REPLY_H_
+#define _JSON_REPLY_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include <type_traits>
+
+#ifndef JSON_REPLY_LEN
+#define JSON_REPLY_LEN 256 // the replies of the commands fit, longer ones take more than one write
+#endif
+#define JSON_REPLY_MAX_DECIMALS 12
+
+/*
+ * Writes the json reply of a command into a buffer that lives with it (on the stack of the command), and sends it
+ * with a single write when it's done, so a reply is one usb packet instead of one per printf and nothing is
+ * allocated. Keys and string values are escaped.
+ *
+ *     JsonReply(stream, cmd).add("slot", slot).add("mean", mean).send();
+ *     // {"success":true,"cmd":"hx","slot":2,"mean":1.2345}
+ *
+ * Arrays and objects are opened and closed explicitly, their elements go in with item(). A reply that outgrows the
+ * buffer isn't cut, the full buffer is written and it goes on. It's sent at the latest when it goes out of scope.
+ * Values from ArduinoJson (add(key, variant), add(obj)) are serialized straight into the buffer, it's a Print for that.
+ */
+class JsonReply : public Print
+{
+public:
+    enum class Kind
+    {
+        SUCCESS, // {"success":true,"cmd":..
+        ERR,     // {"err":true,"cmd":..
+        INFO     // {"cmd":..
+    };
+
+private:
+    Stream *const _stream;
+    char _buf[JSON_REPLY_LEN];
+    size_t _len = 0;
+    bool _comma = false; // a value was written at this level, the next one needs a ','
+    bool _sent = false;
+
+    void _flush();
+    void _put(const char *s);
+    void _key(const char *key);
+    void _separate();
+
+    void _value(const char *s);
+    void _value(bool b);
+    void _value(double d);
+    void _fixed(double d, uint8_t decimals, bool trim);
+    void _value(JsonVariantConst v);
+    void _value_int(int64_t i);
+    void _value_uint(uint64_t u);
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type _value(T i)
+    {
+        if (std::is_signed<T>::value) _value_int(i);
+        else _value_uint(i);
+    }
+
+public:
+    JsonReply(Stream *stream, const char *cmd, Kind kind=Kind::SUCCESS);
+    ~JsonReply() { send(); }
+
+    template <typename T>
+    JsonReply &add(const char *key, T value)
+    {
+        _key(key);
+        _value(value);
+        return *this;
+    }
+    // floats have 7 significant digits, unless they're given a fixed number of decimals
+    JsonReply &add(const char *key, double value, uint8_t decimals);
+    // every member of obj, as if they were added one by one
+    JsonReply &add(JsonObjectConst obj);
+
+    template <typename T>
+    JsonReply &item(T value)
+    {
+        _separate();
+        _value(value);
+        return *this;
+    }
+
+    JsonReply &begin_array(const char *key);
+    JsonReply &end_array();
+    JsonReply &begin_object(const char *key=NULL); // without key inside an array
+    JsonReply &end_object();
+
+    // closes the reply and writes it. only the first call does something
+    void send();
+
+    // raw bytes, for serializeJson. use add() and item() instead, they take care of the commas
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+};
+
+#endif /* _JSON_REPLY_H_ */
@@ -4,6 +4,7 @@
 #include "sd_helper.h"
 #include "defs.h"
 #include "debug_helper.h"
+#include "json_pool.h"
 
 // RunData::RunData()
 // {
@@ -156,7 +157,7 @@ bool RunData::set_data(JsonDocument *doc)
 bool RunData::set_data(const char *json_str)
 {
     // get a json string and extract the run data from it
-    JsonDocument doc;
+    JsonDocument doc(&json_pool);
     DeserializationError error = deserializeJson(doc, json_str);
     if (error)
     {
@@ -170,7 +171,7 @@ bool RunData::set_data(const char *json_str)
 bool RunData::set_data(Stream *stream)
 {
     // get a json string and extract the run data from it
-    JsonDocument doc;
+    JsonDocument doc(&json_pool);
     DeserializationError error = deserializeJson(doc, *stream);
     if (error)
     {
@@ -217,7 +218,7 @@ bool RunData::get_data(JsonObject *obj) const
 
 bool RunData::save() const
 {
-    JsonDocument doc;
+    JsonDocument doc(&json_pool);
     JsonObject obj = doc.to<JsonObject>();
 
     if (!get_data(&obj))
@@ -0,0 +1,26 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+// timing for the host benchmarks. the numbers only compare variants on the same machine, the RP2040 is a lot slower
+
+#include <stdio.h>
+#include <chrono>
+
+// ns per iteration of f, which runs iterations times
+template <typename F>
+static double bench_ns(size_t iterations, F f)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    f(iterations);
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+// keeps the compiler from optimizing away a result
+template <typename T>
+static inline void bench_keep(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#endif /* _BENCH_H_ */
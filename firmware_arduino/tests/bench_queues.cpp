@@ -0,0 +1,97 @@
+// push + pop of a LogData sized entry through QueueFIFO, in ns per entry, for a power of two length (masked indices),
+// other lengths (compare and branch) and the ring as it was before both: compare and branch indices and a memcpy per
+// entry. an x86 compiler inlines a fixed size memcpy as well as an assignment, the difference is on the cortex-m0+
+
+#include "Queues.h"
+#include "bench.h"
+
+#define BENCH_ITERATIONS 20000000
+#define BENCH_BURST 8 // entries pushed before they're popped, so the indices wrap at every length
+
+// like LogData in firmware_arduino.ino
+struct LogEntry
+{
+    const char *timestamp;
+    uint8_t slot;
+    float mean, stdev;
+    uint32_t resulting_n;
+    float hum, temp, pres;
+    bool watered, finished_protocol;
+    uint8_t protocol_step;
+};
+
+// push_back and pop_front of DequeBase before the masks and the assignment
+template <typename T, size_t N>
+class MemcpyRing
+{
+private:
+    T _data[N];
+    size_t _front = 0, _back = 0, _size = 0;
+
+public:
+    bool push(const T *const entry)
+    {
+        if (_size == 0)
+        {
+            _back = _front;
+            memcpy(_data + _front, entry, sizeof(T));
+            ++_size;
+            return true;
+        }
+        if (_size == N) return false;
+        _back = _back < N - 1 ? _back + 1 : 0;
+        memcpy(_data + _back, entry, sizeof(T));
+        ++_size;
+        return true;
+    }
+
+    bool pop(T *entry)
+    {
+        if (_size == 0) return false;
+        memcpy(entry, _data + _front, sizeof(T));
+        _front = _front < N - 1 ? _front + 1 : 0;
+        --_size;
+        return true;
+    }
+};
+
+template <typename Q>
+static double bench_queue(Q *q)
+{
+    LogEntry in = {"2024-01-01T00:00:00", 3, 1.0f, 0.1f, 50, 40.0f, 21.0f, 1013.0f, false, false, 2}, out;
+    return bench_ns(BENCH_ITERATIONS, [&](size_t n) {
+        for (size_t i = 0; i < n; i += BENCH_BURST)
+        {
+            for (size_t k = 0; k < BENCH_BURST; k++)
+            {
+                in.resulting_n = i + k;
+                q->push(&in);
+            }
+            for (size_t k = 0; k < BENCH_BURST; k++)
+            {
+                q->pop(&out);
+                bench_keep(out.resulting_n);
+            }
+        }
+    });
+}
+
+template <size_t N>
+static void bench()
+{
+    static QueueFIFO<LogEntry, N> fifo(false);
+    static MemcpyRing<LogEntry, N> ring;
+    const double fifo_ns = bench_queue(&fifo);
+    const double ring_ns = bench_queue(&ring);
+    printf("N=%2zu%s  QueueFIFO %5.2f ns  memcpy ring %5.2f ns  (push+pop of %zu bytes)\n", N,
+           (N & (N - 1)) == 0 ? " (pow2)" : "       ", fifo_ns, ring_ns, sizeof(LogEntry));
+}
+
+int main()
+{
+    bench<16>();
+    bench<32>();
+    bench<31>();
+    bench<50>();
+    return 0;
+}
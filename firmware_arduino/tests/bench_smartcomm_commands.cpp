@@ -0,0 +1,104 @@
+// dispatching a line to one of 96 commands (command_set.h, colliding names included): SmartComm::tick with the hash
+// table against the same tick with the scan of the commands array it replaced, in ns per line. both read the line and
+// split it the same way, the difference is the lookup
+
+#include "command_set.h"
+#include "bench.h"
+
+#include <stdio.h>
+
+#define BENCH_ROUNDS 20000
+
+static uint32_t calls = 0;
+static void cmd_cb(Stream *, const SmartCmdArguments *, const char *) { ++calls; }
+static void default_cb(Stream *, const char *) { ++calls; }
+
+// SmartComm::tick as it was before the table, text mode only
+class ScanComm
+{
+private:
+    Stream *const _stream;
+    const SmartCmdBase *const *const _cmds;
+    char _buffer[STREAM_BUFFER_LEN+1];
+    SmartTokenizer _tokenizer;
+
+public:
+    ScanComm(const SmartCmdBase *const *cmds, Stream &stream)
+    : _stream(&stream), _cmds(cmds), _tokenizer(_buffer, STREAM_BUFFER_LEN, '\n', ' ') {}
+
+    void tick()
+    {
+        while (_stream->available())
+        {
+            const char c = _stream->read();
+            if (c != '\n')
+            {
+                _tokenizer.push(c);
+                continue;
+            }
+            if (_tokenizer.finish())
+            {
+                const SmartCmdBase *sc = NULL;
+                for (_smart_comm_size_t i = 0; i < COMMAND_SET_N; i++)
+                {
+                    if (!_cmds[i]) continue;
+                    if (_cmds[i]->is_command(_tokenizer.command))
+                    {
+                        sc = _cmds[i];
+                        break;
+                    }
+                }
+                if (sc)
+                {
+                    const SmartCmdArguments args(_tokenizer.nArgs, _tokenizer.args);
+                    sc->callback(_stream, &args);
+                }
+                else
+                    default_cb(_stream, _tokenizer.command);
+            }
+            _tokenizer.reset();
+        }
+    }
+};
+
+template <typename Comm>
+static double bench_lines(Comm &comm, StubStream &serial, const std::string &lines, size_t n_lines)
+{
+    serial.input = lines;
+    return bench_ns(n_lines * BENCH_ROUNDS, [&](size_t) {
+        for (size_t r = 0; r < BENCH_ROUNDS; r++)
+        {
+            serial.pos = 0;
+            comm.tick();
+        }
+    });
+}
+
+static void bench(const char *name, const CommandSet &set, const std::vector<std::string> &words)
+{
+    std::string lines;
+    for (const std::string &word : words) lines += word + " 250 50 true\n";
+
+    StubStream serial;
+    CommandSetComm table(set.cmds, serial, '\n', ' ', default_cb);
+    ScanComm scan(set.cmds, serial);
+    calls = 0;
+    const double table_ns = bench_lines(table, serial, lines, words.size());
+    const double scan_ns = bench_lines(scan, serial, lines, words.size());
+    if (calls != 2 * words.size() * BENCH_ROUNDS) printf("lost lines\n");
+    printf("%-36s table %7.1f ns  scan %7.1f ns  per line\n", name, table_ns, scan_ns);
+}
+
+int main()
+{
+    static CommandSet set(cmd_cb);
+
+    bench("every command once", set, set.names);
+    bench("the colliding names", set, std::vector<std::string>(set.names.begin(), set.names.begin() + 21));
+    bench("the first command", set, {set.names[0]});
+    bench("the last command", set, {set.names[COMMAND_SET_N - 2]});
+    std::vector<std::string> unknown = set.missing;
+    unknown.push_back("nocommand");
+    bench("unknown, on used slots too", set, unknown);
+    return 0;
+}
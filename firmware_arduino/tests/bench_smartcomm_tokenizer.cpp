@@ -0,0 +1,63 @@
+// __extractArguments, the single pass tokenizer against the multi pass one it replaced, in ns per line and per char: a
+// usual command, a full line of STREAM_BUFFER_LEN, and a long line full of separator runs, where the old one memmoved the
+// rest of the line once per run
+
+#include "SmartComm.h"
+#include "old_tokenizer.h"
+#include "bench.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#define BENCH_CHARS 40000000 // about the same work for every line
+
+template <typename F>
+static double bench_line(const std::string &line, F extract)
+{
+    // room for the old memmove to read past the '\0'
+    std::vector<char> buffer(2 * line.size() + 1);
+    const size_t iterations = BENCH_CHARS / line.size() + 1;
+    return bench_ns(iterations, [&](size_t n) {
+        for (size_t i = 0; i < n; i++)
+        {
+            memcpy(buffer.data(), line.c_str(), line.size() + 1);
+            char *command;
+            char *args[MAX_ARGUMENTS];
+            _smart_comm_size_t nArgs;
+            bench_keep(extract(buffer.data(), '\n', ' ', command, args, nArgs));
+            bench_keep(nArgs);
+        }
+    });
+}
+
+static void bench(const char *name, const std::string &line)
+{
+    const double now = bench_line(line, __extractArguments);
+    const double old = bench_line(line, old_tokenizer::__extractArguments);
+    printf("%-24s %5zu chars  single pass %8.1f ns (%.2f ns/char)  old %9.1f ns (%.2f ns/char)\n", name, line.size(),
+        now, now / line.size(), old, old / line.size());
+}
+
+int main()
+{
+    bench("command", "hx 2 100 true");
+
+    std::mt19937 rng(20);
+    std::string full;
+    while (full.size() < STREAM_BUFFER_LEN)
+        full += (full.empty() ? "" : " ") + std::to_string(rng() % 100000);
+    full.resize(STREAM_BUFFER_LEN);
+    bench("full buffer", full);
+
+    // runs of 1 to 8 separators between short words
+    std::string runs;
+    while (runs.size() < 4095)
+    {
+        runs += std::string(rng() % 8 + 1, ' ');
+        runs += std::string(rng() % 4 + 1, 'a' + rng() % 26);
+    }
+    runs.resize(4095);
+    bench("separator runs", runs);
+    return 0;
+}
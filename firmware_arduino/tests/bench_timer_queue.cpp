@@ -0,0 +1,54 @@
+// schedule + pop of TimerQueue at 16 to 256 pending timers, the heap stays full the whole time
+
+#include "TimerQueue.h"
+#include "bench.h"
+
+#include <random>
+
+#define BENCH_ITERATIONS 2000000
+
+template <size_t N>
+static void bench()
+{
+    static TimerQueue<uint32_t, N> q;
+    std::mt19937 rng(N);
+    uint32_t v = 0;
+    for (size_t i = 0; i < N; i++) q.schedule(rng() % 10000, &v);
+    // deadlines drawn ahead of time, so the timing is the queue's and not the generator's
+    static uint32_t steps[4096];
+    for (uint32_t &s : steps) s = rng() % 10000;
+
+    const double pop_schedule = bench_ns(BENCH_ITERATIONS, [&](size_t n) {
+        uint64_t deadline = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            q.pop(&v, &deadline);
+            q.schedule(deadline + steps[i % 4096], &v);
+        }
+    });
+    // reschedule of an arbitrary pending timer, the other way a timer moves
+    TimerHandle handles[64];
+    q.clean();
+    for (size_t i = 0; i < N; i++)
+    {
+        const TimerHandle h = q.schedule(steps[i], &v);
+        if (i < 64) handles[i] = h;
+    }
+    const size_t n_handles = N < 64 ? N : 64;
+    const double reschedule = bench_ns(BENCH_ITERATIONS, [&](size_t n) {
+        for (size_t i = 0; i < n; i++)
+            q.reschedule(handles[i % n_handles], steps[i % 4096]);
+    });
+    bench_keep(v);
+    printf("N=%3zu  pop+schedule %6.1f ns  reschedule %6.1f ns\n", N, pop_schedule, reschedule);
+}
+
+int main()
+{
+    bench<16>();
+    bench<32>();
+    bench<64>();
+    bench<128>();
+    bench<256>();
+    return 0;
+}
@@ -0,0 +1,67 @@
+// the integer aggregate against the float one on raw HX711 counts: per sample update, batch update and finalize.
+// the host has an FPU and the cortex-m0+ doesn't, there floats are software emulated and the gap is far wider
+
+#include "welfords.h"
+#include "bench.h"
+
+#include <random>
+#include <vector>
+
+#define BENCH_SAMPLES 4096
+#define BENCH_ROUNDS 2000
+
+int main()
+{
+    std::mt19937 rng(6);
+    std::normal_distribution<double> dist(-3000000, 40);
+    std::vector<int32_t> raw(BENCH_SAMPLES);
+    std::vector<float> raw_f(BENCH_SAMPLES);
+    for (size_t i = 0; i < raw.size(); i++)
+    {
+        raw[i] = static_cast<int32_t>(dist(rng));
+        raw_f[i] = static_cast<float>(raw[i]);
+    }
+    const size_t iterations = BENCH_SAMPLES * BENCH_ROUNDS;
+
+    float mean, stdev;
+    const double float_update = bench_ns(iterations, [&](size_t) {
+        for (size_t r = 0; r < BENCH_ROUNDS; r++)
+        {
+            Welfords::Aggregate agg;
+            for (float v : raw_f) Welfords::update(&agg, v);
+            Welfords::finalize(&agg, &mean, &stdev);
+            bench_keep(mean);
+        }
+    });
+    const double int_update = bench_ns(iterations, [&](size_t) {
+        for (size_t r = 0; r < BENCH_ROUNDS; r++)
+        {
+            Welfords::AggregateInt agg;
+            for (int32_t v : raw) Welfords::update(&agg, v);
+            Welfords::finalize(&agg, &mean, &stdev);
+            bench_keep(mean);
+        }
+    });
+    const double float_batch = bench_ns(iterations, [&](size_t) {
+        for (size_t r = 0; r < BENCH_ROUNDS; r++)
+        {
+            Welfords::Aggregate agg;
+            Welfords::update(&agg, raw_f.data(), raw_f.size());
+            Welfords::finalize(&agg, &mean, &stdev);
+            bench_keep(mean);
+        }
+    });
+    const double int_batch = bench_ns(iterations, [&](size_t) {
+        for (size_t r = 0; r < BENCH_ROUNDS; r++)
+        {
+            Welfords::AggregateInt agg;
+            Welfords::update(&agg, raw.data(), raw.size());
+            Welfords::finalize(&agg, &mean, &stdev);
+            bench_keep(mean);
+        }
+    });
+
+    printf("per sample     float %5.2f ns  int %5.2f ns\n", float_update, int_update);
+    printf("batch update   float %5.2f ns  int %5.2f ns\n", float_batch, int_batch);
+    return 0;
+}
@@ -0,0 +1,111 @@
+#ifndef _COMMAND_SET_H_
+#define _COMMAND_SET_H_
+
+// a made up set of COMMAND_SET_N commands for the command table of SmartComm, with the names that make it work hardest:
+// pairs with the same full hash, a long run of names on the same slot and a repeated name. the names are generated
+// (with a fixed seed), so the commands are built at run time, some of them as SmartCmdF
+
+// only the static_assert of SmartComm looks at it, so SmartComm.cpp can keep the default
+#define MAX_COMMANDS 128
+#include "SmartComm.h"
+
+#include <assert.h>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define COMMAND_SET_N 96
+#define COMMAND_SET_FULL_PAIRS 2  // names 0..3, two pairs with the same 32 bit hash
+#define COMMAND_SET_SAME_SLOT 16  // names 4..19, all on the same slot of the table as name 20
+#define COMMAND_SET_REPEATED 95   // the same name as COMMAND_SET_REPEATS, the first one is the one found
+#define COMMAND_SET_REPEATS 30
+
+typedef SmartComm<COMMAND_SET_N> CommandSetComm;
+
+struct CommandSet
+{
+    std::vector<std::string> names;
+    // names that aren't commands but share the full hash or the slot of one that is
+    std::vector<std::string> missing;
+    std::vector<SmartCmd> ram;
+    std::vector<SmartCmdF> flash;
+    const SmartCmdBase *cmds[COMMAND_SET_N];
+
+    static std::string random_name(std::mt19937 &rng)
+    {
+        static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789_";
+        std::string name(rng() % 11 + 2, 'x');
+        for (char &c : name) c = chars[rng() % (sizeof(chars) - 1)];
+        name[0] = 'a' + rng() % 26;
+        return name;
+    }
+
+    CommandSet(smartCmdCB_t cb)
+    {
+        std::mt19937 rng(19);
+        const uint32_t slots = __smartCommTableSize(COMMAND_SET_N) - 1;
+        std::unordered_map<std::string, bool> used;
+        auto fresh = [&](const std::string &name) { return used.emplace(name, true).second; };
+
+        // full 32 bit collisions, by the birthday paradox among 8 char names. the third pair only has one name in
+        std::unordered_map<uint32_t, std::string> seen;
+        std::vector<std::pair<std::string, std::string>> pairs;
+        while (pairs.size() < COMMAND_SET_FULL_PAIRS + 1)
+        {
+            std::string name(8, 'a');
+            for (char &c : name) c = 'a' + rng() % 26;
+            const auto it = seen.emplace(__smartCmdHash(name.c_str()), name);
+            if (!it.second && it.first->second != name && used.count(name) == 0 && used.count(it.first->second) == 0)
+            {
+                pairs.push_back({it.first->second, name});
+                fresh(name);
+                fresh(it.first->second);
+            }
+        }
+        for (size_t i = 0; i < COMMAND_SET_FULL_PAIRS; i++)
+        {
+            names.push_back(pairs[i].first);
+            names.push_back(pairs[i].second);
+        }
+        missing.push_back(pairs.back().second);
+
+        // a run of names on the slot of the third pair, and two more on it that aren't commands
+        const uint32_t slot = __smartCmdHash(pairs.back().first.c_str()) & slots;
+        while (names.size() + missing.size() < 2 * COMMAND_SET_FULL_PAIRS + COMMAND_SET_SAME_SLOT + 3)
+        {
+            const std::string name = random_name(rng);
+            if ((__smartCmdHash(name.c_str()) & slots) != slot || !fresh(name)) continue;
+            if (names.size() < 2 * COMMAND_SET_FULL_PAIRS + COMMAND_SET_SAME_SLOT) names.push_back(name);
+            else missing.push_back(name);
+        }
+        names.push_back(pairs.back().first);
+
+        while (names.size() < COMMAND_SET_N)
+        {
+            const std::string name = names.size() == COMMAND_SET_REPEATED ? names[COMMAND_SET_REPEATS] : random_name(rng);
+            if (names.size() == COMMAND_SET_REPEATED || fresh(name))
+                names.push_back(name);
+        }
+        assert(names[COMMAND_SET_REPEATED] == names[COMMAND_SET_REPEATS]);
+
+        // every 5th in flash, hashed when it's built like a SmartCmdF made without its hash
+        ram.reserve(COMMAND_SET_N);
+        flash.reserve(COMMAND_SET_N);
+        for (size_t i = 0; i < COMMAND_SET_N; i++)
+        {
+            if (i % 5 == 4 && i != COMMAND_SET_REPEATED && i != COMMAND_SET_REPEATS)
+            {
+                flash.emplace_back(names[i].c_str(), cb);
+                cmds[i] = &flash.back();
+            }
+            else
+            {
+                ram.emplace_back(names[i].c_str(), cb);
+                cmds[i] = &ram.back();
+            }
+        }
+    }
+};
+
+#endif /* _COMMAND_SET_H_ */
@@ -0,0 +1,210 @@
+#ifndef _OLD_TOKENIZER_H_
+#define _OLD_TOKENIZER_H_
+
+// __extractArguments as it was before the single pass tokenizer (SmartComm.cpp at 51aa413~1, debug prints left out):
+// trim, collapse the separators, drop the unwanted chars, then split with strchr. the reference of
+// test_smartcomm_tokenizer and the baseline of bench_smartcomm_tokenizer.
+// the memmove of __removeConsecutiveDuplicates reads as many chars past the '\0' as it collapsed, lines passed to it need
+// that much room after them
+
+#include "SmartComm.h"
+
+namespace old_tokenizer
+{
+
+inline void __trimChar(char *&str, char c)
+{
+    // it modifies str so that all chatacters c at the start and end of str are removed. if c is space
+    // and str is "     hello there  ", after the function, str will be "hello there"
+    // this modifies the original str. it returns a new pointer (inside the original str)
+    // the str argument should be passed as *&a if a is a (char *)
+    // https://stackoverflow.com/questions/122616/how-do-i-trim-leading-trailing-whitespace-in-a-standard-way
+    if (c == '\0' || str == NULL || *str == '\0') {
+        return; // Nothing to trim
+    }
+
+    // remove from front
+    while (*str == c)
+        ++str;
+
+    char *endp = str + strlen(str) - 1;
+    // if(endp <= str) return;
+
+    // remove from back
+    // if (endp - str < 2) return;
+    while (*endp == c && endp > str)
+        --endp;
+    *(endp+1) = '\0';
+}
+
+inline void __removeConsecutiveDuplicates(char *&str, char c)
+{
+    // modifies str such that there are no multiple consecutive characters c. That means that if c
+    // is a space, and str is "  hi how     are  you  ", after running this function, str will be
+    // " hi how are you "
+    //
+    // the idea of the implementation is the following:
+    // we traverse the string. if we find c in position i, we start counting how many contiguous
+    // characters c are after index i. if its one, we continue incrementing i. if there are more,
+    // we count how many there are before the caracter is no longer c. then we move the whole str
+    // that's on the right side of i to overwrite the excess of c characters
+    if (c == '\0' || str == NULL || *str == '\0') {
+        return; // Nothing to remove
+    }
+    _smart_comm_size_t len = strlen(str);
+    if (len == 1) return;
+    else if (len == 2)
+    {
+        if (*str == c && *(str+1) == c)
+            *(str+1) = '\0';
+        return;
+    }
+
+    char *endp = str + len - 1;
+
+    // remove front
+    while (*str == c && *(str+1) == c)
+        ++str;
+    // if (str >= endp-1) return;
+
+    // remove back
+    while (*endp == c && *(endp-1) == c && endp > str+1)
+        --endp;
+    if (endp <= str+1)
+    {
+        *(endp+1) = '\0';
+        return;
+    }
+
+    // remove center
+    _smart_comm_size_t nConsec = 0;
+    for (char *p = str+1; p < endp; ++p)
+    {
+        // count how many consecutives
+        if (*p == c)
+        {
+            while (*(p + nConsec + 1) == c)
+                ++nConsec;
+        }
+
+        // shift all chars to the left nConsec places
+        if (nConsec)
+        {
+            memmove(p + 1, p + nConsec + 1, endp-p);
+            // memmove(str+i+1, str+i+1+nConsec, len-nConsec);
+            // update strlen(p) == len accordingly
+            endp -= nConsec;
+            nConsec = 0;
+        }
+    }
+    *(endp+1) = '\0';
+}
+
+template <typename F>
+inline void __removeUnwantedChars(char *&str, const F &isUnwanted)
+{
+    if (str == NULL || *str == '\0') {
+        return; // Nothing to remove
+    }
+
+    _smart_comm_size_t len = strlen(str);
+    if (len == 1)
+    {
+        if (isUnwanted(*str))
+            *str = '\0';
+        return;
+    }
+
+    char *endp = str + len - 1;
+
+    // remove from front
+    while (isUnwanted(*str))
+        ++str;
+
+    // remove from tail
+    while (isUnwanted(*endp) && endp > str)
+        --endp;
+    if (endp <= str)
+    {
+        *(endp+1) = '\0';
+        return;
+    }
+
+    // remove from center
+    _smart_comm_size_t nConsec = 0;
+    for (char *p = str+1; p < endp; ++p)
+    {
+        while (isUnwanted(*(p + nConsec)))
+            ++nConsec;
+
+        // shift all chars to the left nConsec places
+        if (nConsec)
+        {
+            memmove(p, p+nConsec, endp-p);
+            endp -= nConsec;
+            nConsec = 0;
+        }
+    }
+    *(endp+1) = '\0';
+}
+
+inline bool __isCharUnwanted(char c, char endChar, char sepChar)
+{
+    return !(c == endChar || c == sepChar || (c > 32 && c < 127) || c == '\0');
+}
+
+inline bool __extractArguments(char *buffer, char endChar, char sepChar, char *&command, char *args[MAX_ARGUMENTS], _smart_comm_size_t &nArgs)
+{
+    // return true if arguments were found. populates nArgs and populates the args array of arguments.
+    // buffer cannot be used afterward because it is modified to store the arguments pointed to by args
+
+    // trim leading and trailing sepChars from _buffer
+    __trimChar(buffer, sepChar);
+
+    // remove duplicate sepChars
+    __removeConsecutiveDuplicates(buffer, sepChar);
+
+    // remove unwanted chars
+    __removeUnwantedChars(buffer, [endChar, sepChar](char c){ return __isCharUnwanted(c, endChar, sepChar); });
+
+    command = buffer;
+
+    _smart_comm_size_t len = strlen(buffer);
+
+    if (*buffer == '\0' || len == 0)
+    {
+        return false;
+    }
+
+    // find all arguments
+    char *sepPtr = buffer; // ptr of the last separation char found + 1
+    // char *args[MAX_ARGUMENTS] = {0}; // ptrs of all separation characters found
+    // _smart_comm_size_t nArgs = 0; // amount of arguments
+    nArgs = 0;
+    char *ptr;
+    for (;;)
+    {
+        ptr = strchr(sepPtr, sepChar); // this returns the pointer to the first ocurrence
+
+        if (ptr == NULL) break;
+
+        // later we split the buffer into several strings,
+        // each being an argument (the first is the command)
+        // to reuse the same char array, we can change the
+        // sep chars for '\0' and save pointers to the next char
+        *ptr = '\0';
+        
+        // -2 because we dont want sepIndex to point to the ending '\0'
+        if (ptr >= buffer+len-1) break;
+        sepPtr = ptr+1;
+        
+        if (nArgs >= MAX_ARGUMENTS) break;
+        args[nArgs++] = sepPtr;
+    }
+
+    return true;
+}
+
+} // namespace old_tokenizer
+
+#endif /* _OLD_TOKENIZER_H_ */
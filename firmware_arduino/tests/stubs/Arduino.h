@@ -0,0 +1,202 @@
+#ifndef _STUB_ARDUINO_H_
+#define _STUB_ARDUINO_H_
+
+// the little of Arduino.h the host tests need
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <thread>
+
+typedef unsigned int uint;
+typedef uint8_t pin_size_t;
+
+static inline unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+static inline void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static inline void delayMicroseconds(unsigned int us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+#define sq(x) ((x) * (x))
+
+// gpio. inputs are driven by the test with stub_drive_pin, which also runs the interrupt attached to the pin
+
+enum PinStatus
+{
+    LOW = 0,
+    HIGH = 1,
+    CHANGE,
+    FALLING,
+    RISING,
+};
+
+enum PinMode
+{
+    INPUT = 0,
+    OUTPUT = 1,
+    INPUT_PULLUP,
+    INPUT_PULLDOWN,
+};
+
+typedef void (*voidFuncPtrParam)(void *);
+
+#define STUB_PINS 32
+
+struct StubPin
+{
+    std::atomic<PinStatus> level{LOW};
+    voidFuncPtrParam isr = NULL;
+    PinStatus isr_mode = LOW;
+    void *isr_param = NULL;
+};
+
+inline StubPin stub_pins[STUB_PINS];
+
+static inline void pinMode(pin_size_t, PinMode) {}
+static inline PinStatus digitalRead(pin_size_t pin) { return stub_pins[pin].level; }
+static inline void digitalWrite(pin_size_t pin, PinStatus level) { stub_pins[pin].level = level; }
+static inline pin_size_t digitalPinToInterrupt(pin_size_t pin) { return pin; }
+
+static inline void attachInterruptParam(pin_size_t pin, voidFuncPtrParam isr, PinStatus mode, void *param)
+{
+    stub_pins[pin].isr = isr;
+    stub_pins[pin].isr_mode = mode;
+    stub_pins[pin].isr_param = param;
+}
+
+// what the outside world does to an input, from any thread. the interrupt runs in that thread, like an irq would
+static inline void stub_drive_pin(pin_size_t pin, PinStatus level)
+{
+    StubPin &p = stub_pins[pin];
+    const PinStatus old = p.level.exchange(level);
+    const bool fire = p.isr && level != old &&
+                      (p.isr_mode == CHANGE || (p.isr_mode == FALLING && level == LOW) ||
+                       (p.isr_mode == RISING && level == HIGH));
+    if (fire) p.isr(p.isr_param);
+}
+
+// flash is memory like any other on the host, as on the RP2040
+#define PROGMEM
+typedef const char *PGM_P;
+#define F(s) (s)
+#define pgm_read_byte(p) (*reinterpret_cast<const uint8_t *>(p))
+#define strcmp_P strcmp
+#define strncpy_P strncpy
+
+struct String
+{
+    std::string s;
+    String &operator=(const char *str) { s = str; return *this; }
+    const char *c_str() const { return s.c_str(); }
+};
+
+// Print and Stream with the calls the firmware makes
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size--) n += write(*(buffer++));
+        return n;
+    }
+    virtual void flush() {}
+
+    size_t print(const char *s) { return write(reinterpret_cast<const uint8_t *>(s), strlen(s)); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t print(int v) { return print(static_cast<long>(v)); }
+    size_t print(unsigned int v) { return print(static_cast<unsigned long>(v)); }
+    size_t print(unsigned char v) { return print(static_cast<unsigned long>(v)); }
+    size_t print(double v) { return printf("%.2f", v); }
+    size_t println() { return write('\n'); }
+    template <typename T>
+    size_t println(T v) { return print(v) + println(); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buf[1024];
+        va_list args;
+        va_start(args, format);
+        const int n = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        if (n <= 0) return 0;
+        return write(reinterpret_cast<const uint8_t *>(buf), static_cast<size_t>(n) < sizeof(buf) ? n : sizeof(buf) - 1);
+    }
+};
+
+class Stream : public Print
+{
+protected:
+    unsigned long _timeout = 1000;
+
+    int timedRead()
+    {
+        const unsigned long start = millis();
+        do
+        {
+            const int c = read();
+            if (c >= 0) return c;
+        } while (millis() - start < _timeout);
+        return -1;
+    }
+
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+};
+
+// a serial port in memory: the test puts what the host sends in input, and finds what the board wrote in output
+class StubStream : public Stream
+{
+public:
+    std::string input, output;
+    size_t pos = 0;
+
+    int available() override { return input.size() - pos; }
+    int read() override { return pos < input.size() ? static_cast<uint8_t>(input[pos++]) : -1; }
+    int peek() override { return pos < input.size() ? static_cast<uint8_t>(input[pos]) : -1; }
+    size_t write(uint8_t c) override
+    {
+        output += static_cast<char>(c);
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        output.append(reinterpret_cast<const char *>(buffer), size);
+        return size;
+    }
+    using Print::write;
+};
+
+inline StubStream Serial;
+
+#endif /* _STUB_ARDUINO_H_ */
@@ -0,0 +1,88 @@
+#ifndef _STUB_ARDUINOJSON_H_
+#define _STUB_ARDUINOJSON_H_
+
+// the types and calls of ArduinoJson v7 the firmware uses, so its sources compile on the host. they hold nothing and
+// parse nothing: the tests don't go through json, that's ArduinoJson's job and it's tested upstream
+
+#include <Arduino.h>
+
+class JsonObject;
+class JsonArray;
+
+class JsonString
+{
+public:
+    const char *c_str() const { return ""; }
+};
+
+class JsonVariantConst
+{
+public:
+    template <typename T> bool is() const { return false; }
+    template <typename T> T as() const { return T(); }
+    explicit operator bool() const { return false; }
+};
+
+class JsonVariant : public JsonVariantConst
+{
+public:
+    template <typename T> JsonVariant &operator=(const T &) { return *this; }
+    template <typename T> T to() { return T(); }
+    template <typename T> T add() { return T(); }
+    JsonVariant operator[](const char *) const { return JsonVariant(); }
+    JsonVariant operator[](size_t) const { return JsonVariant(); }
+};
+
+class JsonPairConst
+{
+public:
+    JsonString key() const { return JsonString(); }
+    JsonVariantConst value() const { return JsonVariantConst(); }
+};
+
+class JsonObjectConst
+{
+public:
+    const JsonPairConst *begin() const { return NULL; }
+    const JsonPairConst *end() const { return NULL; }
+    JsonVariantConst operator[](const char *) const { return JsonVariantConst(); }
+    explicit operator bool() const { return false; }
+};
+
+class JsonObject
+{
+public:
+    JsonVariant operator[](const char *) const { return JsonVariant(); }
+    operator JsonObjectConst() const { return JsonObjectConst(); }
+    explicit operator bool() const { return false; }
+};
+
+class JsonArray
+{
+public:
+    size_t size() const { return 0; }
+    JsonVariant operator[](size_t) const { return JsonVariant(); }
+    template <typename T> T add() const { return T(); }
+    template <typename T> bool add(const T &) const { return false; }
+    explicit operator bool() const { return false; }
+};
+
+class JsonDocument : public JsonVariant
+{
+public:
+    void clear() {}
+};
+
+class DeserializationError
+{
+public:
+    explicit operator bool() const { return true; }
+    const char *c_str() const { return "not in the host stub"; }
+};
+
+template <typename... Args> DeserializationError deserializeJson(Args &&...) { return DeserializationError(); }
+template <typename T> size_t measureJson(const T &) { return 0; }
+template <typename T> size_t serializeJson(const T &, char *, size_t) { return 0; }
+template <typename T, typename Out> size_t serializeJson(const T &, Out &) { return 0; }
+
+#endif /* _STUB_ARDUINOJSON_H_ */
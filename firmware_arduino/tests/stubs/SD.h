@@ -0,0 +1,19 @@
+#ifndef _STUB_SD_H_
+#define _STUB_SD_H_
+
+// the SD card isn't reached by the host tests, File only has to exist
+
+#include <Arduino.h>
+
+class File
+{
+public:
+    explicit operator bool() const { return false; }
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t write(uint8_t) { return 0; }
+    size_t write(const uint8_t *, size_t) { return 0; }
+    void close() {}
+};
+
+#endif /* _STUB_SD_H_ */
@@ -0,0 +1,16 @@
+#ifndef _STUB_HARDWARE_PIO_H_
+#define _STUB_HARDWARE_PIO_H_
+
+#include <stdint.h>
+#include "pio_instructions.h"
+
+typedef struct pio_hw *PIO;
+
+typedef struct
+{
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+#endif /* _STUB_HARDWARE_PIO_H_ */
@@ -0,0 +1,87 @@
+#ifndef _STUB_HARDWARE_PIO_INSTRUCTIONS_H_
+#define _STUB_HARDWARE_PIO_INSTRUCTIONS_H_
+
+// the encoders the firmware uses, from the instruction set in the RP2040 datasheet (3.4). the real header also checks
+// its arguments, these don't
+
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+enum pio_src_dest
+{
+    pio_pins = 0,
+    pio_x = 1,
+    pio_y = 2,
+    pio_null = 3,
+    pio_pindirs = 4,
+    pio_status = 5,
+    pio_isr = 6,
+    pio_osr = 7,
+};
+
+enum pio_instr_bits
+{
+    pio_instr_bits_jmp = 0x0000,
+    pio_instr_bits_wait = 0x2000,
+    pio_instr_bits_in = 0x4000,
+    pio_instr_bits_out = 0x6000,
+    pio_instr_bits_push = 0x8000,
+    pio_instr_bits_pull = 0x8080,
+    pio_instr_bits_mov = 0xa000,
+    pio_instr_bits_irq = 0xc000,
+    pio_instr_bits_set = 0xe000,
+};
+
+static inline uint pio_encode_sideset(uint sideset_bit_count, uint value)
+{
+    return value << (13u - sideset_bit_count);
+}
+
+static inline uint pio_encode_delay(uint cycles)
+{
+    return cycles << 8u;
+}
+
+static inline uint _pio_encode_instr_and_args(enum pio_instr_bits bits, uint arg1, uint arg2)
+{
+    return bits | (arg1 << 5u) | (arg2 & 0x1fu);
+}
+
+static inline uint pio_encode_jmp(uint addr) { return _pio_encode_instr_and_args(pio_instr_bits_jmp, 0, addr); }
+static inline uint pio_encode_jmp_x_dec(uint addr) { return _pio_encode_instr_and_args(pio_instr_bits_jmp, 2, addr); }
+static inline uint pio_encode_jmp_y_dec(uint addr) { return _pio_encode_instr_and_args(pio_instr_bits_jmp, 4, addr); }
+
+static inline uint pio_encode_wait_pin(bool polarity, uint pin)
+{
+    return _pio_encode_instr_and_args(pio_instr_bits_wait, 1u | (polarity ? 4u : 0u), pin);
+}
+
+static inline uint pio_encode_in(enum pio_src_dest src, uint count)
+{
+    return _pio_encode_instr_and_args(pio_instr_bits_in, src, count);
+}
+
+static inline uint pio_encode_pull(bool if_empty, bool block)
+{
+    return _pio_encode_instr_and_args(pio_instr_bits_pull, (if_empty ? 2u : 0u) | (block ? 1u : 0u), 0);
+}
+
+static inline uint pio_encode_mov(enum pio_src_dest dest, enum pio_src_dest src)
+{
+    return _pio_encode_instr_and_args(pio_instr_bits_mov, dest, src & 7u);
+}
+
+static inline uint pio_encode_nop() { return pio_encode_mov(pio_y, pio_y); }
+
+static inline uint pio_encode_irq_set(bool relative, uint irq)
+{
+    return _pio_encode_instr_and_args(pio_instr_bits_irq, 0, (relative ? 0x10u : 0u) | irq);
+}
+
+static inline uint pio_encode_set(enum pio_src_dest dest, uint value)
+{
+    return _pio_encode_instr_and_args(pio_instr_bits_set, dest, value);
+}
+
+#endif /* _STUB_HARDWARE_PIO_INSTRUCTIONS_H_ */
@@ -0,0 +1,44 @@
+#ifndef _STUB_HARDWARE_SYNC_H_
+#define _STUB_HARDWARE_SYNC_H_
+
+// the event register of the cortex-m0+: __sev sets it, __wfe sleeps until it's set and clears it. one register for
+// every thread, which is what a wait on one core woken by the other or by an irq needs. stub_wfe_sleeps counts the
+// waits that actually slept, so a test can tell sleeping from spinning
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+struct StubEvent
+{
+    std::mutex m;
+    std::condition_variable cv;
+    bool set = false;
+};
+
+inline StubEvent stub_event;
+inline std::atomic<uint32_t> stub_wfe_sleeps{0};
+
+static inline void __sev()
+{
+    std::lock_guard<std::mutex> lock(stub_event.m);
+    stub_event.set = true;
+    stub_event.cv.notify_all();
+}
+
+static inline void __wfe()
+{
+    std::unique_lock<std::mutex> lock(stub_event.m);
+    if (!stub_event.set)
+    {
+        ++stub_wfe_sleeps;
+        stub_event.cv.wait(lock, [] { return stub_event.set; });
+    }
+    stub_event.set = false;
+}
+
+static inline uint32_t save_and_disable_interrupts() { return 0; }
+static inline void restore_interrupts(uint32_t) {}
+
+#endif /* _STUB_HARDWARE_SYNC_H_ */
@@ -0,0 +1,12 @@
+#ifndef _STUB_PICO_DIVIDER_H_
+#define _STUB_PICO_DIVIDER_H_
+
+#include <stdint.h>
+
+static inline int64_t divmod_s64s64_rem(int64_t a, int64_t b, int64_t *rem)
+{
+    (*rem) = a % b;
+    return a / b;
+}
+
+#endif /* _STUB_PICO_DIVIDER_H_ */
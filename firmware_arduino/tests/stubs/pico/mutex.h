@@ -0,0 +1,24 @@
+#ifndef _STUB_PICO_MUTEX_H_
+#define _STUB_PICO_MUTEX_H_
+
+// pico mutexes on top of std::timed_mutex, one thread standing in for each core
+
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+
+typedef struct
+{
+    std::timed_mutex m;
+} mutex_t;
+
+static inline void mutex_init(mutex_t *) {}
+static inline void mutex_enter_blocking(mutex_t *mtx) { mtx->m.lock(); }
+static inline void mutex_exit(mutex_t *mtx) { mtx->m.unlock(); }
+
+static inline bool mutex_enter_timeout_us(mutex_t *mtx, uint32_t timeout_us)
+{
+    return mtx->m.try_lock_for(std::chrono::microseconds(timeout_us));
+}
+
+#endif /* _STUB_PICO_MUTEX_H_ */
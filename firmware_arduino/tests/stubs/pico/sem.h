@@ -0,0 +1,62 @@
+#ifndef _STUB_PICO_SEM_H_
+#define _STUB_PICO_SEM_H_
+
+// pico semaphores on top of a condition variable. stub_sem_sleeps counts the acquires that had to wait for a permit,
+// so a test can tell sleeping from spinning
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+typedef struct
+{
+    std::mutex m;
+    std::condition_variable cv;
+    int16_t permits;
+    int16_t max_permits;
+} semaphore_t;
+
+inline std::atomic<uint32_t> stub_sem_sleeps{0};
+
+static inline void sem_init(semaphore_t *sem, int16_t initial_permits, int16_t max_permits)
+{
+    sem->permits = initial_permits;
+    sem->max_permits = max_permits;
+}
+
+static inline bool sem_release(semaphore_t *sem)
+{
+    std::lock_guard<std::mutex> lock(sem->m);
+    if (sem->permits >= sem->max_permits) return false;
+    ++sem->permits;
+    sem->cv.notify_one();
+    return true;
+}
+
+static inline bool sem_acquire_timeout_us(semaphore_t *sem, uint32_t timeout_us)
+{
+    std::unique_lock<std::mutex> lock(sem->m);
+    if (sem->permits == 0)
+    {
+        ++stub_sem_sleeps;
+        if (!sem->cv.wait_for(lock, std::chrono::microseconds(timeout_us), [sem] { return sem->permits > 0; }))
+            return false;
+    }
+    --sem->permits;
+    return true;
+}
+
+static inline void sem_acquire_blocking(semaphore_t *sem)
+{
+    std::unique_lock<std::mutex> lock(sem->m);
+    if (sem->permits == 0)
+    {
+        ++stub_sem_sleeps;
+        sem->cv.wait(lock, [sem] { return sem->permits > 0; });
+    }
+    --sem->permits;
+}
+
+#endif /* _STUB_PICO_SEM_H_ */
@@ -0,0 +1,7 @@
+#ifndef _STUB_PICO_SYNC_H_
+#define _STUB_PICO_SYNC_H_
+
+#include "mutex.h"
+#include "sem.h"
+
+#endif /* _STUB_PICO_SYNC_H_ */
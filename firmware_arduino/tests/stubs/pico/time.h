@@ -0,0 +1,56 @@
+#ifndef _STUB_PICO_TIME_H_
+#define _STUB_PICO_TIME_H_
+
+// absolute times in us of the host's steady clock, and the wait on the event register with a timeout
+
+#include <Arduino.h>
+#include <hardware/sync.h>
+
+typedef uint64_t absolute_time_t;
+
+#define at_the_end_of_time UINT64_MAX
+
+static inline absolute_time_t get_absolute_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline bool is_at_the_end_of_time(absolute_time_t t) { return t == at_the_end_of_time; }
+static inline absolute_time_t make_timeout_time_us(uint64_t us) { return get_absolute_time() + us; }
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) { return make_timeout_time_us(ms * 1000ull); }
+static inline bool time_reached(absolute_time_t t) { return get_absolute_time() >= t; }
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+    return static_cast<int64_t>(to - from);
+}
+
+static inline void sleep_us(uint64_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+// true if the timeout was reached, false if an event woke it up first
+static inline bool best_effort_wfe_or_timeout(absolute_time_t timeout_time)
+{
+    if (time_reached(timeout_time)) return true;
+    std::unique_lock<std::mutex> lock(stub_event.m);
+    if (!stub_event.set)
+    {
+        ++stub_wfe_sleeps;
+        if (is_at_the_end_of_time(timeout_time))
+        {
+            stub_event.cv.wait(lock, [] { return stub_event.set; });
+        }
+        else
+        {
+            const std::chrono::steady_clock::time_point until{std::chrono::microseconds(timeout_time)};
+            stub_event.cv.wait_until(lock, until, [] { return stub_event.set; });
+        }
+    }
+    if (!stub_event.set) return true;
+    stub_event.set = false;
+    return false;
+}
+
+#endif /* _STUB_PICO_TIME_H_ */
@@ -0,0 +1,8 @@
+#ifndef _STUB_SYS__STDINT_H_
+#define _STUB_SYS__STDINT_H_
+
+// newlib's, hx711.h includes it
+
+#include <stdint.h>
+
+#endif /* _STUB_SYS__STDINT_H_ */
@@ -0,0 +1,217 @@
+// AsyncCmds: every request gets its own id and every reply line the id of its request, a request that doesn't fit in
+// the ring is turned down without using an id, long lines go out in pieces with the serial held in between, and a
+// command with more to say than the reply ring holds waits for forward() instead of losing lines
+
+#include "async_cmds.h"
+
+#include <hardware/sync.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// the received lines, without the '\n' of each
+static std::vector<std::string> lines(StubStream &serial)
+{
+    std::vector<std::string> out;
+    size_t start = 0;
+    for (size_t end; (end = serial.output.find('\n', start)) != std::string::npos; start = end + 1)
+        out.push_back(serial.output.substr(start, end - start));
+    assert(start == serial.output.size());
+    serial.output.clear();
+    return out;
+}
+
+// {"cmd":"echo","args":"a b"}, from whichever core runs it
+static void echo_cb(Stream *stream, const SmartCmdArguments *args, const char *cmd)
+{
+    std::string joined;
+    for (_smart_comm_size_t i = 0; i < args->N; i++) joined += (i ? " " : "") + std::string(args->arg(i));
+    stream->printf("{\"cmd\":\"%s\",\"args\":\"%s\"}\n", cmd, joined.c_str());
+}
+
+static bool submit(AsyncCmds &async, Stream *stream, const std::vector<const char *> &argv, smartCmdCB_t cb=echo_cb)
+{
+    const SmartCmdArguments args(argv.size(), argv.data());
+    return async.submit(stream, &args, "echo", cb);
+}
+
+static void test_ids()
+{
+    StubStream serial;
+    AsyncCmds async;
+
+    // the ring holds ASYNC_CMDS_QUEUE_LEN requests, each answered right away with its id
+    const char *const keys[] = {"a", "b", "c", "d", "e"};
+    for (uint32_t i = 0; i < ASYNC_CMDS_QUEUE_LEN; i++)
+    {
+        assert(submit(async, &serial, {keys[i], "1"}));
+        assert(lines(serial) == std::vector<std::string>{
+            "{\"cmd\":\"echo\",\"processing\":true,\"id\":" + std::to_string(i + 1) + "}"});
+    }
+    assert(async.pending());
+
+    // one more is turned down, and its id stays free
+    assert(!submit(async, &serial, {keys[4], "1"}));
+    assert(lines(serial) == std::vector<std::string>{
+        "{\"err\":true,\"cmd\":\"echo\",\"msg\":\"Too many requests in flight\"}"});
+
+    // so are arguments that don't fit in a job, by a byte, before the ring is even looked at
+    const std::string long_arg(ASYNC_CMDS_ARGS_LEN - 2, 'x');
+    assert(!submit(async, &serial, {long_arg.c_str(), "z"}));
+    assert(lines(serial) == std::vector<std::string>{"{\"err\":true,\"cmd\":\"echo\",\"msg\":\"Arguments too long\"}"});
+
+    // running one makes room, and the next request gets the id after the last accepted one
+    assert(async.run_next());
+    assert(submit(async, &serial, {keys[4], "1"}));
+    assert(lines(serial) == std::vector<std::string>{"{\"cmd\":\"echo\",\"processing\":true,\"id\":5}"});
+
+    // the replies come back in order, each with the id of its request
+    async.forward();
+    for (uint32_t i = 1; i < ASYNC_CMDS_QUEUE_LEN; i++) assert(async.run_next());
+    async.forward();
+    assert(async.run_next());
+    assert(!async.run_next());
+    assert(!async.pending());
+    async.forward();
+    std::vector<std::string> expected;
+    for (uint32_t i = 0; i < 5; i++)
+        expected.push_back("{\"id\":" + std::to_string(i + 1) + ",\"cmd\":\"echo\",\"args\":\"" + keys[i] + " 1\"}");
+    assert(lines(serial) == expected);
+    assert(!async.mid_line());
+
+    // one byte less still goes
+    const std::string fits(ASYNC_CMDS_ARGS_LEN - 3, 'y');
+    assert(submit(async, &serial, {fits.c_str(), "z"}));
+    assert(lines(serial) == std::vector<std::string>{"{\"cmd\":\"echo\",\"processing\":true,\"id\":6}"});
+    assert(async.run_next());
+    async.forward();
+    assert(lines(serial) == std::vector<std::string>{"{\"id\":6,\"cmd\":\"echo\",\"args\":\"" + fits + " z\"}"});
+}
+
+static void lines_cb(Stream *stream, const SmartCmdArguments *, const char *)
+{
+    // not json, an empty object, empty lines and '\r', and a last line without its '\n'
+    stream->print("plain text\r\n");
+    stream->print("{}\n");
+    stream->print("\n\r\n");
+    stream->print("[1,2]\n");
+    stream->print("{\"a\":1}");
+}
+
+static void test_lines()
+{
+    StubStream serial;
+    AsyncCmds async;
+    assert(submit(async, &serial, {}, lines_cb));
+    lines(serial);
+
+    // only json objects get the id, the empty lines aren't sent, and the unended line is ended by run_next
+    assert(async.run_next());
+    async.forward();
+    assert((lines(serial) == std::vector<std::string>{"plain text", "{\"id\":1}", "[1,2]", "{\"id\":1,\"a\":1}"}));
+    assert(!async.mid_line());
+}
+
+static void long_cb(Stream *stream, const SmartCmdArguments *args, const char *)
+{
+    const std::string line = "{\"data\":\"" + std::string(atoi(args->arg(0)), 'v') + "\"}\n";
+    stream->print(line.c_str());
+}
+
+static void test_long_line()
+{
+    // many more pieces than the reply ring holds, so the command has to wait for forward() in the middle of the line
+    const size_t n = 16 * ASYNC_CMDS_REPLY_QUEUE_LEN * ASYNC_CMDS_REPLY_LEN;
+    const std::string len = std::to_string(n);
+    StubStream serial;
+    AsyncCmds async;
+    assert(submit(async, &serial, {len.c_str()}, long_cb));
+    lines(serial);
+
+    const uint32_t sleeps = stub_wfe_sleeps;
+    std::thread core1([&] { assert(async.run_next()); });
+    // the ring is full and the command sleeps
+    while (stub_wfe_sleeps == sleeps) std::this_thread::yield();
+    async.forward();
+    assert(serial.output.size() >= ASYNC_CMDS_REPLY_QUEUE_LEN * ASYNC_CMDS_REPLY_LEN);
+    // the serial is held as long as the line isn't done
+    do
+    {
+        assert(async.mid_line() == (serial.output.back() != '\n'));
+        async.forward();
+    } while (serial.output.back() != '\n');
+    core1.join();
+    assert(!async.mid_line());
+    assert(lines(serial) == std::vector<std::string>{"{\"id\":1,\"data\":\"" + std::string(n, 'v') + "\"}"});
+}
+
+// the frames on the serial, as their id, seq and text
+struct Frame
+{
+    uint8_t id, seq;
+    std::string text;
+    bool operator==(const Frame &f) const { return id == f.id && seq == f.seq && text == f.text; }
+};
+
+static std::vector<Frame> frames(StubStream &serial)
+{
+    std::vector<Frame> out;
+    size_t start = 0;
+    for (size_t end; (end = serial.output.find('\0', start)) != std::string::npos; start = end + 1)
+    {
+        std::vector<uint8_t> f(serial.output.begin() + start, serial.output.begin() + end);
+        f.resize(__cobsDecode(f.data(), f.size()));
+        assert(__smartCrc16(f.data(), f.size() - 2) == (f[f.size() - 2] | (f[f.size() - 1] << 8)));
+        // the text is a MessagePack str
+        const size_t header = (f[2] & 0xE0) == 0xA0 ? 1 : 2;
+        out.push_back({f[0], f[1], std::string(f.begin() + 2 + header, f.end() - 2)});
+    }
+    assert(start == serial.output.size());
+    serial.output.clear();
+    return out;
+}
+
+static void test_framed()
+{
+    // the frame stream only knows the request it's answering now, the replies of the others keep their own
+    StubStream serial;
+    SmartFrameStream framed(&serial);
+    AsyncCmds async;
+    async.set_frame_stream(&framed);
+
+    framed.begin(3, 9);
+    assert(submit(async, &framed, {"x"}));
+    framed.begin(4, 10);
+    assert(submit(async, &framed, {"y"}));
+    assert((frames(serial) == std::vector<Frame>{
+        {3, 9, "{\"cmd\":\"echo\",\"processing\":true,\"id\":1}"},
+        {4, 10, "{\"cmd\":\"echo\",\"processing\":true,\"id\":2}"}}));
+
+    // a text request in between is answered in text
+    assert(submit(async, &serial, {"z"}));
+    serial.output.clear();
+    framed.begin(5, 11);
+
+    while (async.run_next()) {}
+    async.forward();
+    // the frames, then the text line
+    const std::string text = serial.output.substr(serial.output.rfind('\0') + 1);
+    serial.output.resize(serial.output.size() - text.size());
+    assert(text == "{\"id\":3,\"cmd\":\"echo\",\"args\":\"z\"}\n");
+    assert((frames(serial) == std::vector<Frame>{
+        {3, 9, "{\"id\":1,\"cmd\":\"echo\",\"args\":\"x\"}"},
+        {4, 10, "{\"id\":2,\"cmd\":\"echo\",\"args\":\"y\"}"}}));
+}
+
+int main()
+{
+    test_ids();
+    test_lines();
+    test_long_line();
+    test_framed();
+    printf("ok\n");
+    return 0;
+}
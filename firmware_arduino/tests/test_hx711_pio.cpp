@@ -0,0 +1,237 @@
+// runs the HX711PIO program through a model of a PIO state machine wired to a model of an HX711, and checks that the
+// frames the DMA would move into the ring decode to the values the converter put out
+
+#include "hx711_pio.h"
+#include "hx711_pio_program.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+
+// cycles of the state machine clock (HX711_PIO_CLOCK_HZ), the converter takes ~12ms at 80Hz but that only adds waiting
+#define CONVERSION_CYCLES 40
+#define FRAME_END_CYCLES 10 // SCK low this long after the 24 bits and the gain pulses ends the frame
+#define SCK_HIGH_MAX_CYCLES 60 // 60us at 1MHz powers the HX711 down
+
+/*
+ * The HX711 side: DOUT goes low when a conversion is ready, every rising edge of SCK shifts out the next bit (MSB
+ * first), after the 24th DOUT goes high and the pulses after it select the gain of the next conversion.
+ */
+struct HX711Model
+{
+    std::vector<int32_t> values;
+    size_t next = 0;
+    int32_t current = 0;
+    bool ready = false, sck = false;
+    uint pulses = 0;
+    uint low_cycles = 0;
+    std::vector<uint> gains; // pulses after the 24 bits, per frame
+    uint sck_high_cycles = 0, sck_high_max = 0;
+
+    bool dout() const
+    {
+        if (!ready) return true;
+        if (pulses == 0) return false;
+        if (pulses > 24) return true;
+        return (current >> (24 - pulses)) & 1;
+    }
+
+    // one cycle with SCK at the given level
+    void clock(bool level)
+    {
+        if (level && !sck)
+        {
+            assert(ready); // clocked while converting
+            ++pulses;
+            low_cycles = 0;
+        }
+        sck = level;
+
+        if (sck)
+        {
+            ++sck_high_cycles;
+            if (sck_high_cycles > sck_high_max) sck_high_max = sck_high_cycles;
+            return;
+        }
+        sck_high_cycles = 0;
+        ++low_cycles;
+
+        if (ready && pulses > 24 && low_cycles >= FRAME_END_CYCLES)
+        {
+            // the frame is over, the next conversion starts
+            gains.push_back(pulses - 24);
+            ready = false;
+            pulses = 0;
+            low_cycles = 0;
+        }
+        if (!ready && next < values.size() && low_cycles >= CONVERSION_CYCLES)
+        {
+            current = values[next++];
+            ready = true;
+        }
+    }
+};
+
+/*
+ * The state machine side, decoding the instruction words as in the datasheet (3.4) and not through the encoders in the
+ * stubs, with the config from HX711PIO::begin: 1 side-set bit on SCK, in pins at DOUT, shift left with autopush at 24,
+ * wrap over the whole program.
+ */
+struct PIOModel
+{
+    const uint16_t *program;
+    uint len;
+    uint pc = 0;
+    uint32_t x = 0, y = 0, osr = 0, isr = 0;
+    uint isr_count = 0;
+    uint delay = 0;
+    bool sck = false;
+    std::vector<uint32_t> tx_fifo, rx_fifo;
+    uint irqs = 0;
+
+    PIOModel(const uint16_t *program, uint len) : program(program), len(len) {}
+
+    // executes instr, returns false if it stalled
+    bool exec(uint16_t instr, bool dout)
+    {
+        const uint op = instr >> 13;
+        const uint arg1 = (instr >> 5) & 7, arg2 = instr & 0x1f;
+        switch (op)
+        {
+        case 0: // jmp
+        {
+            bool cond;
+            switch (arg1)
+            {
+            case 0: cond = true; break;
+            case 2: cond = x != 0; --x; break;
+            case 4: cond = y != 0; --y; break;
+            default: assert(!"jmp condition not modelled"); return true;
+            }
+            pc = cond ? arg2 : pc + 1;
+            return true;
+        }
+        case 1: // wait
+            assert((arg1 & 3) == 1 && arg2 == 0); // wait pin 0
+            if (dout != static_cast<bool>(arg1 & 4)) return false;
+            break;
+        case 2: // in
+            assert(arg1 == 0); // pins
+            for (uint i = 0; i < (arg2 ? arg2 : 32); i++) isr = (isr << 1) | dout;
+            isr_count += arg2 ? arg2 : 32;
+            if (isr_count >= 24)
+            {
+                rx_fifo.push_back(isr);
+                isr = 0;
+                isr_count = 0;
+            }
+            break;
+        case 4: // pull
+            assert(instr & 0x80);
+            if (tx_fifo.empty()) return !(arg1 & 1);
+            osr = tx_fifo.front();
+            tx_fifo.erase(tx_fifo.begin());
+            break;
+        case 5: // mov, only to y
+        {
+            assert(arg1 == 2 && ((instr >> 3) & 3) == 0);
+            const uint src = instr & 7;
+            assert(src == 2 || src == 7);
+            y = src == 7 ? osr : y;
+            break;
+        }
+        case 6: // irq
+            assert(!(instr & 0x60) && (arg2 & 0x0f) == 0); // set, no wait, irq 0 (sm 0 so rel doesn't move it)
+            ++irqs;
+            break;
+        case 7: // set
+            assert(arg1 == 1); // x
+            x = arg2;
+            break;
+        default:
+            assert(!"instruction not modelled");
+        }
+        ++pc;
+        return true;
+    }
+
+    // one cycle, SCK as it is during the cycle
+    void cycle(HX711Model &hx)
+    {
+        if (delay > 0)
+        {
+            --delay;
+            hx.clock(sck);
+            return;
+        }
+        const uint16_t instr = program[pc];
+        // side-set applies from the first cycle of the instruction, even a stalled one
+        sck = (instr >> 12) & 1;
+        hx.clock(sck);
+        if (!exec(instr, hx.dout())) return;
+        delay = (instr >> 8) & 0xf;
+        if (pc >= len) pc = 0; // wrap
+    }
+};
+
+static void run(const std::vector<int32_t> &values, uint8_t gain_pulses)
+{
+    HX711Model hx;
+    hx.values = values;
+    PIOModel sm(hx711_pio_instructions, HX711_PIO_PROGRAM_LEN);
+    // like _load_gain
+    sm.tx_fifo.push_back(gain_pulses - 1);
+    assert(sm.exec(pio_encode_pull(false, true), true));
+    sm.pc = 0;
+
+    const size_t max_cycles = (values.size() + 1) * (CONVERSION_CYCLES + FRAME_END_CYCLES + 24 * 7 + 3 * 8 + 10);
+    for (size_t i = 0; i < max_cycles && sm.irqs < values.size(); i++)
+        sm.cycle(hx);
+    // the last gain pulses are counted once SCK stays low
+    for (int i = 0; i < FRAME_END_CYCLES; i++) sm.cycle(hx);
+
+    assert(sm.rx_fifo.size() == values.size());
+    assert(sm.irqs == values.size());
+    assert(hx.gains.size() == values.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        assert(sm.rx_fifo[i] < (1u << 24));
+        assert(hx711_frame_to_raw(sm.rx_fifo[i]) == values[i]);
+        assert(hx.gains[i] == gain_pulses);
+    }
+    // 3 cycles high per pulse, nowhere near the power down
+    assert(hx.sck_high_max == 3);
+    assert(hx.sck_high_max < SCK_HIGH_MAX_CYCLES);
+}
+
+static void test_frame_to_raw()
+{
+    assert(hx711_frame_to_raw(0x000000) == 0);
+    assert(hx711_frame_to_raw(0x000001) == 1);
+    assert(hx711_frame_to_raw(0x7FFFFF) == 0x7FFFFF);
+    assert(hx711_frame_to_raw(0x800000) == -0x800000);
+    assert(hx711_frame_to_raw(0xFFFFFF) == -1);
+}
+
+static void test_program()
+{
+    const std::vector<int32_t> edges = {0, 1, -1, 0x7FFFFF, -0x800000, 0x555555, -0x555556};
+    for (uint8_t gain_pulses = 1; gain_pulses <= 3; gain_pulses++)
+        run(edges, gain_pulses);
+
+    std::mt19937 rng(2711);
+    std::uniform_int_distribution<int32_t> dist(-0x800000, 0x7FFFFF);
+    std::vector<int32_t> values(500);
+    for (int32_t &v : values) v = dist(rng);
+    for (uint8_t gain_pulses = 1; gain_pulses <= 3; gain_pulses++)
+        run(values, gain_pulses);
+}
+
+int main()
+{
+    test_frame_to_raw();
+    test_program();
+    printf("ok\n");
+    return 0;
+}
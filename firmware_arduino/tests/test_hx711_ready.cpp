@@ -0,0 +1,123 @@
+// HX711::wait_ready and wait_ready_timeout against a simulated DOUT line: the falling edge interrupt has to wake a
+// sleeping reader, and a reader must neither miss the edge nor spin while it waits
+
+#include "hx711.h"
+#include "sd_helper.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <time.h>
+
+#define PIN_SCK 2
+#define PIN_DOUT 3
+// generous, the host may be busy. what matters is that a waiter doesn't return before or long after
+#define WAKE_MAX_MS 200
+
+// hx711.cpp loads and saves calibrations, which the tests don't reach
+bool SD_Helper::open_read(File *, const char *) { return false; }
+bool SD_Helper::open_write(File *, const char *) { return false; }
+bool SD_Helper::close(File *) { return true; }
+
+typedef std::chrono::steady_clock Clock;
+
+static long ms_since(Clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t).count();
+}
+
+// cpu time of the calling thread, a reader that polls DOUT instead of sleeping burns the whole wait
+static double cpu_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_ms(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// DOUT stays high while the HX711 converts, low when a conversion is ready
+static void converting() { stub_drive_pin(PIN_DOUT, HIGH); }
+static void ready() { stub_drive_pin(PIN_DOUT, LOW); }
+
+static void test_ready_before_wait()
+{
+    HX711 hx(PIN_SCK, PIN_DOUT);
+    hx.begin();
+    converting();
+    ready();
+    const uint32_t sleeps = stub_wfe_sleeps;
+    const Clock::time_point start = Clock::now();
+    assert(hx.is_ready());
+    assert(hx.wait_ready_timeout(1000));
+    hx.wait_ready();
+    assert(ms_since(start) < WAKE_MAX_MS);
+    assert(stub_wfe_sleeps == sleeps);
+}
+
+static void test_ready_during_wait()
+{
+    HX711 hx(PIN_SCK, PIN_DOUT);
+    hx.begin();
+    for (bool timeout : {true, false})
+    {
+        converting();
+        Clock::time_point edge;
+        std::thread converter([&edge] {
+            sleep_ms(50);
+            edge = Clock::now();
+            ready();
+        });
+        const uint32_t sleeps = stub_wfe_sleeps;
+        const double cpu = cpu_ms();
+        const Clock::time_point start = Clock::now();
+        if (timeout) assert(hx.wait_ready_timeout(5000));
+        else hx.wait_ready();
+        converter.join();
+        assert(ms_since(start) >= 50);
+        assert(ms_since(edge) < WAKE_MAX_MS);
+        // slept until the edge instead of polling DOUT
+        assert(stub_wfe_sleeps - sleeps <= 2);
+        assert(cpu_ms() - cpu < 10);
+    }
+}
+
+static void test_timeout()
+{
+    HX711 hx(PIN_SCK, PIN_DOUT);
+    hx.begin();
+    converting();
+    const uint32_t sleeps = stub_wfe_sleeps;
+    const double cpu = cpu_ms();
+    Clock::time_point start = Clock::now();
+    assert(!hx.wait_ready_timeout(50));
+    long elapsed = ms_since(start);
+    assert(elapsed >= 50 && elapsed < 50 + WAKE_MAX_MS);
+    assert(stub_wfe_sleeps - sleeps <= 2);
+    assert(cpu_ms() - cpu < 10);
+
+    // a glitch on DOUT (like the bits of a frame going by) wakes the reader, but it goes back to sleep
+    std::thread glitch([] {
+        sleep_ms(10);
+        ready();
+        converting();
+    });
+    start = Clock::now();
+    assert(!hx.wait_ready_timeout(50));
+    elapsed = ms_since(start);
+    glitch.join();
+    assert(elapsed >= 50 && elapsed < 50 + WAKE_MAX_MS);
+}
+
+int main()
+{
+    test_ready_before_wait();
+    test_ready_during_wait();
+    test_timeout();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,221 @@
+// JsonReply: the three kinds, escaping, commas through nested arrays and objects, the numbers, and a reply longer than
+// its buffer, which must come out whole in several writes of at most JSON_REPLY_LEN, even with an escape sequence
+// across the end of the buffer
+
+#include "json_reply.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <limits>
+#include <string>
+#include <vector>
+
+// every write of the reply on its own
+class WritesStream : public StubStream
+{
+public:
+    std::vector<std::string> writes;
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        writes.push_back(std::string(reinterpret_cast<const char *>(buffer), size));
+        return StubStream::write(buffer, size);
+    }
+    using StubStream::write;
+
+    // what was sent since the last call, which has to be a single write
+    std::string reply()
+    {
+        assert(writes.size() == 1 && writes[0] == output);
+        const std::string r = output;
+        writes.clear();
+        output.clear();
+        return r;
+    }
+};
+
+static void test_kinds()
+{
+    WritesStream s;
+    JsonReply(&s, "hx").send();
+    assert(s.reply() == "{\"success\":true,\"cmd\":\"hx\"}\n");
+    JsonReply(&s, "hx", JsonReply::Kind::ERR).add("msg", "Bad slot").send();
+    assert(s.reply() == "{\"err\":true,\"cmd\":\"hx\",\"msg\":\"Bad slot\"}\n");
+    JsonReply(&s, "hx", JsonReply::Kind::INFO).add("processing", true).add("id", 7u).send();
+    assert(s.reply() == "{\"cmd\":\"hx\",\"processing\":true,\"id\":7}\n");
+}
+
+static void test_send()
+{
+    WritesStream s;
+    {
+        JsonReply r(&s, "a");
+        r.add("x", 1);
+        r.send();
+        assert(s.reply() == "{\"success\":true,\"cmd\":\"a\",\"x\":1}\n");
+        // only the first send does something, also the one of the destructor
+        r.send();
+        assert(s.writes.empty() && s.output.empty());
+    }
+    assert(s.writes.empty() && s.output.empty());
+
+    // nothing goes out before the reply is done, and then at the latest when it goes out of scope
+    {
+        JsonReply r(&s, "b");
+        r.add("y", false);
+        assert(s.writes.empty());
+    }
+    assert(s.reply() == "{\"success\":true,\"cmd\":\"b\",\"y\":false}\n");
+}
+
+static void test_escaping()
+{
+    WritesStream s;
+    JsonReply(&s, "q\"uote").add("k\\ey", "a\"b\\c\nd\re\tf\x01g\x1f/\xc2\xb5").add("null", (const char *)NULL).send();
+    assert(s.reply() ==
+        "{\"success\":true,\"cmd\":\"q\\\"uote\",\"k\\\\ey\":\"a\\\"b\\\\c\\nd\\re\\tf\\u0001g\\u001f/\xc2\xb5\","
+        "\"null\":null}\n");
+    JsonReply(&s, "").add("", "").send();
+    assert(s.reply() == "{\"success\":true,\"cmd\":\"\",\"\":\"\"}\n");
+}
+
+static void test_nesting()
+{
+    WritesStream s;
+    JsonReply(&s, "n")
+        .begin_array("a").end_array()
+        .begin_array("b").item(1).item("two").item(true)
+            .begin_object().add("x", 1).add("y", 2).end_object()
+            .begin_object().end_object()
+            .item(3)
+        .end_array()
+        .begin_object("o")
+            .begin_array("e").end_array()
+            .begin_object("p").add("q", -1).end_object()
+            .add("z", 0)
+        .end_object()
+        .add("last", 1)
+        .send();
+    assert(s.reply() == "{\"success\":true,\"cmd\":\"n\",\"a\":[],\"b\":[1,\"two\",true,{\"x\":1,\"y\":2},{},3],"
+        "\"o\":{\"e\":[],\"p\":{\"q\":-1},\"z\":0},\"last\":1}\n");
+}
+
+static std::string number(double d)
+{
+    WritesStream s;
+    JsonReply(&s, "", JsonReply::Kind::INFO).add("v", d).send();
+    const std::string r = s.reply();
+    return r.substr(14, r.size() - 16);
+}
+
+static std::string fixed(double d, uint8_t decimals)
+{
+    WritesStream s;
+    JsonReply(&s, "", JsonReply::Kind::INFO).add("v", d, decimals).send();
+    const std::string r = s.reply();
+    return r.substr(14, r.size() - 16);
+}
+
+template <typename T>
+static std::string integer(T i)
+{
+    WritesStream s;
+    JsonReply(&s, "", JsonReply::Kind::INFO).add("v", i).send();
+    const std::string r = s.reply();
+    return r.substr(14, r.size() - 16);
+}
+
+static void test_numbers()
+{
+    assert(integer(0) == "0");
+    assert(integer(static_cast<int8_t>(-128)) == "-128");
+    assert(integer(static_cast<uint8_t>(255)) == "255");
+    assert(integer(std::numeric_limits<int32_t>::min()) == "-2147483648");
+    assert(integer(std::numeric_limits<uint32_t>::max()) == "4294967295");
+    assert(integer(std::numeric_limits<int64_t>::min()) == "-9223372036854775808");
+    assert(integer(std::numeric_limits<int64_t>::max()) == "9223372036854775807");
+    assert(integer(std::numeric_limits<uint64_t>::max()) == "18446744073709551615");
+
+    // 7 significant digits, the trailing zeros trimmed
+    assert(number(0) == "0");
+    assert(number(1) == "1");
+    assert(number(-2.25) == "-2.25");
+    assert(number(0.1f) == "0.1");
+    assert(number(1.0 / 3) == "0.3333333");
+    assert(number(1234567.4) == "1234567");
+    assert(number(0.99999999) == "1");
+    assert(number(0.00001) == "0.00001");
+    assert(number(0.000012345678) == "0.00001234568");
+    // an exponent outside 1e-5..1e7
+    assert(number(12345678) == "1.234568e7");
+    assert(number(-1e20) == "-1e20");
+    assert(number(0.0000015) == "1.5e-6");
+    assert(number(9.9999999e7) == "1e8");
+    assert(number(NAN) == "null");
+    assert(number(INFINITY) == "null");
+    assert(number(-INFINITY) == "null");
+
+    // a fixed number of decimals keeps its zeros, and rounds as a whole
+    assert(fixed(3.14159, 2) == "3.14");
+    assert(fixed(2, 3) == "2.000");
+    assert(fixed(0.99999, 4) == "1.0000");
+    assert(fixed(-0.125, 1) == "-0.1");
+    assert(fixed(12.5, 0) == "13");
+    assert(fixed(1, 20) == "1.000000000000");
+    // too big for 64 bits with its decimals, and json has no nan
+    assert(fixed(1e20, 2) == "1e20");
+    assert(fixed(NAN, 2) == "null");
+}
+
+static void test_overflow()
+{
+    // a reply that ends exactly at the end of the buffer is still a single write, one more byte makes it two
+    WritesStream s;
+    const std::string head = "{\"cmd\":\"x\",\"s\":\"";
+    std::string fits(JSON_REPLY_LEN - head.size() - 3, 'f');
+    JsonReply(&s, "x", JsonReply::Kind::INFO).add("s", fits.c_str()).send();
+    assert(s.reply() == head + fits + "\"}\n");
+    fits += 'f';
+    JsonReply(&s, "x", JsonReply::Kind::INFO).add("s", fits.c_str()).send();
+    const std::string full = head + fits + "\"}\n";
+    assert((s.writes == std::vector<std::string>{full.substr(0, JSON_REPLY_LEN), "\n"}));
+    s.writes.clear();
+    s.output.clear();
+
+    // several buffers full of items, and strings whose escapes fall across the end of a buffer at every offset
+    for (size_t pad = 0; pad < 8; pad++)
+    {
+        std::string expected = "{\"success\":true,\"cmd\":\"x\",\"pad\":\"" + std::string(pad, 'p') + "\",\"items\":[";
+        {
+            JsonReply r(&s, "x");
+            r.add("pad", std::string(pad, 'p').c_str()).begin_array("items");
+            for (int i = 0; i < 300; i++)
+            {
+                r.item(i * 1001).item("\"\x02\\");
+                expected += (i ? "," : "") + std::to_string(i * 1001) + ",\"\\\"\\u0002\\\\\"";
+            }
+            r.end_array().add("end", true);
+        }
+        expected += "],\"end\":true}\n";
+
+        assert(s.output == expected);
+        assert(s.writes.size() == (expected.size() + JSON_REPLY_LEN - 1) / JSON_REPLY_LEN);
+        for (size_t i = 0; i + 1 < s.writes.size(); i++) assert(s.writes[i].size() == JSON_REPLY_LEN);
+        s.writes.clear();
+        s.output.clear();
+    }
+}
+
+int main()
+{
+    test_kinds();
+    test_send();
+    test_escaping();
+    test_nesting();
+    test_numbers();
+    test_overflow();
+    printf("ok\n");
+    return 0;
+}
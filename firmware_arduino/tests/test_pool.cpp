@@ -0,0 +1,64 @@
+// Pool hands every block out once, takes back only its own blocks, once
+
+#include "Pool.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <set>
+
+struct Counted
+{
+    static int alive;
+    uint32_t value;
+    Counted(uint32_t value) : value(value) { ++alive; }
+    ~Counted() { --alive; }
+};
+int Counted::alive = 0;
+
+static void test_alloc_free()
+{
+    Pool<uint64_t, 5> pool;
+    std::set<uint64_t *> blocks;
+    for (int i = 0; i < 5; i++)
+    {
+        uint64_t *p = pool.alloc();
+        assert(p && pool.owns(p) && blocks.insert(p).second);
+    }
+    assert(pool.full() && !pool.alloc() && pool.high_water() == 5);
+
+    uint64_t *p = *blocks.begin();
+    assert(pool.free(p));
+    // twice, a stranger, NULL, the middle of a block
+    assert(!pool.free(p));
+    uint64_t other;
+    assert(!pool.free(&other) && !pool.free(NULL));
+    assert(!pool.owns(reinterpret_cast<uint8_t *>(*blocks.rbegin()) + 1));
+    assert(pool.in_use() == 4 && pool.available() == 1);
+
+    // the block comes back and can be freed again
+    assert(pool.alloc() == p);
+    for (uint64_t *b : blocks) assert(pool.free(b));
+    assert(pool.available() == 5);
+    for (uint64_t *b : blocks) assert(!pool.free(b));
+    assert(pool.available() == 5 && pool.high_water() == 5);
+}
+
+static void test_create_destroy()
+{
+    Pool<Counted, 3> pool;
+    Counted *a = pool.create(1u), *b = pool.create(2u);
+    assert(a->value == 1 && b->value == 2 && Counted::alive == 2);
+    assert(pool.destroy(a) && Counted::alive == 1);
+    // the destructor doesn't run twice
+    assert(!pool.destroy(a) && Counted::alive == 1);
+    assert(pool.destroy(b) && Counted::alive == 0);
+    assert(pool.in_use() == 0);
+}
+
+int main()
+{
+    test_alloc_free();
+    test_create_destroy();
+    printf("ok\n");
+    return 0;
+}
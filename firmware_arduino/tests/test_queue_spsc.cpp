@@ -0,0 +1,103 @@
+// QueueSPSC from two threads, the way core 0 and core 1 use it: every entry comes out once, in order and whole
+
+#include "Queues.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <thread>
+
+#define STRESS_ENTRIES 1000000
+
+// wide enough that a torn copy shows up as a mismatch between the words
+struct Entry
+{
+    uint32_t seq;
+    uint32_t words[7];
+};
+
+static void fill(Entry *e, uint32_t seq)
+{
+    e->seq = seq;
+    for (uint32_t i = 0; i < 7; i++) e->words[i] = seq * 2654435761u + i;
+}
+
+static bool whole(const Entry *e, uint32_t seq)
+{
+    if (e->seq != seq) return false;
+    for (uint32_t i = 0; i < 7; i++)
+        if (e->words[i] != seq * 2654435761u + i) return false;
+    return true;
+}
+
+static void test_single_thread()
+{
+    QueueSPSC<Entry, 4> q;
+    Entry e;
+    assert(q.empty() && !q.peek() && !q.pop(&e));
+    // many times around the ring
+    for (uint32_t round = 0; round < 10; round++)
+    {
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            fill(&e, round * 4 + i);
+            assert(q.push(&e));
+            assert(q.size() == i + 1);
+        }
+        assert(q.full());
+        fill(&e, 0xFFFF);
+        assert(!q.push(&e));
+        assert(whole(q.peek(), round * 4));
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            assert(q.pop(&e));
+            assert(whole(&e, round * 4 + i));
+        }
+        assert(q.empty() && !q.pop(&e));
+    }
+}
+
+template <size_t N>
+static void stress()
+{
+    static QueueSPSC<Entry, N> q;
+    bool in_order = true;
+    std::thread producer([] {
+        Entry e;
+        for (uint32_t seq = 0; seq < STRESS_ENTRIES;)
+        {
+            fill(&e, seq);
+            if (q.push(&e)) ++seq;
+            else std::this_thread::yield();
+        }
+    });
+    std::thread consumer([&in_order] {
+        Entry e;
+        for (uint32_t seq = 0; seq < STRESS_ENTRIES;)
+        {
+            const Entry *peeked = q.peek();
+            if (!peeked)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            if (!whole(peeked, seq)) in_order = false;
+            assert(q.pop(&e));
+            if (!whole(&e, seq)) in_order = false;
+            ++seq;
+        }
+    });
+    producer.join();
+    consumer.join();
+    assert(in_order);
+    assert(q.empty());
+}
+
+int main()
+{
+    test_single_thread();
+    // a ring that's full most of the time and one that rarely is
+    stress<2>();
+    stress<64>();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,115 @@
+// the *_wait calls of the RP2040 thread-safe queues, with the pico mutex and semaphore running on std threads: a
+// blocked waiter sleeps until the other side changes the queue or its timeout passes, it doesn't spin
+
+#define ARDUINO_ARCH_RP2040
+#include "Queues.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+// generous, the host may be busy. what matters is that a waiter doesn't return before or long after
+#define WAKE_MAX_MS 200
+
+typedef std::chrono::steady_clock Clock;
+
+static long ms_since(Clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t).count();
+}
+
+static void sleep_ms(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static void test_pop_wakes_on_push()
+{
+    static QueueFIFOThreadSafe_RP2040<int, 4> q(false);
+    int v = 0;
+    Clock::time_point pushed;
+    std::thread consumer([&v] { assert(q.pop_wait(&v)); });
+    sleep_ms(50);
+    const uint32_t sleeps = stub_sem_sleeps;
+    int x = 42;
+    pushed = Clock::now();
+    assert(q.push_blocking(&x));
+    consumer.join();
+    assert(v == 42);
+    assert(ms_since(pushed) < WAKE_MAX_MS);
+    // it slept through the 50ms: a spinning waiter would have gone around thousands of times
+    assert(sleeps <= 2);
+}
+
+static void test_push_wakes_on_pop()
+{
+    static QueueFIFOThreadSafe_RP2040<int, 2> q(false);
+    int x = 1;
+    assert(q.push_blocking(&x) && q.push_blocking(&x));
+    std::thread producer([] {
+        int y = 3;
+        assert(q.push_wait(&y, 1000000));
+    });
+    sleep_ms(50);
+    int v;
+    const Clock::time_point popped = Clock::now();
+    assert(q.pop_blocking(&v) && v == 1);
+    producer.join();
+    assert(ms_since(popped) < WAKE_MAX_MS);
+    assert(q.pop_blocking(&v) && v == 1);
+    assert(q.pop_blocking(&v) && v == 3);
+}
+
+static void test_wait_times_out()
+{
+    QueueFIFOThreadSafe_RP2040<int, 4> q(false);
+    StackLIFOThreadSafe_RP2040<int, 4> stack(false);
+    DequeThreadSafe_RP2040<int, 4> deque(false);
+    int v;
+    const uint32_t sleeps = stub_sem_sleeps;
+    Clock::time_point start = Clock::now();
+    assert(!q.pop_wait(&v, 30000));
+    long elapsed = ms_since(start);
+    assert(elapsed >= 30 && elapsed < 30 + WAKE_MAX_MS);
+    // one sleep for the whole timeout, plus one for the permit left by the constructor
+    assert(stub_sem_sleeps - sleeps <= 2);
+
+    start = Clock::now();
+    assert(!stack.pop_wait(&v, 20000) && !deque.pop_front_wait(&v, 20000));
+    elapsed = ms_since(start);
+    assert(elapsed >= 40 && elapsed < 40 + WAKE_MAX_MS);
+
+    // a full queue times out on push
+    for (int i = 0; i < 4; i++) assert(q.push_blocking(&i));
+    start = Clock::now();
+    assert(!q.push_wait(&v, 20000));
+    assert(ms_since(start) >= 20);
+}
+
+static void test_handoff()
+{
+    // every entry through a small ring, both sides waiting on each other
+    static QueueFIFOThreadSafe_RP2040<uint32_t, 2> q(false);
+    const uint32_t n = 20000;
+    std::thread producer([] {
+        for (uint32_t i = 0; i < n; i++) assert(q.push_wait(&i));
+    });
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t v;
+        assert(q.pop_wait(&v, 1000000));
+        assert(v == i);
+    }
+    producer.join();
+}
+
+int main()
+{
+    test_pop_wakes_on_push();
+    test_push_wakes_on_pop();
+    test_wait_times_out();
+    test_handoff();
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,187 @@
+// Deque, QueueFIFO and StackLIFO against a std::deque doing the same random calls, for power of two lengths (masked
+// indices) and others (compare and branch), with and without overwrite
+
+#include "Queues.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <deque>
+#include <random>
+
+struct Small
+{
+    uint32_t value;
+    Small(uint32_t value=0) : value(value) {}
+};
+
+// the size of the LogData entries the firmware queues for the SD card
+struct Large
+{
+    uint32_t value;
+    uint8_t rest[36];
+    Large(uint32_t value=0) : value(value) { memset(rest, static_cast<uint8_t>(value), sizeof(rest)); }
+};
+
+template <typename T, size_t N>
+static void check_same(const Deque<T, N> &q, const std::deque<uint32_t> &ref)
+{
+    assert(q.size() == ref.size());
+    assert(q.empty() == ref.empty() && q.full() == (ref.size() == N));
+    if (ref.empty()) return;
+    assert(q.peek_front()->value == ref.front() && q.peek_back()->value == ref.back());
+    for (size_t i = 0; i < ref.size(); i++)
+    {
+        const T expected(ref[i]);
+        assert(memcmp(q.peek(i), &expected, sizeof(T)) == 0);
+    }
+    assert(!q.peek(ref.size()));
+}
+
+template <typename T, size_t N>
+static void fuzz_deque(bool overwrite, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    Deque<T, N> q(overwrite);
+    std::deque<uint32_t> ref;
+    uint32_t next = 0;
+    for (int i = 0; i < 100000; i++)
+    {
+        const uint32_t op = rng() % 8;
+        T e(next);
+        if (op <= 1)
+        {
+            // back
+            const bool pushed = q.push_back(&e);
+            assert(pushed == (overwrite || ref.size() < N));
+            if (ref.size() == N && overwrite) ref.pop_front(); // the oldest, at the other end, is dropped
+            if (pushed) ref.push_back(next++);
+        }
+        else if (op <= 3)
+        {
+            const bool pushed = q.push_front(&e);
+            assert(pushed == (overwrite || ref.size() < N));
+            if (ref.size() == N && overwrite) ref.pop_back();
+            if (pushed) ref.push_front(next++);
+        }
+        else if (op == 4)
+        {
+            assert(q.pop_back(&e) == !ref.empty());
+            if (!ref.empty())
+            {
+                assert(e.value == ref.back());
+                ref.pop_back();
+            }
+        }
+        else if (op == 5)
+        {
+            assert(q.pop_front(&e) == !ref.empty());
+            if (!ref.empty())
+            {
+                assert(e.value == ref.front());
+                ref.pop_front();
+            }
+        }
+        else if (op == 6)
+        {
+            // a batch in, through the copying version (two spans when it wraps)
+            T batch[N + 2];
+            const size_t n = rng() % (N + 2);
+            for (size_t k = 0; k < n; k++) batch[k] = T(next + k);
+            const size_t pushed = q.push_back_n(batch, n);
+            assert(pushed == std::min(n, N - ref.size()));
+            for (size_t k = 0; k < pushed; k++) ref.push_back(next++);
+        }
+        else
+        {
+            T batch[N + 2];
+            const size_t n = rng() % (N + 2);
+            const size_t popped = q.pop_front_n(batch, n);
+            assert(popped == std::min(n, ref.size()));
+            for (size_t k = 0; k < popped; k++)
+            {
+                assert(batch[k].value == ref.front());
+                ref.pop_front();
+            }
+        }
+        check_same(q, ref);
+    }
+}
+
+template <size_t N>
+static void fuzz_fifo_stack(uint32_t seed)
+{
+    // the fifo and the stack are the two ends of the same deque, one overwriting and one not
+    std::mt19937 rng(seed);
+    QueueFIFO<Large, N> fifo(true);
+    StackLIFO<Large, N> stack(false);
+    std::deque<uint32_t> ref_fifo, ref_stack;
+    for (uint32_t i = 0; i < 50000; i++)
+    {
+        Large e(i);
+        if (rng() % 2)
+        {
+            assert(fifo.push(&e));
+            if (ref_fifo.size() == N) ref_fifo.pop_front();
+            ref_fifo.push_back(i);
+            assert(stack.push(&e) == (ref_stack.size() < N));
+            if (ref_stack.size() < N) ref_stack.push_back(i);
+        }
+        else
+        {
+            assert(fifo.pop(&e) == !ref_fifo.empty());
+            if (!ref_fifo.empty())
+            {
+                assert(e.value == ref_fifo.front());
+                ref_fifo.pop_front();
+            }
+            assert(stack.pop(&e) == !ref_stack.empty());
+            if (!ref_stack.empty())
+            {
+                assert(e.value == ref_stack.back());
+                ref_stack.pop_back();
+            }
+        }
+        assert(fifo.size() == ref_fifo.size() && stack.size() == ref_stack.size());
+    }
+}
+
+template <size_t N>
+static void test_overwrite_ends()
+{
+    // a full overwriting fifo keeps the newest N, in order, however many times it wraps
+    QueueFIFO<uint32_t, N> q(true);
+    for (uint32_t i = 0; i < 3 * N + 1; i++) assert(q.push(&i));
+    assert(q.full());
+    for (uint32_t i = 2 * N + 1; i < 3 * N + 1; i++)
+    {
+        uint32_t v;
+        assert(*q.peek() == i);
+        assert(q.pop(&v) && v == i);
+    }
+    assert(q.empty());
+    // and clean really empties it
+    for (uint32_t i = 0; i < N; i++) q.push(&i);
+    q.clean();
+    uint32_t v;
+    assert(q.empty() && q.size() == 0 && !q.pop(&v));
+}
+
+int main()
+{
+    for (bool overwrite : {false, true})
+    {
+        fuzz_deque<Small, 8>(overwrite, 8);
+        fuzz_deque<Small, 7>(overwrite, 7);
+        fuzz_deque<Small, 1>(overwrite, 1);
+        fuzz_deque<Small, 2>(overwrite, 2);
+        fuzz_deque<Large, 16>(overwrite, 16);
+        fuzz_deque<Large, 50>(overwrite, 50);
+    }
+    fuzz_fifo_stack<16>(16);
+    fuzz_fifo_stack<5>(5);
+    test_overwrite_ends<8>();
+    test_overwrite_ends<5>();
+    test_overwrite_ends<1>();
+    printf("ok\n");
+    return 0;
+}
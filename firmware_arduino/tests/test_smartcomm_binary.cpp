@@ -0,0 +1,354 @@
+// the binary framed mode of SmartComm: COBS both ways, the CRC, the MessagePack arguments, and whole frames through
+// tick(), where a frame with a bad CRC or cut short must be dropped without calling anything
+
+#include "SmartComm.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static Bytes cobs_encode(const Bytes &data)
+{
+    StubStream out;
+    __cobsWrite(&out, data.data(), data.size());
+    return Bytes(out.output.begin(), out.output.end());
+}
+
+// decodes an encoded frame, without its delimiter
+static Bytes cobs_decode(Bytes frame)
+{
+    const size_t len = __cobsDecode(frame.data(), frame.size());
+    frame.resize(len);
+    return frame;
+}
+
+static void check_round_trip(const Bytes &data)
+{
+    const Bytes encoded = cobs_encode(data);
+    // one code byte per 254 bytes at most, and the delimiter
+    assert(encoded.size() <= data.size() + data.size() / 254 + 2);
+    assert(encoded.back() == 0);
+    for (size_t i = 0; i + 1 < encoded.size(); i++) assert(encoded[i] != 0);
+    assert(cobs_decode(Bytes(encoded.begin(), encoded.end() - 1)) == data);
+}
+
+static void test_cobs_vectors()
+{
+    // the examples of the COBS paper and of its usual test suites
+    const struct { Bytes data, encoded; } vectors[] = {
+        {{}, {0x01, 0x00}},
+        {{0x00}, {0x01, 0x01, 0x00}},
+        {{0x00, 0x00}, {0x01, 0x01, 0x01, 0x00}},
+        {{0x00, 0x11, 0x00}, {0x01, 0x02, 0x11, 0x01, 0x00}},
+        {{0x11, 0x22, 0x00, 0x33}, {0x03, 0x11, 0x22, 0x02, 0x33, 0x00}},
+        {{0x11, 0x22, 0x33, 0x44}, {0x05, 0x11, 0x22, 0x33, 0x44, 0x00}},
+        {{0x11, 0x00, 0x00, 0x00}, {0x02, 0x11, 0x01, 0x01, 0x01, 0x00}},
+    };
+    for (const auto &v : vectors)
+    {
+        assert(cobs_encode(v.data) == v.encoded);
+        assert(cobs_decode(Bytes(v.encoded.begin(), v.encoded.end() - 1)) == v.data);
+    }
+
+    // a full block of 254 non zero bytes has no zero after it
+    Bytes block(254);
+    for (size_t i = 0; i < block.size(); i++) block[i] = i + 1;
+    Bytes encoded = cobs_encode(block);
+    assert(encoded.size() == 256 && encoded[0] == 0xFF && encoded[255] == 0);
+    assert(std::equal(block.begin(), block.end(), encoded.begin() + 1));
+
+    // one more byte starts a second block
+    block.push_back(0xFF);
+    encoded = cobs_encode(block);
+    assert(encoded.size() == 258 && encoded[0] == 0xFF && encoded[255] == 0x02 && encoded[256] == 0xFF);
+
+    // a zero after a full block
+    block.back() = 0;
+    encoded = cobs_encode(block);
+    assert(encoded.size() == 258 && encoded[0] == 0xFF && encoded[255] == 0x01 && encoded[256] == 0x01);
+}
+
+static void test_cobs_round_trip()
+{
+    // the lengths around the block size, with the zeros alone, in runs or missing
+    std::mt19937 rng(2303);
+    for (size_t len : {1, 2, 253, 254, 255, 256, 507, 508, 509, 600})
+    {
+        Bytes data(len);
+        for (uint8_t &b : data) b = rng() % 255 + 1;
+        check_round_trip(data);
+        check_round_trip(Bytes(len, 0));
+        for (int i = 0; i < 50; i++)
+        {
+            for (uint8_t &b : data) b = rng() % 4 ? rng() % 255 + 1 : 0;
+            // a run of zeros somewhere
+            const size_t at = rng() % len, run = rng() % 8;
+            for (size_t k = at; k < len && k < at + run; k++) data[k] = 0;
+            check_round_trip(data);
+        }
+    }
+}
+
+static void test_cobs_malformed()
+{
+    // a zero inside, and a code that runs past the end
+    Bytes bad = {0x03, 0x11, 0x00, 0x22};
+    assert(__cobsDecode(bad.data(), bad.size()) == 0);
+    bad = {0x05, 0x11, 0x22};
+    assert(__cobsDecode(bad.data(), bad.size()) == 0);
+}
+
+static void test_crc()
+{
+    // the check value of CRC-16/CCITT-FALSE
+    const char *check = "123456789";
+    assert(__smartCrc16(reinterpret_cast<const uint8_t *>(check), 9) == 0x29B1);
+    assert(__smartCrc16(NULL, 0) == 0xFFFF);
+    const uint8_t zero = 0;
+    assert(__smartCrc16(&zero, 1) == 0xE1F0);
+}
+
+// decodes body into text arguments, NULL if it was rejected
+static std::vector<std::string> *to_args(const Bytes &body, size_t out_len=256)
+{
+    static std::vector<std::string> result;
+    char out[256];
+    char *args[MAX_ARGUMENTS];
+    _smart_comm_size_t n = 12345;
+    if (!__msgpackToArguments(body.data(), body.size(), out, out_len, args, n)) return NULL;
+    result.assign(args, args + n);
+    return &result;
+}
+
+static void check_args(const Bytes &body, const std::vector<std::string> &expected)
+{
+    const std::vector<std::string> *args = to_args(body);
+    assert(args && *args == expected);
+}
+
+static void test_msgpack_types()
+{
+    // no body and an empty array are no arguments
+    check_args({}, {});
+    check_args({0x90}, {});
+
+    check_args({0x93, 0x00, 0x05, 0x7F}, {"0", "5", "127"});             // positive fixint
+    check_args({0x92, 0xFF, 0xE0}, {"-1", "-32"});                       // negative fixint
+    check_args({0x93, 0xC0, 0xC2, 0xC3}, {"null", "false", "true"});     // nil, bool
+    check_args({0x91, 0xCC, 0xFF}, {"255"});                             // uint 8
+    check_args({0x91, 0xCD, 0x12, 0x34}, {"4660"});                      // uint 16
+    check_args({0x91, 0xCE, 0xFF, 0xFF, 0xFF, 0xFF}, {"4294967295"});    // uint 32
+    check_args({0x91, 0xCF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}, {"18446744073709551615"}); // uint 64
+    check_args({0x92, 0xD0, 0x80, 0xD0, 0x7F}, {"-128", "127"});         // int 8
+    check_args({0x91, 0xD1, 0xFF, 0x38}, {"-200"});                      // int 16
+    check_args({0x91, 0xD2, 0x80, 0x00, 0x00, 0x00}, {"-2147483648"});   // int 32
+    check_args({0x91, 0xD3, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, {"-9223372036854775808"}); // int 64
+    check_args({0x91, 0xCA, 0x3F, 0xC0, 0x00, 0x00}, {"1.5"});           // float 32
+    check_args({0x91, 0xCB, 0xC0, 0x09, 0x21, 0xFB, 0x54, 0x44, 0x2D, 0x18}, {"-3.14159265"}); // float 64, %.9g
+    check_args({0x92, 0xA0, 0xA3, 'a', 'b', 'c'}, {"", "abc"});          // fixstr
+
+    // str 8 and str 16, longer than a fixstr
+    Bytes body = {0x92, 0xD9, 40};
+    body.insert(body.end(), 40, 'x');
+    body.insert(body.end(), {0xDA, 0x00, 0x03, 'h', 'x', '7'});
+    check_args(body, {std::string(40, 'x'), "hx7"});
+
+    // array 16
+    check_args({0xDC, 0x00, 0x02, 0x01, 0xC3}, {"1", "true"});
+
+    // as many arguments as there can be, more than a fixarray holds
+    body = {0xDC, 0x00, MAX_ARGUMENTS};
+    body.insert(body.end(), MAX_ARGUMENTS, 0x07);
+    const std::vector<std::string> *args = to_args(body);
+    assert(args && args->size() == MAX_ARGUMENTS);
+}
+
+static void test_msgpack_rejected()
+{
+    // not an array, a map, bin and ext in it
+    assert(!to_args({0x01}));
+    assert(!to_args({0x91, 0x80}));
+    assert(!to_args({0x91, 0xC4, 0x01, 0x00}));
+    assert(!to_args({0x91, 0xD4, 0x01, 0x00}));
+    // more elements than arguments
+    Bytes body = {0xDC, 0x00, MAX_ARGUMENTS + 1};
+    body.insert(body.end(), MAX_ARGUMENTS + 1, 0x07);
+    assert(!to_args(body));
+
+    // cut short anywhere, and with bytes left over
+    const Bytes whole = {0x94, 0xCD, 0x12, 0x34, 0xCB, 0, 0, 0, 0, 0, 0, 0, 0, 0xA3, 'a', 'b', 'c', 0xD9, 2, 'd', 'e'};
+    assert(to_args(whole));
+    for (size_t len = 1; len < whole.size(); len++)
+        assert(!to_args(Bytes(whole.begin(), whole.begin() + len)));
+    Bytes longer = whole;
+    longer.push_back(0x01);
+    assert(!to_args(longer));
+
+    // the text doesn't fit
+    assert(!to_args({0x91, 0xA3, 'a', 'b', 'c'}, 3));
+    assert(to_args({0x91, 0xA3, 'a', 'b', 'c'}, 4));
+    assert(!to_args({0x91, 0xCA, 0x3F, 0xC0, 0x00, 0x00}, 31));
+}
+
+/// whole frames through SmartComm ////////////////////////////////////////////////////////////
+
+static int calls = 0;
+static std::vector<std::string> last_args;
+
+static void cmd_echo(Stream *stream, const SmartCmdArguments *args, const char *cmd)
+{
+    ++calls;
+    last_args.clear();
+    for (_smart_comm_size_t i = 0; i < args->N; i++) last_args.push_back(args->arg(i));
+    stream->printf("%s %u", cmd, static_cast<unsigned>(args->N));
+    stream->println();
+}
+
+SMART_CMD_CREATE(cmdPing, "ping", cmd_echo);
+SMART_CMD_CREATE(cmdEcho, "echo", cmd_echo);
+static const SmartCmdBase *commands[] = {&cmdPing, &cmdEcho};
+
+static Bytes frame(uint8_t id, uint8_t seq, const Bytes &body)
+{
+    Bytes f = {id, seq};
+    f.insert(f.end(), body.begin(), body.end());
+    const uint16_t crc = __smartCrc16(f.data(), f.size());
+    f.push_back(crc & 0xFF);
+    f.push_back(crc >> 8);
+    return f;
+}
+
+static void send(SmartComm<ARRAY_LENGTH(commands)> &sc, StubStream &serial, const Bytes &encoded)
+{
+    serial.input.append(encoded.begin(), encoded.end());
+    sc.tick();
+}
+
+// the reply frames the board wrote since the last call, checked and decoded
+static std::vector<Bytes> replies(StubStream &serial)
+{
+    std::vector<Bytes> frames;
+    size_t start = 0;
+    for (size_t end; (end = serial.output.find('\0', start)) != std::string::npos; start = end + 1)
+    {
+        const Bytes f = cobs_decode(Bytes(serial.output.begin() + start, serial.output.begin() + end));
+        assert(f.size() >= SMART_BIN_OVERHEAD);
+        assert(__smartCrc16(f.data(), f.size() - 2) == (f[f.size() - 2] | (f[f.size() - 1] << 8)));
+        frames.push_back(f);
+    }
+    assert(start == serial.output.size());
+    serial.output.clear();
+    return frames;
+}
+
+static void check_reply(const Bytes &f, uint8_t id, uint8_t seq, const std::string &text)
+{
+    assert(f[0] == id && f[1] == seq);
+    // the body is a single MessagePack str, as the only element of an array it decodes like an argument
+    Bytes body = {0x91};
+    body.insert(body.end(), f.begin() + 2, f.end() - 2);
+    assert((body[1] & 0xE0) == 0xA0 || body[1] == 0xD9);
+    check_args(body, {text});
+}
+
+static void test_frames()
+{
+    StubStream serial;
+    SmartComm<ARRAY_LENGTH(commands)> sc(commands, serial);
+    sc.setBinary(true);
+
+    const Bytes good = frame(1, 7, {0x93, 0x2A, 0xA2, 'h', 'i', 0xC3});
+    send(sc, serial, cobs_encode(good));
+    assert(calls == 1);
+    assert((last_args == std::vector<std::string>{"42", "hi", "true"}));
+    std::vector<Bytes> r = replies(serial);
+    assert(r.size() == 1);
+    check_reply(r[0], 1, 7, "echo 3");
+
+    // a frame split over ticks, and two in one
+    Bytes encoded = cobs_encode(frame(0, 8, {}));
+    send(sc, serial, Bytes(encoded.begin(), encoded.begin() + 3));
+    assert(calls == 1);
+    send(sc, serial, Bytes(encoded.begin() + 3, encoded.end()));
+    assert(calls == 2);
+    encoded.insert(encoded.end(), encoded.begin(), encoded.end());
+    send(sc, serial, encoded);
+    assert(calls == 4);
+    r = replies(serial);
+    assert(r.size() == 3);
+    for (const Bytes &f : r) check_reply(f, 0, 8, "ping 0");
+
+    // every single bit flipped is caught by the CRC
+    for (size_t i = 0; i < good.size() * 8; i++)
+    {
+        Bytes bad = good;
+        bad[i / 8] ^= 1 << (i % 8);
+        send(sc, serial, cobs_encode(bad));
+    }
+    assert(calls == 4);
+    assert(serial.output.empty());
+
+    // cut short, at any length, with the delimiter right after
+    for (size_t len = 1; len < good.size(); len++)
+        send(sc, serial, cobs_encode(Bytes(good.begin(), good.begin() + len)));
+    // and a byte lost on the wire, which also breaks the COBS codes
+    const Bytes whole = cobs_encode(good);
+    for (size_t i = 0; i + 1 < whole.size(); i++)
+    {
+        Bytes lost = whole;
+        lost.erase(lost.begin() + i);
+        send(sc, serial, lost);
+    }
+    assert(calls == 4);
+    assert(serial.output.empty());
+
+    // the frame after them still goes through
+    send(sc, serial, cobs_encode(good));
+    assert(calls == 5);
+    check_reply(replies(serial).at(0), 1, 7, "echo 3");
+
+    // a good CRC on bad arguments is answered, but doesn't call the command
+    send(sc, serial, cobs_encode(frame(1, 9, {0x91, 0x80})));
+    assert(calls == 5);
+    r = replies(serial);
+    assert(r.size() == 1);
+    check_reply(r[0], 1, 9, "ERROR: Bad arguments for command 1");
+
+    // an unknown id
+    send(sc, serial, cobs_encode(frame(5, 10, {})));
+    r = replies(serial);
+    assert(r.size() == 1);
+    check_reply(r[0], 5, 10, "ERROR: Unknown command '5'");
+
+    // longer than the buffer
+    send(sc, serial, cobs_encode(frame(1, 11, Bytes(STREAM_BUFFER_LEN, 0x01))));
+    assert(calls == 5);
+    r = replies(serial);
+    assert(r.size() == 1 && r[0][0] == SMART_BIN_ID_ERROR);
+
+    // back to text
+    send(sc, serial, cobs_encode(frame(SMART_BIN_ID_TEXT, 12, {})));
+    check_reply(replies(serial).at(0), SMART_BIN_ID_TEXT, 12, "text");
+    assert(!sc.binary());
+    serial.input += "ping a b\n";
+    sc.tick();
+    assert(calls == 6);
+    assert(serial.output == "ping 2\n");
+}
+
+int main()
+{
+    test_cobs_vectors();
+    test_cobs_round_trip();
+    test_cobs_malformed();
+    test_crc();
+    test_msgpack_types();
+    test_msgpack_rejected();
+    test_frames();
+    printf("ok\n");
+    return 0;
+}
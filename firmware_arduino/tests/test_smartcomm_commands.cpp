@@ -0,0 +1,127 @@
+// the command table of SmartComm: with 96 commands, full hash collisions, a long probe run and a repeated name, every
+// received word must find the command a scan of the array in order would, and a word that's no command none
+
+#include "command_set.h"
+
+#include <stdio.h>
+
+static const char *called = NULL; // the name the callback got, NULL for the default one
+static std::string called_name, unknown; // a SmartCmdF passes a copy on its stack
+
+static void cmd_cb(Stream *, const SmartCmdArguments *, const char *cmd)
+{
+    called = cmd;
+    called_name = cmd;
+}
+static void default_cb(Stream *, const char *cmd)
+{
+    called = NULL;
+    unknown = cmd;
+}
+
+static CommandSet set(cmd_cb);
+
+static void send(CommandSetComm &sc, StubStream &serial, const std::string &word)
+{
+    called = NULL;
+    unknown.clear();
+    serial.input += word + " 1 2\n";
+    sc.tick();
+}
+
+// the first command in the array with the name
+static int first_of(const SmartCmdBase *const *cmds, const std::string &name)
+{
+    for (int i = 0; i < COMMAND_SET_N; i++)
+        if (cmds[i] && set.names[i] == name) return i;
+    return -1;
+}
+
+static bool in_ram(const SmartCmdBase *cmd)
+{
+    return cmd >= &set.ram.front() && cmd <= &set.ram.back();
+}
+
+static void test_hash()
+{
+    // the FNV-1a 32 test vectors
+    static_assert(__smartCmdHash("") == 0x811c9dc5, "FNV-1a");
+    static_assert(__smartCmdHash("a") == 0xe40c292c, "FNV-1a");
+    static_assert(__smartCmdHash("foobar") == 0xbf9cf968, "FNV-1a");
+    static_assert(__smartCommTableSize(COMMAND_SET_N) == 256, "at most half full");
+
+    // the set is what it says
+    for (size_t i = 0; i < 2 * COMMAND_SET_FULL_PAIRS; i += 2)
+        assert(set.cmds[i]->hash() == set.cmds[i + 1]->hash() && set.names[i] != set.names[i + 1]);
+    const uint32_t slot = set.cmds[20]->hash() & 255;
+    for (size_t i = 4; i < 20; i++) assert((set.cmds[i]->hash() & 255) == slot);
+    assert(__smartCmdHash(set.missing[0].c_str()) == set.cmds[20]->hash());
+    for (const std::string &name : set.missing) assert(first_of(set.cmds, name) < 0);
+    // SmartCmdF hashes the name when it's built without its hash
+    for (size_t i = 0; i < COMMAND_SET_N; i++) assert(set.cmds[i]->hash() == __smartCmdHash(set.names[i].c_str()));
+    assert(!set.flash.empty());
+}
+
+static void test_lookup(const SmartCmdBase *const *cmds)
+{
+    StubStream serial;
+    CommandSetComm sc(cmds, serial, '\n', ' ', default_cb);
+
+    for (size_t i = 0; i < COMMAND_SET_N; i++)
+    {
+        if (!cmds[i]) continue;
+        const std::string &name = set.names[i];
+        send(sc, serial, name);
+        assert(called && called_name == name);
+        // a SmartCmd passes its own name, so the command it was is known. the repeated name is the first one
+        const int first = first_of(cmds, name);
+        if (in_ram(cmds[first])) assert(called == set.names[first].c_str());
+    }
+
+    // names that are no commands, even the ones on an occupied slot or with the full hash of one
+    std::vector<std::string> misses = set.missing;
+    for (size_t i = 0; i < COMMAND_SET_N; i += 7)
+    {
+        if (!cmds[i]) continue;
+        const std::string &name = set.names[i];
+        misses.push_back(name.substr(0, name.size() - 1));
+        misses.push_back(name + "x");
+        misses.push_back("x" + name);
+    }
+    for (const std::string &name : misses)
+    {
+        if (first_of(cmds, name) >= 0) continue;
+        send(sc, serial, name);
+        assert(!called && unknown == name);
+    }
+}
+
+static void test_with_gaps()
+{
+    // NULL entries are skipped, and their names aren't found anymore. one of each kind of collision goes
+    const SmartCmdBase *cmds[COMMAND_SET_N];
+    for (size_t i = 0; i < COMMAND_SET_N; i++)
+        cmds[i] = i == 1 || i == 7 || i == 20 || i == COMMAND_SET_REPEATS ? NULL : set.cmds[i];
+    test_lookup(cmds);
+
+    StubStream serial;
+    CommandSetComm sc(cmds, serial, '\n', ' ', default_cb);
+    send(sc, serial, set.names[1]);
+    assert(!called && unknown == set.names[1]);
+    send(sc, serial, set.names[0]);
+    assert(called && called_name == set.names[0]);
+    send(sc, serial, set.names[20]);
+    assert(!called);
+    // the repeated name falls to its second appearance
+    send(sc, serial, set.names[COMMAND_SET_REPEATS]);
+    assert(called == set.names[COMMAND_SET_REPEATED].c_str());
+}
+
+int main()
+{
+    test_hash();
+    test_lookup(set.cmds);
+    test_with_gaps();
+    printf("ok\n");
+    return 0;
+}
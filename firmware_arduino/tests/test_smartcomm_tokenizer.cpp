@@ -0,0 +1,164 @@
+// __extractArguments (the single pass SmartTokenizer) against the multi pass one it replaced, on random lines: the same
+// command and arguments for every line, except where the control chars between separators now vanish with them
+
+#include "SmartComm.h"
+#include "old_tokenizer.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#define FUZZ_LINES 200000
+
+struct Tokens
+{
+    bool found;
+    std::vector<std::string> words; // the command and then the arguments
+};
+
+static Tokens tokens(bool old, std::string line, char endChar, char sepChar)
+{
+    char *command = NULL;
+    char *args[MAX_ARGUMENTS];
+    _smart_comm_size_t n = 0;
+    const size_t len = line.size();
+    // the old memmove reads up to a line past the '\0', see old_tokenizer.h
+    if (old) line.resize(2 * line.size() + 1, '\0');
+    const bool found = old ? old_tokenizer::__extractArguments(&line[0], endChar, sepChar, command, args, n)
+                           : __extractArguments(&line[0], endChar, sepChar, command, args, n);
+    Tokens t = {found, {}};
+    if (!found) return t;
+    assert(n <= MAX_ARGUMENTS);
+    t.words.push_back(command);
+    for (_smart_comm_size_t i = 0; i < n; i++)
+    {
+        // split in place
+        assert(args[i] > &line[0] && args[i] < &line[0] + len);
+        t.words.push_back(args[i]);
+    }
+    return t;
+}
+
+static bool operator==(const Tokens &a, const Tokens &b)
+{
+    return a.found == b.found && (!a.found || a.words == b.words);
+}
+
+static bool unwanted(char c, char endChar, char sepChar)
+{
+    return !(c == endChar || c == sepChar || (c > 32 && c < 127));
+}
+
+static std::string without_unwanted(const std::string &line, char endChar, char sepChar)
+{
+    std::string s;
+    for (char c : line)
+        if (!unwanted(c, endChar, sepChar)) s += c;
+    return s;
+}
+
+static void test_examples()
+{
+    const Tokens pump = tokens(false, "pump 250 50 true", '\n', ' ');
+    assert(pump.found && (pump.words == std::vector<std::string>{"pump", "250", "50", "true"}));
+    assert((tokens(false, "   hx   2\r\t  100  ", '\n', ' ').words == std::vector<std::string>{"hx", "2", "100"}));
+    assert((tokens(false, "a,,b,", '\n', ',').words == std::vector<std::string>{"a", "b"}));
+    assert(!tokens(false, "", '\n', ' ').found);
+    assert(!tokens(false, "    ", '\n', ' ').found);
+    assert(!tokens(false, " \t\r\x01 ", '\n', ' ').found);
+
+    // the arguments past MAX_ARGUMENTS are dropped
+    std::string line = "cmd";
+    for (int i = 0; i < MAX_ARGUMENTS + 3; i++) line += " " + std::to_string(i);
+    const Tokens many = tokens(false, line, '\n', ' ');
+    assert(many.words.size() == MAX_ARGUMENTS + 1 && many.words.back() == std::to_string(MAX_ARGUMENTS - 1));
+    assert(many == tokens(true, line, '\n', ' '));
+}
+
+static void test_control_chars_between_separators()
+{
+    // the behaviour that changed: a control char alone between two separators used to leave an empty argument behind,
+    // because the separators were collapsed before it was dropped. now it goes first and the separators are one run
+    const Tokens now = tokens(false, "a \t b", '\n', ' ');
+    assert((now.words == std::vector<std::string>{"a", "b"}));
+    const Tokens before = tokens(true, "a \t b", '\n', ' ');
+    assert((before.words == std::vector<std::string>{"a", "", "b"}));
+
+    // the same as the old one on the line without them
+    assert(now == tokens(true, without_unwanted("a \t b", '\n', ' '), '\n', ' '));
+    assert((tokens(false, "x \r\r y \x7f z", '\n', ' ').words == std::vector<std::string>{"x", "y", "z"}));
+    assert((tokens(false, "x,\x01,y", '\n', ',').words == std::vector<std::string>{"x", "y"}));
+}
+
+static void test_fuzz()
+{
+    std::mt19937 rng(2020);
+    // mostly word chars and separators, in runs, with the odd char the tokenizer drops
+    const std::string word = "abcXYZ019-_.{}\":";
+    const std::string dropped = "\t\r\x01\x1f\x7f\x80\xff";
+    size_t with_dropped = 0, changed = 0;
+    for (size_t i = 0; i < FUZZ_LINES; i++)
+    {
+        const char sepChar = rng() % 4 ? ' ' : ',';
+        const char endChar = '\n';
+        const bool dirty = rng() % 2;
+        const size_t len = rng() % 8 ? rng() % 40 : rng() % 400;
+        std::string line;
+        while (line.size() < len)
+        {
+            const uint32_t r = rng() % 16;
+            const size_t run = rng() % 3 + 1;
+            for (size_t k = 0; k < run; k++)
+                line += r < 9 ? word[rng() % word.size()] : (r < 14 || !dirty) ? sepChar : dropped[rng() % dropped.size()];
+        }
+
+        const Tokens now = tokens(false, line, endChar, sepChar);
+        const std::string clean = without_unwanted(line, endChar, sepChar);
+        // what the old one gives once the dropped chars can't come between separators anymore
+        assert(now == tokens(true, clean, endChar, sepChar));
+        if (clean == line)
+            assert(now == tokens(true, line, endChar, sepChar));
+        else
+        {
+            ++with_dropped;
+            if (!(now == tokens(true, line, endChar, sepChar))) ++changed;
+        }
+    }
+    // both kinds of line came up, and the old one does differ on some of the ones with dropped chars
+    assert(with_dropped > FUZZ_LINES / 4 && changed > 0);
+}
+
+static void test_streamed()
+{
+    // SmartComm feeds the tokenizer a char at a time as the line arrives, it must end up the same as the whole line
+    std::mt19937 rng(21);
+    for (int i = 0; i < 20000; i++)
+    {
+        std::string line;
+        const size_t len = rng() % 60;
+        while (line.size() < len) line += rng() % 3 ? static_cast<char>('a' + rng() % 26) : rng() % 5 ? ' ' : '\t';
+        char buffer[STREAM_BUFFER_LEN + 1];
+        SmartTokenizer tokenizer(buffer, STREAM_BUFFER_LEN, '\n', ' ');
+        for (char c : line) tokenizer.push(c);
+        const bool found = tokenizer.finish();
+        assert(!tokenizer.overflow());
+        const Tokens whole = tokens(false, line, '\n', ' ');
+        assert(found == whole.found);
+        if (!found) continue;
+        assert(whole.words[0] == tokenizer.command);
+        assert(whole.words.size() == tokenizer.nArgs + 1u);
+        for (_smart_comm_size_t k = 0; k < tokenizer.nArgs; k++) assert(whole.words[k + 1] == tokenizer.args[k]);
+    }
+}
+
+int main()
+{
+    test_examples();
+    test_control_chars_between_separators();
+    test_fuzz();
+    test_streamed();
+    printf("ok\n");
+    return 0;
+}
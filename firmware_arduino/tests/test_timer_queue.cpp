@@ -0,0 +1,145 @@
+// TimerQueue against a sorted set of (deadline, order scheduled) doing the same random schedule, cancel, reschedule
+// and pop_due calls
+
+#include "TimerQueue.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <map>
+#include <random>
+#include <set>
+#include <tuple>
+#include <vector>
+
+// deadline, order it was (re)scheduled in, id
+typedef std::tuple<uint64_t, uint32_t, int> Timer;
+
+static void test_same_deadline()
+{
+    // fifo among equal deadlines, also after a reschedule
+    TimerQueue<int, 8> q;
+    TimerHandle handles[5];
+    for (int i = 0; i < 5; i++) handles[i] = q.schedule(100, &i);
+    assert(q.reschedule(handles[1], 100));
+    const int order[] = {0, 2, 3, 4, 1};
+    int v;
+    uint64_t deadline;
+    for (int expected : order)
+    {
+        assert(q.pop_due(100, &v, &deadline));
+        assert(v == expected && deadline == 100);
+    }
+    assert(q.empty() && !q.pop(&v));
+}
+
+static void test_handles()
+{
+    TimerQueue<int, 2> q;
+    int v = 1;
+    const TimerHandle a = q.schedule(10, &v);
+    const TimerHandle b = q.schedule(20, &v);
+    assert(a != TIMER_QUEUE_INVALID_HANDLE && b != TIMER_QUEUE_INVALID_HANDLE);
+    assert(q.full() && q.schedule(30, &v) == TIMER_QUEUE_INVALID_HANDLE);
+    assert(q.cancel(a));
+    // the entry of a is reused, the old handle mustn't reach the new timer
+    const TimerHandle c = q.schedule(5, &v);
+    assert(c != a);
+    assert(!q.pending(a) && !q.cancel(a) && !q.reschedule(a, 1));
+    assert(q.pending(c) && q.pending(b));
+    assert(!q.cancel(TIMER_QUEUE_INVALID_HANDLE));
+    q.clean();
+    assert(q.empty() && !q.pending(b) && !q.pending(c));
+}
+
+template <size_t N>
+static void fuzz(uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    TimerQueue<int, N> q;
+    std::set<Timer> ref;
+    std::map<int, std::pair<TimerHandle, Timer>> live;
+    std::vector<TimerHandle> dead;
+    uint32_t seq = 0;
+    int next_id = 0;
+
+    auto random_live = [&]() {
+        auto it = live.begin();
+        std::advance(it, rng() % live.size());
+        return it;
+    };
+
+    for (int i = 0; i < 200000; i++)
+    {
+        const uint32_t op = rng() % 5;
+        if (op <= 1)
+        {
+            const uint64_t deadline = rng() % 1000;
+            const int id = next_id++;
+            const TimerHandle h = q.schedule(deadline, &id);
+            assert((h != TIMER_QUEUE_INVALID_HANDLE) == (live.size() < N));
+            if (h == TIMER_QUEUE_INVALID_HANDLE) continue;
+            const Timer t(deadline, seq++, id);
+            ref.insert(t);
+            live[id] = {h, t};
+        }
+        else if (op == 2 && !live.empty())
+        {
+            auto it = random_live();
+            assert(q.cancel(it->second.first));
+            ref.erase(it->second.second);
+            dead.push_back(it->second.first);
+            live.erase(it);
+        }
+        else if (op == 3 && !live.empty())
+        {
+            auto it = random_live();
+            const uint64_t deadline = rng() % 1000;
+            assert(q.reschedule(it->second.first, deadline));
+            ref.erase(it->second.second);
+            it->second.second = Timer(deadline, seq++, it->first);
+            ref.insert(it->second.second);
+        }
+        else if (op == 4)
+        {
+            const uint64_t now = rng() % 1000;
+            int id;
+            uint64_t deadline = 0;
+            const bool due = !ref.empty() && std::get<0>(*ref.begin()) <= now;
+            assert(q.pop_due(now, &id, &deadline) == due);
+            if (due)
+            {
+                assert(id == std::get<2>(*ref.begin()) && deadline == std::get<0>(*ref.begin()));
+                dead.push_back(live[id].first);
+                live.erase(id);
+                ref.erase(ref.begin());
+            }
+        }
+
+        if (!dead.empty() && rng() % 10 == 0)
+            assert(!q.pending(dead[rng() % dead.size()]));
+        assert(q.size() == ref.size());
+        uint64_t next;
+        assert(q.next_deadline(&next) == !ref.empty());
+        if (!ref.empty()) assert(next == std::get<0>(*ref.begin()));
+    }
+
+    // draining gives everything back in order
+    int id;
+    for (const Timer &t : ref)
+    {
+        assert(q.pop(&id));
+        assert(id == std::get<2>(t));
+    }
+    assert(q.empty());
+}
+
+int main()
+{
+    test_same_deadline();
+    test_handles();
+    fuzz<1>(1);
+    fuzz<16>(16);
+    fuzz<100>(100);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,175 @@
+// the integer aggregate against the float one and against a double reference, on raw HX711 counts
+
+#include "welfords.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+
+static void reference(const std::vector<int32_t> &values, double *mean, double *stdev)
+{
+    double sum = 0;
+    for (int32_t v : values) sum += v;
+    (*mean) = sum / values.size();
+    double M2 = 0;
+    for (int32_t v : values) M2 += (v - *mean) * (v - *mean);
+    (*stdev) = sqrt(M2 / (values.size() - 1));
+}
+
+// a scale reading: a big offset, a bit of noise
+static std::vector<int32_t> samples(std::mt19937 &rng, size_t n, int32_t offset, double noise)
+{
+    std::normal_distribution<double> dist(offset, noise);
+    std::vector<int32_t> values(n);
+    for (int32_t &v : values) v = static_cast<int32_t>(lround(dist(rng)));
+    return values;
+}
+
+static void check(const std::vector<int32_t> &values)
+{
+    double ref_mean, ref_stdev;
+    reference(values, &ref_mean, &ref_stdev);
+
+    Welfords::Aggregate agg_f;
+    Welfords::AggregateInt agg_i, agg_batch;
+    for (int32_t v : values)
+    {
+        Welfords::update(&agg_f, static_cast<float>(v));
+        Welfords::update(&agg_i, v);
+    }
+    Welfords::update(&agg_batch, values.data(), values.size());
+    assert(agg_batch.count == agg_i.count && agg_batch.shift == agg_i.shift);
+    assert(agg_batch.sum == agg_i.sum && agg_batch.sum_sq == agg_i.sum_sq);
+
+    float mean_f, stdev_f, mean_i, stdev_i;
+    assert(Welfords::finalize(&agg_f, &mean_f, &stdev_f));
+    assert(Welfords::finalize(&agg_i, &mean_i, &stdev_i));
+
+    // the integer sums are exact, only the final conversion rounds: within a float ulp of the mean and of the stdev
+    const double mean_ulp = fabs(ref_mean) * 2 * FLT_EPSILON + FLT_EPSILON;
+    assert(fabs(mean_i - ref_mean) <= mean_ulp);
+    assert(fabs(stdev_i - ref_stdev) <= ref_stdev * 1e-5 + 1e-6);
+    // the float one rounds on every update, it's only as good as its mantissa lets it be. the integer one is never worse
+    assert(fabs(mean_i - ref_mean) <= fabs(mean_f - ref_mean) + mean_ulp);
+    assert(fabs(mean_f - ref_mean) <= fabs(ref_mean) * 1e-5 + 1e-3);
+    assert(fabs(stdev_f - ref_stdev) <= ref_stdev * 0.05 + 0.5);
+
+    // both say the same about the standard error, away from the threshold
+    const float se = ref_stdev / sqrt(values.size());
+    for (float factor : {0.5f, 2.0f})
+        assert(Welfords::standard_error_reached(&agg_i, se * factor) ==
+               Welfords::standard_error_reached(&agg_f, se * factor));
+}
+
+static void test_equivalence()
+{
+    std::mt19937 rng(6);
+    check({1, 2, 3, 4});
+    check({-0x800000, 0x7FFFFF});
+    for (int32_t offset : {0, 1000, -3000000, 8000000, -8388000})
+        for (double noise : {0.5, 20.0, 3000.0})
+            for (size_t n : {2, 10, 80, 5000})
+                check(samples(rng, n, offset, noise));
+}
+
+static void test_merge_remove()
+{
+    std::mt19937 rng(7);
+    const std::vector<int32_t> a = samples(rng, 300, -3000000, 40), b = samples(rng, 200, 2500000, 40);
+
+    Welfords::AggregateInt agg_a, agg_b, agg_all;
+    Welfords::update(&agg_a, a.data(), a.size());
+    Welfords::update(&agg_b, b.data(), b.size());
+    Welfords::update(&agg_all, a.data(), a.size());
+    Welfords::update(&agg_all, b.data(), b.size());
+    Welfords::merge(&agg_a, &agg_b);
+    // exact, not just close
+    assert(agg_a.count == agg_all.count && agg_a.shift == agg_all.shift);
+    assert(agg_a.sum == agg_all.sum && agg_a.sum_sq == agg_all.sum_sq);
+
+    for (int32_t v : b) Welfords::remove(&agg_all, v);
+    Welfords::AggregateInt agg_only_a;
+    Welfords::update(&agg_only_a, a.data(), a.size());
+    assert(agg_all.count == agg_only_a.count && agg_all.sum == agg_only_a.sum && agg_all.sum_sq == agg_only_a.sum_sq);
+}
+
+// float: chan's merge and the batch update against one sequential pass. floats round differently on each path, so
+// close and not equal
+static void check_float_merge(const std::vector<float> &a, const std::vector<float> &b)
+{
+    Welfords::Aggregate seq, agg_a, agg_b, batch;
+    for (float v : a) Welfords::update(&seq, v);
+    for (float v : b) Welfords::update(&seq, v);
+    for (float v : a) Welfords::update(&agg_a, v);
+    Welfords::update(&agg_b, b.data(), b.size());
+    Welfords::update(&batch, a.data(), a.size());
+    Welfords::update(&batch, b.data(), b.size());
+    Welfords::merge(&agg_a, &agg_b);
+
+    for (const Welfords::Aggregate *agg : {&agg_a, &batch})
+    {
+        assert(agg->count == seq.count);
+        assert(fabs(agg->mean - seq.mean) <= fabs(seq.mean) * 1e-5 + 1e-4);
+        const float var = seq.count > 1 ? seq.M2 / (seq.count - 1) : 0;
+        const float agg_var = agg->count > 1 ? agg->M2 / (agg->count - 1) : 0;
+        assert(fabs(agg_var - var) <= var * 1e-3 + 1e-4);
+    }
+}
+
+static void test_float_merge()
+{
+    std::mt19937 rng(11);
+    std::normal_distribution<float> grams(250, 3), empty_slot(0, 0.2);
+    std::vector<float> a(400), b(150), c(3);
+    for (float &v : a) v = grams(rng);
+    for (float &v : b) v = grams(rng) + 20; // a different mean, the cross term of the merge matters
+    for (float &v : c) v = empty_slot(rng);
+    check_float_merge(a, b);
+    check_float_merge(b, c);
+    check_float_merge(a, {});
+    check_float_merge({}, b);
+    check_float_merge({}, {});
+
+    // merging an empty aggregate in either direction leaves the other one exactly as it was
+    Welfords::Aggregate agg, empty;
+    Welfords::update(&agg, a.data(), a.size());
+    const Welfords::Aggregate before = agg;
+    Welfords::merge(&agg, &empty);
+    assert(agg.count == before.count && agg.mean == before.mean && agg.M2 == before.M2);
+    Welfords::merge(&empty, &agg);
+    assert(empty.count == before.count && empty.mean == before.mean && empty.M2 == before.M2);
+}
+
+static void test_window()
+{
+    std::mt19937 rng(8);
+    const std::vector<int32_t> values = samples(rng, 1000, 1200000, 100);
+    Welfords::AggregateWindow<16> window;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        window.update(values[i]);
+        if (i < 2) continue;
+        const size_t first = i + 1 > 16 ? i + 1 - 16 : 0;
+        const std::vector<int32_t> last(values.begin() + first, values.begin() + i + 1);
+        assert(window.count() == last.size());
+        double ref_mean, ref_stdev;
+        reference(last, &ref_mean, &ref_stdev);
+        float mean, stdev;
+        assert(window.finalize(&mean, &stdev));
+        assert(fabs(mean - ref_mean) <= fabs(ref_mean) * 2 * FLT_EPSILON);
+        assert(fabs(stdev - ref_stdev) <= ref_stdev * 1e-5 + 1e-6);
+    }
+}
+
+int main()
+{
+    test_equivalence();
+    test_merge_remove();
+    test_float_merge();
+    test_window();
+    printf("ok\n");
+    return 0;
+}
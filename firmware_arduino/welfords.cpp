@@ -1,5 +1,7 @@
 #include "welfords.h"
 
+#include <pico/divider.h>
+
 void Welfords::update(Aggregate *agg, float new_value)
 {
     float delta, delta2;
@@ -10,6 +12,28 @@ void Welfords::update(Aggregate *agg, float new_value)
     agg->M2 += delta * delta2;
 }
 
+void Welfords::update(Aggregate *agg, const float *values, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        update(agg, values[i]);
+}
+
+void Welfords::merge(Aggregate *a, const Aggregate *b)
+{
+    if (b->count == 0) return;
+    if (a->count == 0)
+    {
+        (*a) = (*b);
+        return;
+    }
+    const uint32_t count = a->count + b->count;
+    const float delta = b->mean - a->mean;
+    const float b_weight = static_cast<float>(b->count) / count;
+    a->mean += delta * b_weight;
+    a->M2 += b->M2 + delta * delta * a->count * b_weight;
+    a->count = count;
+}
+
 bool Welfords::finalize(Aggregate *agg, float *mean, float *stdev)
 {
     if (agg->count < 2) return false;
@@ -18,4 +42,112 @@ bool Welfords::finalize(Aggregate *agg, float *mean, float *stdev)
     float sample_variance = agg->M2 / (agg->count - 1);
     (*stdev) = sqrt(sample_variance);
     return true;
+}
+
+bool Welfords::standard_error_reached(const Aggregate *agg, float target_se)
+{
+    // se^2 = M2 / (n * (n-1)), so compare without a sqrt or a division
+    if (agg->count < 2) return false;
+    return agg->M2 <= target_se * target_se * agg->count * (agg->count - 1);
+}
+
+void Welfords::update(AggregateInt *agg, int32_t new_value)
+{
+    if (agg->count == 0)
+        agg->shift = new_value;
+    const int32_t d = new_value - agg->shift;
+    agg->count += 1;
+    agg->sum += d;
+    agg->sum_sq += static_cast<int64_t>(d) * d;
+}
+
+void Welfords::update(AggregateInt *agg, const int32_t *values, size_t n)
+{
+    if (n == 0) return;
+    if (agg->count == 0)
+        agg->shift = values[0];
+    // sum locally, the loop then has no stores to memory
+    int64_t sum = 0, sum_sq = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const int32_t d = values[i] - agg->shift;
+        sum += d;
+        sum_sq += static_cast<int64_t>(d) * d;
+    }
+    agg->count += n;
+    agg->sum += sum;
+    agg->sum_sq += sum_sq;
+}
+
+void Welfords::merge(AggregateInt *a, const AggregateInt *b)
+{
+    if (b->count == 0) return;
+    if (a->count == 0)
+    {
+        (*a) = (*b);
+        return;
+    }
+    // every sample of b is d + delta relative to the shift of a
+    const int64_t delta = static_cast<int64_t>(b->shift) - a->shift;
+    a->sum_sq += b->sum_sq + 2 * delta * b->sum + b->count * delta * delta;
+    a->sum += b->sum + b->count * delta;
+    a->count += b->count;
+}
+
+void Welfords::remove(AggregateInt *agg, int32_t old_value)
+{
+    if (agg->count == 0) return;
+    // the shift stays, any value works as long as the same one is used for every sample
+    const int32_t d = old_value - agg->shift;
+    agg->count -= 1;
+    agg->sum -= d;
+    agg->sum_sq -= static_cast<int64_t>(d) * d;
+}
+
+bool Welfords::finalize(AggregateInt *agg, float *mean, float *stdev)
+{
+    if (agg->count < 2) return false;
+    // sum = q*n + r, so sum^2/n = q*sum + r*sum/n. by cauchy-schwarz |q*sum| <= sum_sq, so the integer part can't overflow.
+    // the 64 bit division runs on the SIO hardware divider
+    const int64_t n = agg->count;
+    int64_t r;
+    const int64_t q = divmod_s64s64_rem(agg->sum, n, &r);
+    (*mean) = static_cast<float>(agg->shift + q) + static_cast<float>(r) / agg->count;
+    const float M2 = static_cast<float>(agg->sum_sq - q * agg->sum) - static_cast<float>(r) * static_cast<float>(agg->sum) / agg->count;
+    const float sample_variance = M2 > 0 ? M2 / (agg->count - 1) : 0;
+    (*stdev) = sqrt(sample_variance);
+    return true;
+}
+
+bool Welfords::standard_error_reached(const AggregateInt *agg, float target_se)
+{
+    // n * M2 = n * sum_sq - sum^2 and se^2 = M2 / (n * (n-1)). exact while n * sum_sq fits in 64 bits, which for the spread
+    // of a scale reading is a lot of samples
+    if (agg->count < 2) return false;
+    const int64_t n = agg->count;
+    const float n_M2 = static_cast<float>(n * agg->sum_sq - agg->sum * agg->sum);
+    const float n_f = static_cast<float>(agg->count);
+    return n_M2 <= target_se * target_se * n_f * n_f * (n_f - 1);
+}
+
+void Welfords::update(AggregateEWMA *agg, float new_value)
+{
+    if (agg->count++ == 0)
+    {
+        agg->mean = new_value;
+        agg->variance = 0;
+        return;
+    }
+    const float delta = new_value - agg->mean;
+    const float increment = agg->alpha * delta;
+    agg->mean += increment;
+    agg->variance = (1 - agg->alpha) * (agg->variance + delta * increment);
+}
+
+bool Welfords::finalize(const AggregateEWMA *agg, float *mean, float *stdev)
+{
+    if (agg->count < 2) return false;
+    (*mean) = agg->mean;
+    (*stdev) = sqrt(agg->variance);
+    return true;
 }
\ No newline at end of file
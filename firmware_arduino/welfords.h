@@ -2,6 +2,7 @@
 #define _WELFORDS_H_
 
 #include <Arduino.h>
+#include "Queues.h"
 // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
 
 namespace Welfords
@@ -12,8 +13,82 @@ namespace Welfords
         float mean = 0, M2 = 0;
     };
 
+    // integer version for raw HX711 counts (the RP2040 has no FPU). It accumulates the samples shifted by the first one,
+    // which keeps the sums small and exact. floats are only produced by finalize
+    // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Computing_shifted_data
+    struct AggregateInt
+    {
+        uint32_t count = 0;
+        int32_t shift = 0;
+        int64_t sum = 0, sum_sq = 0;
+    };
+
+    // exponentially weighted mean and variance. every sample weighs alpha, older ones decay by (1 - alpha) per sample,
+    // so it follows a slowly drifting signal while keeping track of its noise
+    // https://fanf2.user.srcf.net/hermes/doc/antiforgery/stats.pdf
+    struct AggregateEWMA
+    {
+        float alpha;
+        float mean = 0, variance = 0;
+        uint32_t count = 0;
+
+        AggregateEWMA(float alpha=0.1) : alpha(alpha) {}
+    };
+
     void update(Aggregate *agg, float new_value);
+    void update(Aggregate *agg, const float *values, size_t n);
+    // adds the samples of b to a (chan's parallel algorithm), as if they had been updated one by one
+    void merge(Aggregate *a, const Aggregate *b);
     bool finalize(Aggregate *agg, float *mean, float *stdev);
+    // true if the standard error of the mean is <= target_se. cheap enough to call after every update
+    bool standard_error_reached(const Aggregate *agg, float target_se);
+
+    void update(AggregateInt *agg, int32_t new_value);
+    void update(AggregateInt *agg, const int32_t *values, size_t n);
+    // exact, the sums of b are re-shifted to the shift of a
+    void merge(AggregateInt *a, const AggregateInt *b);
+    // takes back a sample that was added before, exactly
+    void remove(AggregateInt *agg, int32_t old_value);
+    bool finalize(AggregateInt *agg, float *mean, float *stdev);
+    bool standard_error_reached(const AggregateInt *agg, float target_se);
+
+    void update(AggregateEWMA *agg, float new_value);
+    bool finalize(const AggregateEWMA *agg, float *mean, float *stdev);
+    inline void reset(AggregateEWMA *agg) { agg->mean = 0; agg->variance = 0; agg->count = 0; }
+
+    // statistics of the last K samples. the samples are kept in a ring, each update removes the oldest one from the
+    // sums once the window is full, so updates are O(1) and exact
+    template <size_t K>
+    class AggregateWindow
+    {
+    private:
+        QueueFIFO<int32_t, K> _window;
+        AggregateInt _agg;
+
+    public:
+        AggregateWindow() : _window(false) {}
+
+        void update(int32_t new_value)
+        {
+            int32_t oldest;
+            if (_window.full() && _window.pop(&oldest))
+                Welfords::remove(&_agg, oldest);
+            _window.push(&new_value);
+            Welfords::update(&_agg, new_value);
+        }
+
+        void reset()
+        {
+            int32_t oldest;
+            while (_window.pop(&oldest)) {}
+            _agg = AggregateInt();
+        }
+
+        inline uint32_t count() const { return _agg.count; }
+        inline bool full() const { return _window.full(); }
+        bool finalize(float *mean, float *stdev) { return Welfords::finalize(&_agg, mean, stdev); }
+        bool standard_error_reached(float target_se) const { return Welfords::standard_error_reached(&_agg, target_se); }
+    };
 }
 
 #endif /* _WELFORDS_H_ */
\ No newline at end of file